@@ -158,6 +158,20 @@ PMCOMM_API void PM_CALLCONV PMFreePeriodicData(struct PMPeriodicRecord *records)
 PMCOMM_API int PM_CALLCONV PMReadProfileData(struct PMConnection *conn, struct PMProfileRecord **battery1Records, struct PMProfileRecord **battery2Records, PMProgressCallback callback, void *usrdata);
 PMCOMM_API void PM_CALLCONV PMFreeProfileData(struct PMProfileRecord *records);
 
+/* Sizes of the logged data memory and its pointers, as read by PMReadPeriodicRaw() and PMReadProfileRaw() */
+#define PM_PERIODIC_RAW_SIZE (29 * 256)
+#define PM_PERIODIC_PTR_SIZE 4
+#define PM_PROFILE_RAW_SIZE (16 * 256)
+#define PM_PROFILE_PTR_SIZE 3
+
+/* Read the periodic or profile data memory without decoding it, so that it can be kept as it is and
+   decoded later with PMDecodePeriodicData() or PMDecodeProfileData(). Decoding gives the same records,
+   to be freed the same way, as PMReadPeriodicData() and PMReadProfileData() */
+PMCOMM_API int PM_CALLCONV PMReadPeriodicRaw(struct PMConnection *conn, unsigned char *buffer, unsigned char *ptrBuffer, PMProgressCallback callback, void *usrdata);
+PMCOMM_API int PM_CALLCONV PMDecodePeriodicData(unsigned char *buffer, unsigned char *ptrBuffer, struct PMPeriodicRecord **records);
+PMCOMM_API int PM_CALLCONV PMReadProfileRaw(struct PMConnection *conn, unsigned char *buffer, unsigned char *ptrBuffer, PMProgressCallback callback, void *usrdata);
+PMCOMM_API int PM_CALLCONV PMDecodeProfileData(unsigned char *buffer, unsigned char *ptrBuffer, struct PMProfileRecord **battery1Records, struct PMProfileRecord **battery2Records);
+
 #define PM_MAX_EFFICIENCY_RECORDS 224
 
 /* Read efficiency data */
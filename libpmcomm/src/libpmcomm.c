@@ -493,14 +493,10 @@ PMCOMM_API int PM_CALLCONV PMReset(struct PMConnection *conn, enum PMResetType r
 // #define DEBUG_FILE_WRITE // writes raw data to a file for debugging
 // #define DEBUG_FILE_READ // reads raw data back from a file for debugging (instead of reading normally)
 
-PMCOMM_API int PM_CALLCONV PMReadPeriodicData(struct PMConnection *conn, struct PMPeriodicRecord **records, PMProgressCallback callback, void *usrdata) {
-	*records = NULL;
-
-	unsigned char *buffer = malloc(29 * 256);
-	if(buffer == NULL)
-		return PM_ERROR_ENOMEM;
-
-	unsigned char ptrBuffer[16];
+/* Reads the periodic data memory without decoding it. BUFFER must hold PM_PERIODIC_RAW_SIZE bytes
+   and PTRBUFFER PM_PERIODIC_PTR_SIZE bytes. Returns 0 on success, <0 on error */
+PMCOMM_API int PM_CALLCONV PMReadPeriodicRaw(struct PMConnection *conn, unsigned char *buffer, unsigned char *ptrBuffer, PMProgressCallback callback, void *usrdata) {
+	unsigned char ptrRaw[16];
 
 #ifdef DEBUG_FILE_READ
 	int error = 0;
@@ -511,25 +507,19 @@ PMCOMM_API int PM_CALLCONV PMReadPeriodicData(struct PMConnection *conn, struct
 
 	FILE *ptrFile = fopen("periodicptr.raw", "rb");
 	if(!ptrFile) error = -1;
-	if(!error) error = fread(ptrBuffer, 4, 1, ptrFile) == 0;
+	if(!error) error = fread(ptrRaw, 4, 1, ptrFile) == 0;
 	fclose(ptrFile);
 
-	if(error != 0) {
-		free(buffer);
+	if(error != 0)
 		return PM_ERROR_OTHER;
-	}
 #else
-	int error = PMReadRaw(conn, 0x1d2, ptrBuffer);
-	if(error < 0) {
-		free(buffer);
+	int error = PMReadRaw(conn, 0x1d2, ptrRaw);
+	if(error < 0)
 		return error;
-	}
 
 	error = PMReadLong(conn, 0x3, 29, buffer, callback, usrdata);
-	if(error < 0) {
-		free(buffer);
+	if(error < 0)
 		return error;
-	}
 
 #ifdef DEBUG_FILE_WRITE
 	FILE *rawFile = fopen("periodic.raw", "wb");
@@ -539,30 +529,43 @@ PMCOMM_API int PM_CALLCONV PMReadPeriodicData(struct PMConnection *conn, struct
 
 	FILE *ptrFile = fopen("periodicptr.raw", "wb");
 	if(!ptrFile) error = -1;
-	if(!error) error = fwrite(ptrBuffer, 4, 1, ptrFile) == 0;
+	if(!error) error = fwrite(ptrRaw, 4, 1, ptrFile) == 0;
 	fclose(ptrFile);
 
-	if(error != 0) {
-		free(buffer);
+	if(error != 0)
 		return PM_ERROR_OTHER;
-	}
 #endif // DEBUG_FILE_WRITE
 #endif // DEBUG_FILE_READ
 
-	error = PMFormatPeriodicData(buffer, ptrBuffer, records);
-	free(buffer);
-	return error;
+	memcpy(ptrBuffer, ptrRaw, PM_PERIODIC_PTR_SIZE);
+	return 0;
 }
 
-PMCOMM_API int PM_CALLCONV PMReadProfileData(struct PMConnection *conn, struct PMProfileRecord **battery1Records, struct PMProfileRecord **battery2Records, PMProgressCallback callback, void *usrdata) {
-	*battery1Records = NULL;
-	*battery2Records = NULL;
+/* Decodes periodic data memory read by PMReadPeriodicRaw(), which may have been stored since.
+   Returns 0 on success, <0 on error */
+PMCOMM_API int PM_CALLCONV PMDecodePeriodicData(unsigned char *buffer, unsigned char *ptrBuffer, struct PMPeriodicRecord **records) {
+	return PMFormatPeriodicData(buffer, ptrBuffer, records);
+}
+
+PMCOMM_API int PM_CALLCONV PMReadPeriodicData(struct PMConnection *conn, struct PMPeriodicRecord **records, PMProgressCallback callback, void *usrdata) {
+	*records = NULL;
 
-	unsigned char *buffer = malloc(16 * 256);
+	unsigned char *buffer = malloc(PM_PERIODIC_RAW_SIZE);
 	if(buffer == NULL)
 		return PM_ERROR_ENOMEM;
 
-	unsigned char ptrBuffer[16];
+	unsigned char ptrBuffer[PM_PERIODIC_PTR_SIZE];
+	int error = PMReadPeriodicRaw(conn, buffer, ptrBuffer, callback, usrdata);
+	if(error >= 0)
+		error = PMFormatPeriodicData(buffer, ptrBuffer, records);
+	free(buffer);
+	return error;
+}
+
+/* Reads the profile data memory without decoding it. BUFFER must hold PM_PROFILE_RAW_SIZE bytes
+   and PTRBUFFER PM_PROFILE_PTR_SIZE bytes. Returns 0 on success, <0 on error */
+PMCOMM_API int PM_CALLCONV PMReadProfileRaw(struct PMConnection *conn, unsigned char *buffer, unsigned char *ptrBuffer, PMProgressCallback callback, void *usrdata) {
+	unsigned char ptrRaw[16];
 #ifdef DEBUG_FILE_READ
 	int error = 0;
 	FILE *rawFile = fopen("profile.raw", "rb");
@@ -572,30 +575,24 @@ PMCOMM_API int PM_CALLCONV PMReadProfileData(struct PMConnection *conn, struct P
 
 	FILE *ptrFile = fopen("profileptr.raw", "rb");
 	if(!ptrFile) error = -1;
-	if(!error) error = fread(ptrBuffer, 3, 1, ptrFile) == 0;
+	if(!error) error = fread(ptrRaw, 3, 1, ptrFile) == 0;
 	fclose(ptrFile);
 
-	if(error) {
-		free(buffer);
+	if(error)
 		return PM_ERROR_OTHER;
-	}
 #else
-	int error = PMReadRaw(conn, 0x1d1, ptrBuffer);
-	if(error < 0) {
-		free(buffer);
+	int error = PMReadRaw(conn, 0x1d1, ptrRaw);
+	if(error < 0)
 		return error;
-	}
 
 	error = PMReadLong(conn, 0x20, 16, buffer, callback, usrdata);
-	if(error < 0) {
-		free(buffer);
+	if(error < 0)
 		return error;
-	}
 
 #ifdef DEBUG_FILE_WRITE
 	FILE *ptrFile = fopen("profileptr.raw", "wb");
 	if(!ptrFile) error = -1;
-	if(!error) error = fwrite(ptrBuffer, 3, 1, ptrFile) == 0;
+	if(!error) error = fwrite(ptrRaw, 3, 1, ptrFile) == 0;
 	fclose(ptrFile);
 
 	FILE *rawFile = fopen("profile.raw", "wb");
@@ -603,14 +600,33 @@ PMCOMM_API int PM_CALLCONV PMReadProfileData(struct PMConnection *conn, struct P
 	if(!error) error = fwrite(buffer, 256, 16, rawFile) == 0;
 	fclose(rawFile);
 
-	if(error != 0) {
-		free(buffer);
+	if(error != 0)
 		return PM_ERROR_OTHER;
-	}
 #endif // DEBUG_FILE_WRITE
 #endif // DEBUG_FILE_READ
 
-	error = PMFormatProfileData(buffer, ptrBuffer, battery1Records, battery2Records);
+	memcpy(ptrBuffer, ptrRaw, PM_PROFILE_PTR_SIZE);
+	return 0;
+}
+
+/* Decodes profile data memory read by PMReadProfileRaw(), which may have been stored since.
+   Returns 0 on success, <0 on error */
+PMCOMM_API int PM_CALLCONV PMDecodeProfileData(unsigned char *buffer, unsigned char *ptrBuffer, struct PMProfileRecord **battery1Records, struct PMProfileRecord **battery2Records) {
+	return PMFormatProfileData(buffer, ptrBuffer, battery1Records, battery2Records);
+}
+
+PMCOMM_API int PM_CALLCONV PMReadProfileData(struct PMConnection *conn, struct PMProfileRecord **battery1Records, struct PMProfileRecord **battery2Records, PMProgressCallback callback, void *usrdata) {
+	*battery1Records = NULL;
+	*battery2Records = NULL;
+
+	unsigned char *buffer = malloc(PM_PROFILE_RAW_SIZE);
+	if(buffer == NULL)
+		return PM_ERROR_ENOMEM;
+
+	unsigned char ptrBuffer[PM_PROFILE_PTR_SIZE];
+	int error = PMReadProfileRaw(conn, buffer, ptrBuffer, callback, usrdata);
+	if(error >= 0)
+		error = PMFormatProfileData(buffer, ptrBuffer, battery1Records, battery2Records);
 	free(buffer);
 	return error;
 }
@@ -129,6 +129,7 @@ void AlarmListModel::setManager(SiteManager *newManager) {
 	beginResetModel();
 	if(manager != NULL) {
 		disconnect(manager, 0, this, 0);
+		manager->unsubscribe(PM_DALARM);
 	}
 
 	manager = newManager;
@@ -137,7 +138,9 @@ void AlarmListModel::setManager(SiteManager *newManager) {
 	alarmsEnabled[1].clear();
 
 	if(manager != NULL) {
+		manager->subscribe(PM_DALARM); // Keeps the alarms at full rate rather than the heartbeat
 		connect(manager, SIGNAL(displayUpdated(PMDisplayNumber)), this, SLOT(displayUpdated(PMDisplayNumber)));
+		connect(manager, SIGNAL(allDisplaysUpdated()), this, SLOT(allDisplaysUpdated()));
 		connect(manager, SIGNAL(programUpdated(PMProgramNumber)), this, SLOT(programUpdated(PMProgramNumber)));
 		connect(manager, SIGNAL(statusChanged(SiteManager::Status)), this, SLOT(statusChanged(SiteManager::Status)));
 	}
@@ -178,6 +181,11 @@ void AlarmListModel::displayUpdated(PMDisplayNumber display) {
 	}
 }
 
+// Snapshot cycles only send this, not displayUpdated()
+void AlarmListModel::allDisplaysUpdated() {
+	displayUpdated(PM_DALARM);
+}
+
 void AlarmListModel::programUpdated(PMProgramNumber program) {
 	if(program != PM_P22_23 && program != PM_P24_25)
 		return;
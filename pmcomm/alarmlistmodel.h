@@ -24,6 +24,7 @@ public:
 
 public slots:
 	void displayUpdated(PMDisplayNumber display);
+	void allDisplaysUpdated();
 	void programUpdated(PMProgramNumber program);
 	void statusChanged(SiteManager::Status status);
 
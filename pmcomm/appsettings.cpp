@@ -4,9 +4,12 @@
 
 #include <QMetaObject>
 #include <QMetaEnum>
-#include <QWidget>
 #include <QSettings>
 
+#ifndef PMCOMM_HEADLESS
+#include <QWidget>
+#endif
+
 // The way to get standard locations changed between Qt4 and Qt5
 #if QT_VERSION >= 0x050000
 #include <QStandardPaths>
@@ -25,6 +28,7 @@ AppSettings::AppSettings(QSettings *s) {
 	defaultDisplays << PM_D1 << PM_D2 << PM_D7 << PM_D8 << PM_D9 << PM_D28;
 }
 
+#ifndef PMCOMM_HEADLESS
 void AppSettings::restoreWindowGeometry(QWidget *widget) {
 	if(settings->contains("general/geometry")) {
 		widget->restoreGeometry(settings->value("general/geometry").toByteArray());
@@ -34,6 +38,7 @@ void AppSettings::restoreWindowGeometry(QWidget *widget) {
 void AppSettings::saveWindowGeometry(QWidget *widget) {
 	settings->setValue("general/geometry", widget->saveGeometry());
 }
+#endif
 
 AppSettings::TempUnit AppSettings::getTempUnit() {
 	return decodeTempUnit(settings->value("general/tempUnit", encodeTempUnit(Celsius)));
@@ -77,6 +82,14 @@ QMap<int, QSharedPointer<SiteSettings> > *AppSettings::getSites() {
 		int downloadInterval = settings->value("downloadInterval").toInt();
 		site->setDownloadInterval(downloadInterval);
 
+		QMap<int, int> refreshIntervals;
+		QVariantMap storedIntervals = settings->value("refreshIntervals").toMap();
+		QVariantMap::const_iterator it;
+		for(it = storedIntervals.constBegin(); it != storedIntervals.constEnd(); ++it) {
+			refreshIntervals.insert(it.key().toInt(), it.value().toInt());
+		}
+		site->setRefreshIntervals(refreshIntervals);
+
 		// site->setContext(this);
 		site->setName(name);
 		(*sites)[id] = QSharedPointer<SiteSettings>(site);
@@ -107,6 +120,14 @@ void AppSettings::saveSites() {
 			settings->setValue("serialPort", site->getSerialPort());
 		}
 		settings->setValue("downloadInterval", site->getDownloadInterval());
+
+		QVariantMap storedIntervals;
+		QMap<int, int> refreshIntervals = site->getRefreshIntervals();
+		QMap<int, int>::const_iterator it;
+		for(it = refreshIntervals.constBegin(); it != refreshIntervals.constEnd(); ++it) {
+			storedIntervals.insert(QString::number(it.key()), it.value());
+		}
+		settings->setValue("refreshIntervals", storedIntervals);
 		i++;
 	}
 
@@ -192,6 +213,15 @@ void AppSettings::setSelectedDisplays(const QList<enum PMDisplayNumber> & select
 	emit selectedDisplaysChanged();
 }
 
+// If true, each site fetches all of its displays as one batch, and the table is updated once per batch
+bool AppSettings::getSnapshotPolling() {
+	return settings->value("display/snapshotPolling", true).toBool();
+}
+
+void AppSettings::setSnapshotPolling(bool snapshot) {
+	settings->setValue("display/snapshotPolling", snapshot);
+}
+
 QString AppSettings::getDownloadPath() {
 #if QT_VERSION >= 0x050000
 	QString defaultPath = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
@@ -229,6 +259,79 @@ void AppSettings::setEfficiencyAverageInterval(int interval) {
 	settings->setValue("logged/efficiencyAverageInterval", interval);
 }
 
+// Number of worker threads shared by all of the site connections. At least 2, so a logged data
+// download never holds the only one and stops the displays from updating
+int AppSettings::getIOThreadCount() {
+	return qMax(2, settings->value("general/ioThreadCount", 4).toInt());
+}
+
+void AppSettings::setIOThreadCount(int threads) {
+	settings->setValue("general/ioThreadCount", threads);
+}
+
+// Number of sites that logged data is downloaded from at the same time
+int AppSettings::getMaxConcurrentDownloads() {
+	return settings->value("logged/maxConcurrentDownloads", 3).toInt();
+}
+
+void AppSettings::setMaxConcurrentDownloads(int downloads) {
+	settings->setValue("logged/maxConcurrentDownloads", downloads);
+}
+
+// If true, downloaded periodic and profile data are stored as the unit's compressed raw memory,
+// and decoded when they are read
+bool AppSettings::getRawLoggedStorage() {
+	return settings->value("logged/rawStorage", false).toBool();
+}
+
+void AppSettings::setRawLoggedStorage(bool raw) {
+	settings->setValue("logged/rawStorage", raw);
+}
+
+// If true, every polled display value is kept in the HistoryStore. Takes effect on restart
+bool AppSettings::getHistoryEnabled() {
+	return settings->value("history/enabled", false).toBool();
+}
+
+void AppSettings::setHistoryEnabled(bool enabled) {
+	settings->setValue("history/enabled", enabled);
+}
+
+// Number of days that every polled value is kept before being reduced to one value per minute
+int AppSettings::getHistoryRawDays() {
+	return settings->value("history/rawDays", 7).toInt();
+}
+
+void AppSettings::setHistoryRawDays(int days) {
+	settings->setValue("history/rawDays", days);
+}
+
+// Number of days that any history is kept. 0 keeps it forever
+int AppSettings::getHistoryRetentionDays() {
+	return settings->value("history/retentionDays", 365).toInt();
+}
+
+void AppSettings::setHistoryRetentionDays(int days) {
+	settings->setValue("history/retentionDays", days);
+}
+
+// If true, the StatusServer serves the current values over HTTP on localhost. Takes effect on restart
+bool AppSettings::getServerEnabled() {
+	return settings->value("server/enabled", false).toBool();
+}
+
+void AppSettings::setServerEnabled(bool enabled) {
+	settings->setValue("server/enabled", enabled);
+}
+
+int AppSettings::getServerPort() {
+	return settings->value("server/port", 8473).toInt();
+}
+
+void AppSettings::setServerPort(int port) {
+	settings->setValue("server/port", port);
+}
+
 QVariant AppSettings::encodeDisplayNum(enum PMDisplayNumber display) {
 	return QVariant((int) display);
 }
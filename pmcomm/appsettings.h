@@ -9,6 +9,7 @@
 #include <QSharedPointer>
 
 class QSettings;
+class QWidget;
 class SiteSettings;
 class PMConnectionWrapper;
 
@@ -26,8 +27,10 @@ public:
 		Fahrenheit
 	};
 
+#ifndef PMCOMM_HEADLESS
 	void restoreWindowGeometry(QWidget *widget);
 	void saveWindowGeometry(QWidget *widget);
+#endif
 
 	TempUnit getTempUnit();
 	void setTempUnit(TempUnit unit);
@@ -45,6 +48,9 @@ public:
 	QList<enum PMDisplayNumber> getSelectedDisplays();
 	void setSelectedDisplays(const QList<enum PMDisplayNumber> & selectedDisplays);
 
+	bool getSnapshotPolling();
+	void setSnapshotPolling(bool snapshot);
+
 	QString getSettingsExportPath();
 	void setSettingsExportPath(QString path);
 
@@ -53,6 +59,25 @@ public:
 	int getEfficiencyAverageInterval();
 	void setEfficiencyAverageInterval(int interval);
 
+	int getIOThreadCount();
+	void setIOThreadCount(int threads);
+	int getMaxConcurrentDownloads();
+	void setMaxConcurrentDownloads(int downloads);
+	bool getRawLoggedStorage();
+	void setRawLoggedStorage(bool raw);
+
+	bool getHistoryEnabled();
+	void setHistoryEnabled(bool enabled);
+	int getHistoryRawDays();
+	void setHistoryRawDays(int days);
+	int getHistoryRetentionDays();
+	void setHistoryRetentionDays(int days);
+
+	bool getServerEnabled();
+	void setServerEnabled(bool enabled);
+	int getServerPort();
+	void setServerPort(int port);
+
 signals:
 	void tempUnitChanged();
 	void sitesChanged();
@@ -0,0 +1,191 @@
+#include "columnwriter.h"
+
+#include <QtEndian>
+#include <cstring> // memcpy()
+
+static const int FORMAT_VERSION = 1;
+
+// The type codes stored in the file
+enum FileType {
+	FILE_TYPE_TIME = 1,
+	FILE_TYPE_INT32 = 2,
+	FILE_TYPE_FLOAT64 = 3,
+	FILE_TYPE_BOOL = 4
+};
+
+static FileType fileType(LoggedFileWriter::ColumnType type) {
+	switch(type) {
+		case LoggedFileWriter::COLUMN_TIME: return FILE_TYPE_TIME;
+		case LoggedFileWriter::COLUMN_INT:
+		case LoggedFileWriter::COLUMN_TEMPERATURE: return FILE_TYPE_INT32;
+		case LoggedFileWriter::COLUMN_DECIMAL: return FILE_TYPE_FLOAT64;
+		case LoggedFileWriter::COLUMN_BOOL: return FILE_TYPE_BOOL;
+	}
+	return FILE_TYPE_INT32;
+}
+
+static void appendUInt16(QByteArray & data, quint16 value) {
+	uchar bytes[2];
+	qToLittleEndian<quint16>(value, bytes);
+	data.append((const char *) bytes, sizeof(bytes));
+}
+
+static void appendUInt32(QByteArray & data, quint32 value) {
+	uchar bytes[4];
+	qToLittleEndian<quint32>(value, bytes);
+	data.append((const char *) bytes, sizeof(bytes));
+}
+
+static void appendUInt64(QByteArray & data, quint64 value) {
+	uchar bytes[8];
+	qToLittleEndian<quint64>(value, bytes);
+	data.append((const char *) bytes, sizeof(bytes));
+}
+
+ColumnWriter::ColumnWriter(QString filename, const Settings & settings) : LoggedFileWriter(settings), file(filename) {
+	failed = false;
+	column = 0;
+	rows = 0;
+}
+
+ColumnWriter::~ColumnWriter() {
+	if(file.isOpen())
+		close();
+}
+
+bool ColumnWriter::open() {
+	return file.open(QIODevice::WriteOnly);
+}
+
+// Writes the last row group and the end marker
+bool ColumnWriter::close() {
+	if(rows > 0)
+		writeRowGroup();
+
+	QByteArray end;
+	appendUInt32(end, 0);
+	write(end);
+
+	file.close();
+	return !failed;
+}
+
+void ColumnWriter::addColumn(QString name, ColumnType type) {
+	Column curr;
+	curr.name = name;
+	curr.type = type;
+	columns.append(curr);
+}
+
+void ColumnWriter::endHeader() {
+	QByteArray header("PMCOLS");
+	appendUInt16(header, FORMAT_VERSION);
+	appendUInt32(header, columns.size());
+	for(int i = 0; i < columns.size(); i++) {
+		QByteArray name = columns[i].name.toUtf8();
+		header.append((char) fileType(columns[i].type));
+		appendUInt16(header, name.size());
+		header.append(name);
+	}
+	write(header);
+
+	for(int i = 0; i < columns.size(); i++) {
+		columns[i].validity.reserve(ROW_GROUP_SIZE / 8);
+		columns[i].values.reserve(ROW_GROUP_SIZE * 8);
+	}
+}
+
+void ColumnWriter::appendTime(int64_t time) {
+	store(true, time, time);
+}
+
+void ColumnWriter::appendInt(int64_t value) {
+	store(true, value, value);
+}
+
+// Decimals are stored at full precision; the number of digits only matters in a csv file
+void ColumnWriter::appendDecimal(double value, int, int) {
+	store(true, qRound64(value), value);
+}
+
+void ColumnWriter::appendFixed(double value, int) {
+	store(true, qRound64(value), value);
+}
+
+void ColumnWriter::appendTemperature(int celsius) {
+	store(celsius != -21, celsius, celsius);
+}
+
+void ColumnWriter::appendBool(bool value) {
+	store(true, value, value);
+}
+
+void ColumnWriter::skip() {
+	store(false, 0, 0);
+}
+
+// Any columns left in the row have no value
+void ColumnWriter::endRow() {
+	while(column < columns.size()) {
+		store(false, 0, 0);
+	}
+	column = 0;
+
+	rows++;
+	if(rows == ROW_GROUP_SIZE)
+		writeRowGroup();
+}
+
+void ColumnWriter::spacerRow() {
+	endRow();
+}
+
+// Adds a value to the next column of the row, converted to the column's type
+void ColumnWriter::store(bool valid, int64_t intValue, double realValue) {
+	if(column >= columns.size())
+		return;
+	Column & curr = columns[column++];
+
+	if(rows % 8 == 0)
+		curr.validity.append('\0');
+	if(valid)
+		curr.validity.data()[rows / 8] |= 1 << (rows % 8);
+
+	switch(curr.type) {
+		case COLUMN_TIME:
+			appendUInt64(curr.values, intValue);
+			break;
+		case COLUMN_INT:
+		case COLUMN_TEMPERATURE:
+			appendUInt32(curr.values, (qint32) intValue);
+			break;
+		case COLUMN_DECIMAL: {
+			quint64 bits;
+			memcpy(&bits, &realValue, sizeof(bits));
+			appendUInt64(curr.values, bits);
+			break;
+		}
+		case COLUMN_BOOL:
+			curr.values.append(intValue ? '\1' : '\0');
+			break;
+	}
+}
+
+void ColumnWriter::writeRowGroup() {
+	QByteArray count;
+	appendUInt32(count, rows);
+	write(count);
+
+	for(int i = 0; i < columns.size(); i++) {
+		write(columns[i].validity);
+		write(columns[i].values);
+		columns[i].validity.resize(0);
+		columns[i].values.resize(0);
+	}
+	rows = 0;
+}
+
+void ColumnWriter::write(const QByteArray & data) {
+	if(file.write(data) != data.size())
+		failed = true;
+}
@@ -0,0 +1,83 @@
+#ifndef COLUMNWRITER_H
+#define COLUMNWRITER_H
+
+#include "loggedfilewriter.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QVector>
+
+/* This class writes logged data as a column file, which analysis tools can load without
+   parsing any text. Each column has a type and is stored as an array of fixed-width values,
+   so a whole column can be read straight into memory.
+
+   A column file is laid out as follows. All numbers are little-endian.
+
+     Magic            6 bytes  "PMCOLS"
+     Version          uint16   1
+     Column count     uint32
+     For each column:
+       Type           uint8    1 = time (int64 seconds since the epoch, UTC)
+                               2 = int32
+                               3 = float64
+                               4 = bool (uint8, 0 or 1)
+       Name length    uint16
+       Name           UTF-8, not terminated
+     Row groups, each with:
+       Row count      uint32   At most ROW_GROUP_SIZE, and never 0
+       For each column, in header order:
+         Validity     (row count + 7) / 8 bytes. Bit i % 8 of byte i / 8 is set if row i
+                      of the group has a value
+         Values       row count values of the column's type. Values without a validity
+                      bit are 0
+     End marker       uint32   0
+
+   Values are stored in the units the PentaMetric reports, not the display units chosen in
+   the settings, so temperatures are always in degrees C. A row with no values marks a
+   break in the records, where the csv files have a spacer row.
+ */
+class ColumnWriter : public LoggedFileWriter {
+public:
+	ColumnWriter(QString filename, const Settings & settings);
+	~ColumnWriter();
+
+	bool open();
+	bool close();
+
+	void addColumn(QString name, ColumnType type);
+	void endHeader();
+
+	void appendTime(int64_t time);
+	void appendInt(int64_t value);
+	void appendDecimal(double value, int digitsDP, int digitsTotal);
+	void appendFixed(double value, int digitsDP);
+	void appendTemperature(int celsius);
+	void appendBool(bool value);
+	void skip();
+	void endRow();
+	void spacerRow();
+
+private:
+	enum { ROW_GROUP_SIZE = 65536 };
+
+	struct Column {
+		QString name;
+		ColumnType type;
+		QByteArray validity;
+		QByteArray values;
+	};
+
+	void store(bool valid, int64_t intValue, double realValue);
+	void writeRowGroup();
+	void write(const QByteArray & data);
+
+	QFile file;
+	bool failed;
+
+	QVector<Column> columns;
+	int column; // Index of the next column in the current row
+	int rows; // Number of rows in the current row group
+};
+
+#endif
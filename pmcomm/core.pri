@@ -0,0 +1,52 @@
+# Classes that talk to the PentaMetric, hold the settings and store logged data. None of
+# these use QtGui, so they are shared by PMComm and the headless pmcommd daemon.
+
+QT += sql network
+
+# Get libpmcomm
+INCLUDEPATH += $$PWD $$PWD/../libpmcomm/include
+LIBS += -L"$$PWD/../libpmcomm/" -lpmcomm
+
+SOURCES  += $$PWD/datafetcher.cpp \
+			$$PWD/displayvalue.cpp \
+			$$PWD/programvalue.cpp \
+			$$PWD/loggedvalue.cpp \
+			$$PWD/loggedfilewriter.cpp \
+			$$PWD/csvwriter.cpp \
+			$$PWD/columnwriter.cpp \
+			$$PWD/periodicquery.cpp \
+			$$PWD/periodicrollup.cpp \
+			$$PWD/pmconnectionwrapper.cpp \
+			$$PWD/sitemanager.cpp \
+			$$PWD/siteslist.cpp \
+			$$PWD/sitesettings.cpp \
+			$$PWD/appsettings.cpp \
+			$$PWD/loggeddownloader.cpp \
+			$$PWD/loggeddata.cpp \
+			$$PWD/loggedstorage.cpp \
+			$$PWD/ioscheduler.cpp \
+			$$PWD/displayresultqueue.cpp \
+			$$PWD/historystore.cpp \
+			$$PWD/statusserver.cpp
+HEADERS  += $$PWD/displayvalue.h \
+			$$PWD/programvalue.h \
+			$$PWD/loggedvalue.h \
+			$$PWD/loggedfilewriter.h \
+			$$PWD/csvwriter.h \
+			$$PWD/columnwriter.h \
+			$$PWD/periodicquery.h \
+			$$PWD/periodicrollup.h \
+			$$PWD/pmconnectionwrapper.h \
+			$$PWD/sitemanager.h \
+			$$PWD/datafetcher.h \
+			$$PWD/siteslist.h \
+			$$PWD/sitesettings.h \
+			$$PWD/appsettings.h \
+			$$PWD/loggeddownloader.h \
+			$$PWD/loggeddata.h \
+			$$PWD/loggedstorage.h \
+			$$PWD/ioscheduler.h \
+			$$PWD/displayresultqueue.h \
+			$$PWD/historystore.h \
+			$$PWD/statusserver.h \
+			$$PWD/displayslots.h
@@ -0,0 +1,172 @@
+#include "csvwriter.h"
+
+#include <QDateTime>
+#include <cmath> // fabs()
+
+CsvWriter::CsvWriter(QString filename, const Settings & settings) : LoggedFileWriter(settings), file(filename) {
+	failed = false;
+	columns = 0;
+	column = 0;
+	hourStart = -1;
+}
+
+CsvWriter::~CsvWriter() {
+	if(file.isOpen())
+		close();
+}
+
+bool CsvWriter::open() {
+	buffer.reserve(BLOCK_SIZE + 1024);
+	return file.open(QIODevice::WriteOnly | QIODevice::Text);
+}
+
+bool CsvWriter::close() {
+	if(!buffer.isEmpty() && file.write(buffer) != buffer.size())
+		failed = true;
+	buffer.clear();
+	file.close();
+	return !failed;
+}
+
+// Column names are written in the local encoding, as a QTextStream would
+void CsvWriter::addColumn(QString name, ColumnType) {
+	separator();
+	buffer.append(name.toLocal8Bit());
+	columns++;
+}
+
+void CsvWriter::endHeader() {
+	endRow();
+}
+
+// Ends a row, and writes the buffer to the file once a block has been filled
+void CsvWriter::endRow() {
+	buffer.append('\n');
+	column = 0;
+	if(buffer.size() < BLOCK_SIZE)
+		return;
+
+	if(file.write(buffer) != buffer.size())
+		failed = true;
+	buffer.resize(0);
+}
+
+void CsvWriter::spacerRow() {
+	for(int i = 1; i < columns; i++) {
+		buffer.append(',');
+	}
+	endRow();
+}
+
+void CsvWriter::skip() {
+	separator();
+}
+
+void CsvWriter::appendBool(bool value) {
+	separator();
+	buffer.append(value ? "TRUE" : "FALSE");
+}
+
+void CsvWriter::appendInt(int64_t value) {
+	separator();
+	writeInt(value);
+}
+
+void CsvWriter::writeInt(int64_t value) {
+	char digits[24];
+	int n = 0;
+	uint64_t magnitude = value < 0 ? -(uint64_t) value : value;
+	do {
+		digits[n++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while(magnitude != 0);
+
+	if(value < 0)
+		buffer.append('-');
+	while(n > 0) {
+		buffer.append(digits[--n]);
+	}
+}
+
+// Writes a value with digitsDP digits after the decimal point, dropping digits from the
+// right while there are more than digitsTotal significant digits (0 means unlimited)
+void CsvWriter::appendDecimal(double value, int digitsDP, int digitsTotal) {
+	separator();
+	bool negative = value < 0;
+	value = std::fabs(value);
+
+	while(true) {
+		uint64_t asInt = value * powerOf10(digitsDP) + 0.5;
+
+		int digitsUsed = 0;
+		for(uint64_t rest = asInt; rest != 0; rest /= 10) {
+			digitsUsed++;
+		}
+		if(digitsTotal != 0 && digitsUsed > digitsTotal) {
+			digitsDP--; // This can go negative, which indicates insignificant trailing zeros
+			continue;
+		}
+
+		char digits[48];
+		int n = 0;
+		for(int digit = 0; digit <= digitsDP || asInt != 0; digit++) {
+			if(digit == digitsDP && digit != 0)
+				digits[n++] = '.';
+			digits[n++] = '0' + asInt % 10;
+			asInt /= 10;
+		}
+
+		if(negative)
+			buffer.append('-');
+		while(n > 0) {
+			buffer.append(digits[--n]);
+		}
+		for(int i = digitsDP; i < 0; i++) {
+			buffer.append('0');
+		}
+		return;
+	}
+}
+
+// Writes a value with a fixed number of digits after the decimal point, as a QTextStream would
+void CsvWriter::appendFixed(double value, int digitsDP) {
+	separator();
+	buffer.append(QByteArray::number(value, 'f', digitsDP));
+}
+
+// Writes a temperature from the unit in the chosen units, like DisplayValue::toString() for D28
+void CsvWriter::appendTemperature(int celsius) {
+	separator();
+	if(celsius == -21) {
+		buffer.append("Invalid");
+		return;
+	}
+	if(!settings.fahrenheit) {
+		writeInt(celsius);
+		return;
+	}
+
+	double value = celsius * 1.8 + 32;
+	if(value < 0)
+		buffer.append('-');
+	writeInt((int64_t) (std::fabs(value) + 0.5));
+}
+
+// Writes a time as "MM/dd/yyyy hh:mm" in local time
+void CsvWriter::appendTime(int64_t time) {
+	separator();
+	if(hourStart < 0 || time < hourStart || time >= hourStart + 3600) {
+		QDateTime local = QDateTime::fromTime_t(time).toLocalTime();
+		QDate date = local.date();
+		QTime clock = local.time();
+		hourStart = time - clock.minute() * 60 - clock.second();
+
+		qsnprintf(hourPrefix, sizeof(hourPrefix), "%02d/%02d/%04d %02d", date.month(), date.day(), date.year(), clock.hour());
+		hourPrefix[13] = ':'; // Replaces the terminator; the prefix is only ever appended by length
+	}
+
+	int minute = (time - hourStart) / 60;
+	buffer.append(hourPrefix, sizeof(hourPrefix));
+	buffer.append('0' + minute / 10);
+	buffer.append('0' + minute % 10);
+}
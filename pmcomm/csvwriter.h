@@ -0,0 +1,58 @@
+#ifndef CSVWRITER_H
+#define CSVWRITER_H
+
+#include "loggedfilewriter.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+
+/* This class writes the csv files of logged data. Rows are formatted straight into a byte
+   buffer, which is written to the file in blocks of about BLOCK_SIZE bytes, rather than
+   going through a QTextStream and a QString for every field.
+
+   Numbers are formatted by hand with the same digits as DisplayValue::toString(), but
+   without building a DisplayValue or a QString for each one. Times are written in local
+   time. The date and hour are only worked out again when a time falls outside the local
+   hour of the one before it.
+ */
+class CsvWriter : public LoggedFileWriter {
+public:
+	CsvWriter(QString filename, const Settings & settings);
+	~CsvWriter();
+
+	bool open();
+	bool close();
+
+	void addColumn(QString name, ColumnType type);
+	void endHeader();
+
+	void appendTime(int64_t time);
+	void appendInt(int64_t value);
+	void appendDecimal(double value, int digitsDP, int digitsTotal);
+	void appendFixed(double value, int digitsDP);
+	void appendTemperature(int celsius);
+	void appendBool(bool value);
+	void skip();
+	void endRow();
+	void spacerRow();
+
+private:
+	enum { BLOCK_SIZE = 65536 };
+
+	// Starts the next field of the row
+	void separator() { if(column++ > 0) buffer.append(','); }
+	void writeInt(int64_t value);
+
+	QFile file;
+	QByteArray buffer;
+	bool failed;
+
+	int columns; // Number of columns in the header
+	int column; // Number of fields started in the current row
+
+	int64_t hourStart; // The local hour that hourPrefix is for, in seconds since the epoch
+	char hourPrefix[14]; // "MM/dd/yyyy hh:"
+};
+
+#endif
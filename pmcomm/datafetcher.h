@@ -5,18 +5,20 @@
 #include "loggedvalue.h"
 #include "programvalue.h"
 #include "sitesettings.h"
+#include "displayresultqueue.h"
 
 #include <QObject>
 #include <QSharedPointer>
+#include <QVector>
 
 class PMConnectionWrapper;
-
-class QThread;
+class IOScheduler;
 
 /* This class is not very interesting, and may be eliminated entirely at some point.
-   All it does is accept signals on a slot, and forward them to an object on a
-   different thread. In particular, it forwards signals to and from a PMConnectionWrapper,
-   which it managers on another thread.
+   All it does is accept requests on a slot and hand them to the shared IOScheduler,
+   which runs them against this fetcher's PMConnectionWrapper on a worker thread.
+   The results come back as signals, which are forwarded on the GUI thread, except for display
+   results, which are drained from a queue with takeDisplayResult().
  */
 class DataFetcher : public QObject {
 	Q_OBJECT
@@ -26,9 +28,14 @@ public:
 	DataFetcher(SiteSettings *settings, QObject *parent = NULL);
 	~DataFetcher();
 
+	// Call beginDisplayDrain(), then takeDisplayResult() until it returns false. Only valid on
+	// the thread that owns the fetcher.
+	void beginDisplayDrain();
+	bool takeDisplayResult(DisplayResult & result);
+
 signals:
-	void displayDataReady(DisplayValue &value, int id);
-	void displayDataError(enum PMDisplayNumber display, int id);
+	// Emitted once when display results become available; drain them with takeDisplayResult()
+	void displayResultsAvailable();
 
 	void programDataReady(QSharedPointer<ProgramValue> value, int id);
 	void programDataFetchError(enum PMProgramNumber program, int id);
@@ -44,18 +51,9 @@ signals:
 	void connected(int id, int version);
 	void connectionError(int id);
 
-	// Signals for communicating with wrapper
-	void privateConnect(int id);
-	void privateDisconnect(int id);
-	void privateResetFailFast();
-	void privateFetchDisplayData(enum PMDisplayNumber display, int id);
-	void privateFetchProgramData(enum PMProgramNumber program, int id);
-	void privateSetProgramData(enum PMProgramNumber program, QSharedPointer<ProgramValue> value, int id);
-	void privateFetchLoggedData(LoggedValue::LoggedDataType type, int id);
-	void privateResetPM(enum PMResetType command, int id);
-
 public slots:
 	void fetchDisplayData(enum PMDisplayNumber display, int id);
+	void fetchDisplaySet(const QVector<enum PMDisplayNumber> & displaySet, int id);
 
 	void fetchProgramData(enum PMProgramNumber program, int id);
 	void setProgramData(enum PMProgramNumber program, QSharedPointer<ProgramValue> value, int id);
@@ -66,22 +64,8 @@ public slots:
 	
 	void resetFailFast();
 
-	// Slots for communicating with wrapper
-	void privateEmitDisplayReady(DisplayValue value, int id);
-	void privateEmitDisplayError(enum PMDisplayNumber display, int id);
-	void privateEmitProgramReady(QSharedPointer<ProgramValue> value, int id);
-	void privateEmitProgramFetchError(enum PMProgramNumber program, int id);
-	void privateEmitProgramStored(enum PMProgramNumber program, int id);
-	void privateEmitProgramSetError(enum PMProgramNumber program, int id);
-	void privateEmitLoggedReady(QSharedPointer<LoggedValue> value, QSharedPointer<LoggedValue> value2, int id);
-	void privateEmitLoggedError(LoggedValue::LoggedDataType type, int id);
-	void privateEmitLoggedProgress(LoggedValue::LoggedDataType type, int id, int progress, int outof);
-	void privateEmitResetStatus(enum PMResetType command, bool success, int id);
-	void privateEmitConnected(int id, int version);
-	void privateEmitConnectionError(int id);
-
 private:
-	QThread *thread;
+	IOScheduler *scheduler;
 	PMConnectionWrapper *wrapper;
 };
 
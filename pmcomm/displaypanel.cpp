@@ -19,6 +19,9 @@
 #include <QItemSelection>
 #include <QMessageBox>
 #include <QListView>
+#include <QScrollBar>
+#include <QHeaderView>
+#include <QEvent>
 
 #include <QDebug>
 
@@ -40,6 +43,18 @@ DisplayPanel::DisplayPanel(SitesList *sitesList, QWidget *parent) : QGroupBox("L
     table = new QTableView;
     table->setModel(model);
 
+    // Only poll what can actually be seen
+    watchedWindow = NULL;
+    table->viewport()->installEventFilter(this);
+    connect(table->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateVisibleCells()));
+    connect(table->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateVisibleCells()));
+    connect(table->verticalHeader(), SIGNAL(sectionResized(int, int, int)), this, SLOT(updateVisibleCells()));
+    connect(table->horizontalHeader(), SIGNAL(sectionResized(int, int, int)), this, SLOT(updateVisibleCells()));
+    connect(model, SIGNAL(modelReset()), this, SLOT(updateVisibleCells()));
+    connect(model, SIGNAL(rowsInserted(const QModelIndex &, int, int)), this, SLOT(updateVisibleCells()));
+    connect(model, SIGNAL(rowsRemoved(const QModelIndex &, int, int)), this, SLOT(updateVisibleCells()));
+    connect(model, SIGNAL(columnsRemoved(const QModelIndex &, int, int)), this, SLOT(updateVisibleCells()));
+
     connect(sitesList, SIGNAL(managersAdded(const QList<SiteManager *> &)), this, SLOT(managersAdded(const QList<SiteManager *> &)));
     connect(sitesList, SIGNAL(managersRemoved(const QList<SiteManager *> &)), this, SLOT(managersRemoved(const QList<SiteManager *> &)));
     connect(sitesList, SIGNAL(currentSiteUpdated()), this, SLOT(currentSiteUpdated()));
@@ -115,6 +130,45 @@ DisplayPanel::DisplayPanel(SitesList *sitesList, QWidget *parent) : QGroupBox("L
     adjustAlarms();
 }
 
+bool DisplayPanel::eventFilter(QObject *watched, QEvent *event) {
+    if(watched == table->viewport()) {
+        if(event->type() == QEvent::Show && watchedWindow == NULL) {
+            // The top level window isn't known until the panel has been placed in it
+            watchedWindow = window();
+            watchedWindow->installEventFilter(this);
+        }
+        if(event->type() == QEvent::Resize || event->type() == QEvent::Show || event->type() == QEvent::Hide)
+            updateVisibleCells();
+    } else if(watched == watchedWindow && event->type() == QEvent::WindowStateChange) {
+        updateVisibleCells();
+    }
+    return QGroupBox::eventFilter(watched, event);
+}
+
+// Tells the model which cells are on screen, so that it only subscribes to those displays
+void DisplayPanel::updateVisibleCells() {
+    bool shown = table->isVisible() && !window()->isMinimized();
+    if(!shown) {
+        model->setShown(false);
+        return;
+    }
+
+    QRect area = table->viewport()->rect();
+    int firstRow = table->rowAt(area.top());
+    int lastRow = table->rowAt(area.bottom());
+    int firstColumn = table->columnAt(area.left());
+    int lastColumn = table->columnAt(area.right());
+
+    // rowAt() and columnAt() return -1 past the end of the table
+    if(firstRow < 0) firstRow = 0;
+    if(lastRow < 0) lastRow = model->rowCount() - 1;
+    if(firstColumn < 0) firstColumn = 0;
+    if(lastColumn < 0) lastColumn = model->columnCount() - 1;
+
+    model->setVisibleRange(firstRow, lastRow, firstColumn, lastColumn);
+    model->setShown(true);
+}
+
 void DisplayPanel::managersAdded(const QList<SiteManager *> & managers) {
     AppSettings *settings = AppSettings::getInstance();
     QList<int> selectedSites = settings->getSelectedSites();
@@ -301,11 +355,13 @@ void DisplayPanel::displaysChanged(const QModelIndex & topLeft, const QModelInde
     if(!topLeft.isValid() || !bottomRight.isValid())
         return;
 
-    if(topLeft.row() < 1)
+    if(bottomRight.row() < 1)
         return;
 
+    // Changes are batched by the model, so this may cover a whole block of cells
     if(topLeft != bottomRight) {
         adjustResetButton();
+        return;
     }
 
     enum PMDisplayNumber display = model->displayAt(topLeft.row());
@@ -43,9 +43,14 @@ public slots:
 
 	void forceStop();
 
+	void updateVisibleCells();
+
 signals:
 	void switchStateStopped();
 
+protected:
+	bool eventFilter(QObject *watched, QEvent *event);
+
 private:
 	SitesList *sitesList;
 
@@ -62,6 +67,8 @@ private:
 	bool isResettable(enum PMDisplayNumber display);
 
 	void adjustAlarms();
+
+	QWidget *watchedWindow;
 };
 
 
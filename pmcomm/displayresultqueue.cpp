@@ -0,0 +1,37 @@
+#include "displayresultqueue.h"
+
+DisplayResultQueue::DisplayResultQueue() : head(0), tail(0), wakePending(0) {}
+
+// Adds a result to the queue. Returns false if the queue is full, in which case the result is
+// dropped. wake is set to true if the consumer has to be notified about this result.
+bool DisplayResultQueue::push(const DisplayResult & result, bool & wake) {
+	wake = false;
+	unsigned int t = (unsigned int) tail.fetchAndAddAcquire(0);
+	unsigned int h = (unsigned int) head.fetchAndAddAcquire(0);
+	if(t - h >= Capacity) // Unsigned, so this still works once the indices wrap around
+		return false;
+
+	results[t % Capacity] = result;
+	tail.fetchAndStoreRelease((int) (t + 1)); // Publishes the slot to the consumer
+
+	wake = wakePending.testAndSetOrdered(0, 1);
+	return true;
+}
+
+// Must be called by the consumer before it starts popping results. Any result pushed after
+// this will send a new wakeup, so nothing can be left sitting in the queue.
+void DisplayResultQueue::beginDrain() {
+	wakePending.fetchAndStoreOrdered(0);
+}
+
+// Removes the oldest result from the queue. Returns false if the queue is empty.
+bool DisplayResultQueue::pop(DisplayResult & result) {
+	unsigned int h = (unsigned int) head.fetchAndAddAcquire(0);
+	unsigned int t = (unsigned int) tail.fetchAndAddAcquire(0);
+	if(h == t)
+		return false;
+
+	result = results[h % Capacity];
+	head.fetchAndStoreRelease((int) (h + 1)); // Hands the slot back to the producer
+	return true;
+}
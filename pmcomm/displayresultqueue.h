@@ -0,0 +1,52 @@
+#ifndef DISPLAYRESULTQUEUE_H
+#define DISPLAYRESULTQUEUE_H
+
+#include "pmdefs.h"
+
+#include <QAtomicInt>
+
+/* The result of reading a single display, in a form that can be copied between
+   threads without any allocation.
+ */
+struct DisplayResult {
+	enum PMDisplayNumber display;
+	int value; // The raw value from struct PMDisplayValue; only meaningful if error is false
+	int id;
+	bool error;
+	bool endOfCycle; // Marks the end of the results for a fetchDisplaySet() cycle; display is PM_DINVALID
+};
+
+/* This class is a fixed size, lock-free queue of display results, used to hand them from
+   the worker thread running a PMConnectionWrapper to the GUI thread.
+
+   There must be exactly one producer and one consumer at a time. The IOScheduler only ever
+   runs one request for a wrapper at a time, so the wrapper's pushes are serialized even though
+   they may happen on different worker threads.
+
+   push() returns true when the consumer needs to be woken up, i.e. when the queue was idle.
+   The consumer calls beginDrain() and then pop() until the queue is empty, so only one wakeup
+   is sent for any number of results that arrive before the consumer gets to them.
+ */
+class DisplayResultQueue {
+public:
+	DisplayResultQueue();
+
+	// Producer side
+	bool push(const DisplayResult & result, bool & wake);
+
+	// Consumer side
+	void beginDrain();
+	bool pop(DisplayResult & result);
+
+private:
+	// The SiteManager only keeps a few display reads outstanding, so this is never close to full.
+	// It must be a power of two so the indices can wrap around.
+	enum { Capacity = 256 };
+
+	DisplayResult results[Capacity];
+	QAtomicInt head; // Next slot to be read. Only written by the consumer
+	QAtomicInt tail; // Next slot to be written. Only written by the producer
+	QAtomicInt wakePending; // 1 if a wakeup has been sent and the consumer hasn't started draining
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef DISPLAYSLOTS_H
+#define DISPLAYSLOTS_H
+
+#include "pmdefs.h"
+
+#include <QtGlobal>
+
+/* The display numbers are small and dense (0 through PM_D40), apart from the three block
+   displays starting at PM_D29_34. These functions map every display number onto a slot
+   from 0 to N_DISPLAY_SLOTS - 1, so that per-display state can be kept in plain arrays.
+ */
+enum {
+	N_DISPLAY_SLOTS = PM_D40 + 1 + (PM_D35_40 - PM_D29_34 + 1)
+};
+
+inline int displaySlot(enum PMDisplayNumber display) {
+	if(display >= PM_D29_34)
+		return PM_D40 + 1 + (display - PM_D29_34);
+	return display;
+}
+
+inline enum PMDisplayNumber slotDisplay(int slot) {
+	if(slot > PM_D40)
+		return (enum PMDisplayNumber) (PM_D29_34 + slot - PM_D40 - 1);
+	return (enum PMDisplayNumber) slot;
+}
+
+/* A set of displays, stored as one bit per display slot.
+ */
+class DisplaySet {
+public:
+	DisplaySet() : bits(0) {}
+
+	bool contains(enum PMDisplayNumber display) const { return (bits & bit(display)) != 0; }
+	void insert(enum PMDisplayNumber display) { bits |= bit(display); }
+	void remove(enum PMDisplayNumber display) { bits &= ~bit(display); }
+	void clear() { bits = 0; }
+
+	bool isEmpty() const { return bits == 0; }
+	int size() const {
+		int n = 0;
+		for(quint64 b = bits; b != 0; b &= b - 1) // Clears the lowest set bit each time
+			n++;
+		return n;
+	}
+
+	// Iterates over the slots in the set, in increasing order: for(int s = set.first(); s >= 0; s = set.next(s))
+	int first() const { return next(-1); }
+	int next(int slot) const {
+		for(int s = slot + 1; s < N_DISPLAY_SLOTS; s++) {
+			if(bits & ((quint64) 1 << s))
+				return s;
+		}
+		return -1;
+	}
+
+private:
+	static quint64 bit(enum PMDisplayNumber display) { return (quint64) 1 << displaySlot(display); }
+
+	quint64 bits;
+};
+
+#endif
@@ -5,6 +5,9 @@
 #include "appsettings.h"
 
 #include <QBrush>
+#include <QTimer>
+
+#include <climits>
 
 #include <QDebug>
 
@@ -12,6 +15,23 @@ DisplayTableModel::DisplayTableModel(QObject *parent) : QAbstractTableModel(pare
 	updating = false;
 	memset(alarmMasks, 0, sizeof(alarmMasks));
 
+	// Everything is visible until the view says otherwise
+	visibleFirstRow = 0;
+	visibleLastRow = INT_MAX;
+	visibleFirstColumn = 0;
+	visibleLastColumn = INT_MAX;
+	shown = true;
+
+	grayBrush = QBrush(Qt::gray);
+	redBrush = QBrush(Qt::red);
+	dirty = false;
+	flushTimer = new QTimer(this);
+	flushTimer->setSingleShot(true);
+	flushTimer->setInterval(16); // Roughly once per frame
+	connect(flushTimer, SIGNAL(timeout()), this, SLOT(flushChanges()));
+
+	rebuildCache();
+
 	connect(AppSettings::getInstance(), SIGNAL(tempUnitChanged()), this, SLOT(tempUnitChanged()));
 }
 
@@ -32,6 +52,53 @@ void DisplayTableModel::setUpdating(bool on) {
 	}
 }
 
+void DisplayTableModel::setVisibleRange(int firstRow, int lastRow, int firstColumn, int lastColumn) {
+	visibleFirstRow = firstRow;
+	visibleLastRow = lastRow;
+	visibleFirstColumn = firstColumn;
+	visibleLastColumn = lastColumn;
+	updateSubscriptions();
+}
+
+// Set to false when the table can't be seen at all, e.g. when the window is minimised
+void DisplayTableModel::setShown(bool shown) {
+	this->shown = shown;
+	updateSubscriptions();
+}
+
+// Subscribes to the displays in the visible cells, and unsubscribes from the rest
+void DisplayTableModel::updateSubscriptions() {
+	QSet<QPair<SiteManager *, enum PMDisplayNumber> > wanted;
+	if(shown) {
+		int lastColumn = qMin(visibleLastColumn, sites.size() - 1);
+		int lastRow = qMin(visibleLastRow, displays.size()); // Row 0 is the status row
+		for(int col = qMax(visibleFirstColumn, 0); col <= lastColumn; col++) {
+			for(int row = qMax(visibleFirstRow, 1); row <= lastRow; row++) {
+				wanted.insert(qMakePair(sites[col], displays[row - 1]));
+			}
+		}
+	}
+
+	QPair<SiteManager *, enum PMDisplayNumber> cell;
+	foreach(cell, subscriptions) {
+		if(!wanted.contains(cell))
+			cell.first->unsubscribe(cell.second);
+	}
+	foreach(cell, wanted) {
+		if(!subscriptions.contains(cell))
+			cell.first->subscribe(cell.second);
+	}
+	subscriptions = wanted;
+}
+
+void DisplayTableModel::unsubscribeAll() {
+	QPair<SiteManager *, enum PMDisplayNumber> cell;
+	foreach(cell, subscriptions) {
+		cell.first->unsubscribe(cell.second);
+	}
+	subscriptions.clear();
+}
+
 int DisplayTableModel::rowCount(const QModelIndex & parent) const {
 	Q_UNUSED(parent);
 	return displays.size() + 1;
@@ -45,13 +112,15 @@ int DisplayTableModel::columnCount(const QModelIndex &parent) const {
 void DisplayTableModel::tempUnitChanged() {
 	int tempIndex = displays.indexOf(PM_D28);
 	if(tempIndex >= 0) {
+		rebuildLabels();
 		emit headerDataChanged(Qt::Vertical, tempIndex + 1, tempIndex + 1);
-		if(!sites.empty()) {
-			emit dataChanged(createIndex(tempIndex + 1, 0), createIndex(tempIndex + 1, sites.size() - 1));
+		for(int col = 0; col < sites.size(); col++) {
+			updateCell(tempIndex + 1, col);
 		}
 	}
 }
 
+// Only reads the cache; the cells are filled in as the values change
 QVariant DisplayTableModel::data(const QModelIndex &index, int role) const {
 	if(!index.isValid())
 		return QVariant();
@@ -62,59 +131,118 @@ QVariant DisplayTableModel::data(const QModelIndex &index, int role) const {
 	if(index.column() >= sites.size() || index.column() < 0)
 		return QVariant();
 
+	const Cell & cell = cells[index.row() * sites.size() + index.column()];
 	if(role == Qt::DisplayRole) {
-		SiteManager *site = sites[index.column()];
-		if(index.row() == 0) {
-			SiteManager::Status status = site->getStatus();
-			switch(status) {
-				case SiteManager::SiteStopped:
-					return "Stopped";
-				case SiteManager::SiteDownloadingLogged:
-					return "Downloading logged data. Please wait";
-				case SiteManager::SiteUpdating:
-					return "Updating";
-				case SiteManager::SiteError:
-					return "Error";
-			}
+		return cell.text;
+	} else if(role == Qt::ForegroundRole) {
+		switch(cell.color) {
+			case CellGray: return grayBrush;
+			case CellRed: return redBrush;
+			default: return QVariant();
+		}
+	}
+	return QVariant();
+}
+
+// Works out what a cell should show
+void DisplayTableModel::computeCell(int row, int column, Cell & cell) {
+	SiteManager *site = sites[column];
+	cell.color = CellNormal;
+
+	if(row == 0) {
+		SiteManager::Status status = site->getStatus();
+		switch(status) {
+			case SiteManager::SiteStopped:
+				cell.text = "Stopped";
+				break;
+			case SiteManager::SiteDownloadingLogged:
+				cell.text = "Downloading logged data. Please wait";
+				cell.color = CellRed;
+				break;
+			case SiteManager::SiteUpdating:
+				cell.text = "Updating";
+				break;
+			case SiteManager::SiteError:
+				cell.text = "Error";
+				break;
 		}
+		return;
+	}
 
-		enum PMDisplayNumber display = displays[index.row() - 1];
-		DisplayValue val = site->getDisplay(display);
-		if(!val.valid())
-			return QString::fromUtf8("—");
+	enum PMDisplayNumber display = displays[row - 1];
+	DisplayValue val = site->getDisplay(display);
+	bool alarmActive = display == PM_DALARM && val.valid() && (val.getRawIntValue() & (alarmMasks[0] | alarmMasks[1]));
+
+	if(!val.valid())
+		cell.text = QString::fromUtf8("—");
+	else if(display == PM_DALARM)
+		cell.text = alarmActive ? "ACTIVE" : "Inactive";
+	else
+		cell.text = val.toString();
+
+	if(!site->displayUpToDate(display))
+		cell.color = CellGray;
+	else if(alarmActive)
+		cell.color = CellRed;
+}
 
-		if(display == PM_DALARM) {
-			if(val.getRawIntValue() & (alarmMasks[0] | alarmMasks[1]))
-				return "ACTIVE";
-			else
-				return "Inactive";		
-		} else
-			return val.toString();
+// Recomputes a cell, and queues a repaint if it changed
+void DisplayTableModel::updateCell(int row, int column) {
+	Cell & cell = cells[row * sites.size() + column];
+	Cell newCell;
+	computeCell(row, column, newCell);
+	if(newCell.color == cell.color && newCell.text == cell.text)
+		return;
 
-	} else if(role == Qt::ForegroundRole) {
-		SiteManager *site = sites[index.column()];
-
-		 if(index.row() == 0) {
-			SiteManager::Status status = site->getStatus();
-			if(status == SiteManager::SiteDownloadingLogged)
-				return QBrush(Qt::red);
-			else
-				return QVariant();
-		 }
-
-		if(!site->displayUpToDate(displays[index.row() - 1]))
-			return QBrush(Qt::gray);
-
-		if(index.row() != 0) {
-			enum PMDisplayNumber display = displays[index.row() - 1];
-			DisplayValue val = site->getDisplay(display);
-			if(display == PM_DALARM && val.valid()) {
-				if(val.getRawIntValue() & (alarmMasks[0] | alarmMasks[1]))
-					return QBrush(Qt::red);
-			}
+	cell = newCell;
+	if(!dirty) {
+		dirty = true;
+		dirtyTop = dirtyBottom = row;
+		dirtyLeft = dirtyRight = column;
+		flushTimer->start();
+	} else {
+		dirtyTop = qMin(dirtyTop, row);
+		dirtyBottom = qMax(dirtyBottom, row);
+		dirtyLeft = qMin(dirtyLeft, column);
+		dirtyRight = qMax(dirtyRight, column);
+	}
+}
+
+// Emits a single dataChanged() covering every cell that changed since the last flush
+void DisplayTableModel::flushChanges() {
+	if(!dirty)
+		return;
+
+	dirty = false;
+	emit dataChanged(createIndex(dirtyTop, dirtyLeft), createIndex(dirtyBottom, dirtyRight));
+}
+
+// Recomputes every cell. Must be called whenever the rows or columns change.
+void DisplayTableModel::rebuildCache() {
+	dirty = false;
+	flushTimer->stop();
+
+	int rows = displays.size() + 1;
+	cells.resize(rows * sites.size());
+	for(int row = 0; row < rows; row++) {
+		for(int col = 0; col < sites.size(); col++) {
+			computeCell(row, col, cells[row * sites.size() + col]);
 		}
 	}
-	return QVariant();
+
+	rebuildLabels();
+}
+
+void DisplayTableModel::rebuildLabels() {
+	SiteManager *site = NULL;
+	if(!sites.empty())
+		site = sites[0];
+
+	rowLabels.resize(displays.size() + 1);
+	rowLabels[0] = "Status";
+	for(int i = 0; i < displays.size(); i++) {
+		rowLabels[i + 1] = SiteManager::getLabelStatic(displays[i], site);
+	}
 }
 
 QVariant DisplayTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
@@ -122,17 +250,10 @@ QVariant DisplayTableModel::headerData(int section, Qt::Orientation orientation,
 		return QVariant();
 
 	if(role == Qt::DisplayRole && orientation == Qt::Vertical) {
-		if(section >= displays.size() + 1)
+		if(section >= rowLabels.size())
 			return QVariant();
 
-		if(section == 0)
-			return "Status";
-
-		SiteManager *site = NULL;
-		if(!sites.empty())
-			site = sites[0];
-
-		return site->getLabelStatic(displays[section - 1], site);
+		return rowLabels[section];
 	}
 	if(role == Qt::DisplayRole && orientation == Qt::Horizontal) {
 		if(section >= sites.size())
@@ -155,8 +276,7 @@ void DisplayTableModel::displayUpdated(PMDisplayNumber display) {
     if(col < 0 || row < 0) // Not selected anymore
     	return;
 
-	QModelIndex changedIdx = createIndex(row + 1, col);
-	emit dataChanged(changedIdx, changedIdx);
+	updateCell(row + 1, col);
 }
 
 // Update the alarm mask
@@ -183,13 +303,14 @@ void DisplayTableModel::programUpdated(PMProgramNumber program) {
 		}
 	}
 
-    int col = sites.indexOf(site);
     int row = displays.indexOf(PM_DALARM);
-    if(col < 0 || row < 0) // Not selected
+    if(row < 0) // Not selected
     	return;
 
-	QModelIndex changedIdx = createIndex(row + 1, col);
-	emit dataChanged(changedIdx, changedIdx);
+	// The masks are shared by all of the columns
+	for(int col = 0; col < sites.size(); col++) {
+		updateCell(row + 1, col);
+	}
 }
 
 void DisplayTableModel::columnUpdated() {
@@ -198,8 +319,12 @@ void DisplayTableModel::columnUpdated() {
 		return;
 
 	int col = sites.indexOf(site);
+	if(col < 0)
+		return;
 
-	emit dataChanged(createIndex(1, col), createIndex(displays.size(), col));	
+	for(int row = 1; row <= displays.size(); row++) {
+		updateCell(row, col);
+	}
 }
 
 void DisplayTableModel::labelsUpdated() {
@@ -209,8 +334,10 @@ void DisplayTableModel::labelsUpdated() {
 
     int col = sites.indexOf(site);
 
-    if(col == 0)
+    if(col == 0) {
+    	rebuildLabels();
     	emit headerDataChanged(Qt::Vertical, 1, displays.size());
+    }
 }
 
 void DisplayTableModel::statusChanged(SiteManager::Status status) {
@@ -221,9 +348,8 @@ void DisplayTableModel::statusChanged(SiteManager::Status status) {
 		return;
 
     int col = sites.indexOf(site);
-
-	QModelIndex changedIdx = createIndex(0, col);
-	emit dataChanged(changedIdx, changedIdx);
+    if(col >= 0)
+		updateCell(0, col);
 	emit siteStatusChanged(site);
 }
 
@@ -240,6 +366,8 @@ void DisplayTableModel::removeSiteAt(int column) {
 	disconnect(manager, 0, this, 0);
 
 	sites.removeAt(column);
+	updateSubscriptions();
+	rebuildCache();
 
 	endRemoveColumns();
 
@@ -250,6 +378,7 @@ void DisplayTableModel::removeSiteAt(int column) {
 void DisplayTableModel::setSites(SitesList *allSites, const QList<int> & selectedSites) {
 	beginResetModel();
 
+	unsubscribeAll();
 	for(int i = 0; i < sites.size(); i++) {
 		SiteManager *manager = sites[i];
 		manager->stopUpdating();
@@ -262,9 +391,6 @@ void DisplayTableModel::setSites(SitesList *allSites, const QList<int> & selecte
 	foreach(int site, selectedSites) {
 		SiteManager *manager = allManagers[site];
 		sites.append(manager);
-		foreach(enum PMDisplayNumber display, displays) {
-			manager->addDisplay(display);
-		}
 
 		connect(manager, SIGNAL(displayUpdated(PMDisplayNumber)), this, SLOT(displayUpdated(PMDisplayNumber)));
 		connect(manager, SIGNAL(programUpdated(PMProgramNumber)), this, SLOT(programUpdated(PMProgramNumber)));
@@ -276,6 +402,8 @@ void DisplayTableModel::setSites(SitesList *allSites, const QList<int> & selecte
 			manager->startUpdating();
 		}
 	}
+	updateSubscriptions();
+	rebuildCache();
 
 	endResetModel();
 }
@@ -288,10 +416,8 @@ void DisplayTableModel::addDisplayAt(enum PMDisplayNumber display, int row) {
 	beginInsertRows(QModelIndex(), row, row);
 
 	displays.insert(row, display);
-
-	foreach(SiteManager *site, sites) {
-		site->addDisplay(display);
-	}
+	updateSubscriptions();
+	rebuildCache();
 
 	endInsertRows();
 }
@@ -299,13 +425,9 @@ void DisplayTableModel::addDisplayAt(enum PMDisplayNumber display, int row) {
 void DisplayTableModel::removeDisplayAt(int row) {
 	beginRemoveRows(QModelIndex(), row, row);
 
-	enum PMDisplayNumber display = displays[row];
-
 	displays.removeAt(row);
-
-	foreach(SiteManager *site, sites) {
-		site->removeDisplay(display);
-	}
+	updateSubscriptions();
+	rebuildCache();
 
 	endRemoveRows();
 }
@@ -313,16 +435,9 @@ void DisplayTableModel::removeDisplayAt(int row) {
 void DisplayTableModel::setDisplays(const QList<enum PMDisplayNumber> & newDisplays) {
 	beginResetModel();
 
-	foreach(SiteManager *site, sites) {
-		for(int i = 0; i < displays.size(); i++) {
-			site->removeDisplay(displays[i]);
-		}
-		for(int i = 0; i < newDisplays.size(); i++) {
-			site->addDisplay(newDisplays[i]);
-		}
-	}
-
 	displays = newDisplays;
+	updateSubscriptions();
+	rebuildCache();
 
 	endResetModel();
 }
@@ -9,10 +9,16 @@
 #include <QModelIndex>
 #include <QList>
 #include <QObject>
+#include <QSet>
+#include <QPair>
+#include <QVector>
+#include <QString>
 
 class SiteManager;
 class SitesList;
 
+class QTimer;
+
 class DisplayTableModel : public QAbstractTableModel {
 	Q_OBJECT
 	Q_PROPERTY(bool updating READ isUpdating WRITE setUpdating);
@@ -32,6 +38,10 @@ public:
 	bool isUpdating();
 	void setUpdating(bool on);
 
+	// The part of the table that can be seen. Only the visible cells are polled.
+	void setVisibleRange(int firstRow, int lastRow, int firstColumn, int lastColumn);
+	void setShown(bool shown);
+
 	int rowCount(const QModelIndex & parent = QModelIndex()) const;
 	int columnCount(const QModelIndex & parent = QModelIndex()) const;
 	QVariant data(const QModelIndex &index, int role) const;
@@ -43,6 +53,7 @@ public slots:
 	void tempUnitChanged();
 	void columnUpdated();
 	void labelsUpdated();
+	void flushChanges();
 
 	void statusChanged(SiteManager::Status status);
 
@@ -55,6 +66,41 @@ private:
 
 	int alarmMasks[2];
 
+	// Everything data() and headerData() return is cached, and only recomputed when it changes
+	enum CellColor {
+		CellNormal,
+		CellGray,
+		CellRed
+	};
+	struct Cell {
+		QVariant text;
+		CellColor color;
+	};
+	QVector<Cell> cells; // Indexed by row * sites.size() + column
+	QVector<QString> rowLabels;
+	QVariant grayBrush;
+	QVariant redBrush;
+
+	void computeCell(int row, int column, Cell & cell);
+	void updateCell(int row, int column);
+	void rebuildCache();
+	void rebuildLabels();
+
+	// Bounding box of the cells changed since the last flush
+	bool dirty;
+	int dirtyTop, dirtyBottom, dirtyLeft, dirtyRight;
+	QTimer *flushTimer;
+
+	void updateSubscriptions();
+	void unsubscribeAll();
+
+	QSet<QPair<SiteManager *, enum PMDisplayNumber> > subscriptions;
+	int visibleFirstRow;
+	int visibleLastRow;
+	int visibleFirstColumn;
+	int visibleLastColumn;
+	bool shown;
+
 	bool updating;
 };
 
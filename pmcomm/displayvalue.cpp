@@ -16,6 +16,11 @@ DisplayValue::DisplayValue(enum PMDisplayNumber disp, struct PMDisplayValue &val
 	precision = 0;
 }
 
+// Constructs a value from the raw val field of a struct PMDisplayValue
+DisplayValue::DisplayValue(enum PMDisplayNumber disp, int rawValue) : disp(disp), intValue(rawValue) {
+	precision = 0;
+}
+
 // Gets the display number this corresponds to
 enum PMDisplayNumber DisplayValue::displayNum() {
 	return disp;
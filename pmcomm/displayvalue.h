@@ -13,6 +13,7 @@ class DisplayValue {
 public:
 	DisplayValue();
 	DisplayValue(enum PMDisplayNumber disp, struct PMDisplayValue &val);
+	DisplayValue(enum PMDisplayNumber disp, int rawValue);
 	virtual ~DisplayValue() {}
 
 	virtual double toDouble();
@@ -16,12 +16,21 @@
 #include <QListWidget>
 #include <QLineEdit>
 #include <QPushButton>
+#include <QProgressDialog>
 
 DownloadOptionsDialog::DownloadOptionsDialog(QSharedPointer<SiteSettings> settings, LoggedDownloader *downloader, QWidget *parent) : QDialog(parent) {
 	setWindowTitle("Logged data auto-download");
 	setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Expanding);
 	this->settings = settings;
 	this->downloader = downloader;
+	storage = downloader->getStorage();
+	listRequest = -1;
+	deleteRequest = -1;
+	deleteProgress = NULL;
+
+	connect(storage, SIGNAL(downloadsListed(int, const DownloadList &, bool)), this, SLOT(downloadsListed(int, const DownloadList &, bool)));
+	connect(storage, SIGNAL(progress(int, int, int)), this, SLOT(storageProgress(int, int, int)));
+	connect(storage, SIGNAL(finished(int, bool)), this, SLOT(storageFinished(int, bool)));
 
 	QGridLayout *layout = new QGridLayout(this);
 
@@ -78,10 +87,17 @@ DownloadOptionsDialog::DownloadOptionsDialog(QSharedPointer<SiteSettings> settin
 	layout->addWidget(buttonBox, 1, 1, 1, 1);
 }
 
+// Asks for the list of downloads, which is filled in by downloadsListed()
 void DownloadOptionsDialog::refreshDownloadList() {
+	listRequest = LoggedStorage::newRequest();
+	QMetaObject::invokeMethod(storage, "listDownloads", Qt::QueuedConnection, Q_ARG(int, listRequest), Q_ARG(int, settings->getId()));
+}
+
+void DownloadOptionsDialog::downloadsListed(int request, const DownloadList & downloads, bool) {
+	if(request != listRequest)
+		return;
+
 	downloadList->clear();
-	bool success;
-	QList<QPair<int, int64_t> > downloads = downloader->downloadsForSite(settings->getId(), success);
 	for(int i = 0; i < downloads.size(); i++) {
 		QDateTime localTime = QDateTime::fromTime_t(downloads[i].second).toLocalTime();
 		QString formattedTime = localTime.toString("MM/dd/yyyy hh:mm");
@@ -128,8 +144,37 @@ void DownloadOptionsDialog::deleteButtonClicked() {
 		return;
 
 	QList<int> ids = getSelectedIds();
-	downloader->deleteLoggedSet(ids);
+	if(ids.empty())
+		return;
+
+	deleteRequest = LoggedStorage::newRequest();
+	deleteProgress = new QProgressDialog("Deleting the selected downloads...", QString(), 0, ids.size(), this);
+	deleteProgress->setWindowModality(Qt::WindowModal);
+	deleteProgress->setValue(0);
+	QMetaObject::invokeMethod(storage, "deleteDownloads", Qt::QueuedConnection, Q_ARG(int, deleteRequest), Q_ARG(QList<int>, ids));
+}
+
+void DownloadOptionsDialog::storageProgress(int request, int done, int total) {
+	if(request != deleteRequest || deleteProgress == NULL)
+		return;
+
+	deleteProgress->setMaximum(total);
+	deleteProgress->setValue(done);
+}
+
+void DownloadOptionsDialog::storageFinished(int request, bool success) {
+	if(request != deleteRequest)
+		return;
+
+	deleteRequest = -1;
+	delete deleteProgress;
+	deleteProgress = NULL;
 	refreshDownloadList();
+
+	if(!success) {
+		QMessageBox failure(QMessageBox::Warning, "Error", "Unable to delete all of the selected downloads", QMessageBox::Ok, this);
+		failure.exec();
+	}
 }
 
 void DownloadOptionsDialog::exportSelectedClicked() {
@@ -148,7 +193,7 @@ void DownloadOptionsDialog::handleExport(QList<int> & ids) {
 }
 
 
-LoggedExportDialog::LoggedExportDialog(LoggedDownloader *downloader, QList<int> & ids, QWidget *parent) : QDialog(parent), downloader(downloader), ids(ids) {
+LoggedExportDialog::LoggedExportDialog(LoggedDownloader *downloader, QList<int> & ids, QWidget *parent) : QDialog(parent), ids(ids) {
 	setWindowTitle("Export Logged Data");
 	setMinimumWidth(500);
 	setWindowModality(Qt::WindowModal);
@@ -175,13 +220,24 @@ LoggedExportDialog::LoggedExportDialog(LoggedDownloader *downloader, QList<int>
 	optionsLayout->addRow("Location", pathLayout);
 	optionsLayout->addRow("File name", nameBox);
 
+	formatBox = new QComboBox();
+	formatBox->addItem("CSV files, for spreadsheets", LoggedData::EXPORT_CSV);
+	formatBox->addItem("Column files, for analysis tools", LoggedData::EXPORT_COLUMNS);
+	optionsLayout->addRow("Format", formatBox);
+
 	layout->addLayout(optionsLayout);
 
-	QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Save | QDialogButtonBox::Cancel);
+	buttonBox = new QDialogButtonBox(QDialogButtonBox::Save | QDialogButtonBox::Cancel);
 	layout->addWidget(buttonBox);
 
 	connect(buttonBox, SIGNAL(accepted()), this, SLOT(exportClicked()));
 	connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
+
+	storage = downloader->getStorage();
+	exportRequest = -1;
+	exportProgress = NULL;
+	connect(storage, SIGNAL(progress(int, int, int)), this, SLOT(storageProgress(int, int, int)));
+	connect(storage, SIGNAL(finished(int, bool)), this, SLOT(storageFinished(int, bool)));
 }
 
 void LoggedExportDialog::browseClicked() {
@@ -215,14 +271,40 @@ void LoggedExportDialog::exportClicked() {
     AppSettings *settings = AppSettings::getInstance();
 	settings->setDownloadPath(path);
 
-	bool success;
-	QList<QSharedPointer<LoggedData> > data = downloader->retrieveLoggedSet(ids, success);
+	QString baseName = QString("%1/%3").arg(path).arg(nameBox->text());
+	int format = formatBox->itemData(formatBox->currentIndex()).toInt();
+
+	// The files are written on the storage thread. Until it finishes, the progress dialog
+	// keeps this one from being used
+	exportRequest = LoggedStorage::newRequest();
+	exportProgress = new QProgressDialog("Exporting logged data...", QString(), 0, 0, this);
+	exportProgress->setWindowModality(Qt::WindowModal);
+	exportProgress->setValue(0);
+	buttonBox->setEnabled(false);
+	QMetaObject::invokeMethod(storage, "exportDownloads", Qt::QueuedConnection, Q_ARG(int, exportRequest), Q_ARG(QList<int>, ids),
+		Q_ARG(QString, baseName), Q_ARG(int, format), Q_ARG(LoggedFileWriter::Settings, LoggedFileWriter::currentSettings()));
+}
+
+void LoggedExportDialog::storageProgress(int request, int done, int total) {
+	if(request != exportRequest || exportProgress == NULL)
+		return;
+
+	exportProgress->setMaximum(total);
+	exportProgress->setValue(done);
+}
+
+void LoggedExportDialog::storageFinished(int request, bool success) {
+	if(request != exportRequest)
+		return;
+
+	exportRequest = -1;
+	delete exportProgress;
+	exportProgress = NULL;
+	buttonBox->setEnabled(true);
+
 	if(success) {
-		QString baseName = QString("%1/%3").arg(path).arg(nameBox->text());
-		if(LoggedData::writeRecordsToFiles(data, baseName)) {
-			accept();
-			return;
-		}
+		accept();
+		return;
 	}
 	QMessageBox failure(QMessageBox::Warning, "Error", "Unable to write output files", QMessageBox::Ok, this);
 	failure.exec();
@@ -2,6 +2,7 @@
 #define DOWNLOADOPTIONSDIALOG_H
 
 #include "sitesettings.h"
+#include "loggedstorage.h"
 
 #include <QObject>
 #include <QDialog>
@@ -14,6 +15,8 @@ class LoggedDownloader;
 class QComboBox;
 class QListWidget;
 class QLineEdit;
+class QProgressDialog;
+class QDialogButtonBox;
 
 class DownloadOptionsDialog : public QDialog {
 	Q_OBJECT
@@ -26,6 +29,10 @@ public slots:
 	void exportSelectedClicked();
 	void exportAllClicked();
 
+	void downloadsListed(int request, const DownloadList & downloads, bool success);
+	void storageProgress(int request, int done, int total);
+	void storageFinished(int request, bool success);
+
 private:
 	void refreshDownloadList();
 	QList<int> getSelectedIds();
@@ -33,8 +40,13 @@ private:
 	void handleExport(QList<int> & ids);
 	QSharedPointer<SiteSettings> settings;
 	LoggedDownloader *downloader;
+	LoggedStorage *storage;
 	QListWidget *downloadList;
 
+	int listRequest; // The latest request for the list of downloads
+	int deleteRequest;
+	QProgressDialog *deleteProgress;
+
 	QComboBox *downloadFrequency;
 };
 
@@ -47,12 +59,20 @@ public slots:
 	void exportClicked();
 	void browseClicked();
 
+	void storageProgress(int request, int done, int total);
+	void storageFinished(int request, bool success);
+
 private:
-	LoggedDownloader *downloader;
+	LoggedStorage *storage;
 	QList<int> ids;
 
+	int exportRequest;
+	QProgressDialog *exportProgress;
+	QDialogButtonBox *buttonBox;
+
 	QLineEdit *nameBox;
 	QLineEdit *pathBox;
+	QComboBox *formatBox;
 };
 
 
@@ -0,0 +1,446 @@
+#include "historystore.h"
+
+#include <QTimer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <limits>
+
+#include <QDebug>
+
+// The way to get standard locations changed between Qt4 and Qt5
+#if QT_VERSION >= 0x050000
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+
+static const int BLOCK_BYTES = 4096; // A block is sealed once its payload reaches this size
+static const int MAX_BLOCK_AGE = 60; // Seconds before a partly filled block is written anyway
+static const int FLUSH_CHECK_INTERVAL = 10000;
+static const int MAINTENANCE_INTERVAL = 3600000;
+static const int SECS_PER_DAY = 86400;
+static const int BLOCK_HEADER_BYTES = 20;
+static const char MAGIC[] = "PMH1";
+
+HistoryStore *HistoryStore::singletonInstance = NULL;
+
+static inline quint64 zigzag(qint64 v) {
+	return ((quint64) v << 1) ^ (quint64) (v >> 63);
+}
+
+static inline qint64 unzigzag(quint64 v) {
+	return (qint64) (v >> 1) ^ -(qint64) (v & 1);
+}
+
+static void putVarint(QByteArray & out, quint64 v) {
+	while(v >= 0x80) {
+		out.append((char) ((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	out.append((char) v);
+}
+
+static bool getVarint(const char *& p, const char *end, quint64 & v) {
+	v = 0;
+	for(int shift = 0; shift < 64; shift += 7) {
+		if(p >= end)
+			return false;
+		quint8 b = (quint8) *p++;
+		v |= (quint64) (b & 0x7f) << shift;
+		if(!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static void putFixed(QByteArray & out, quint64 v, int bytes) {
+	for(int i = 0; i < bytes; i++) {
+		out.append((char) (v >> (8 * i)));
+	}
+}
+
+static quint64 getFixed(const char *p, int bytes) {
+	quint64 v = 0;
+	for(int i = 0; i < bytes; i++) {
+		v |= (quint64) (quint8) p[i] << (8 * i);
+	}
+	return v;
+}
+
+HistoryStore::HistoryStore(QString path, int rawDays, int retentionDays, QObject *parent) : QThread(parent) {
+	this->path = path;
+	this->rawDays = rawDays;
+	this->retentionDays = retentionDays;
+	stopping = false;
+
+	flushTimer = new QTimer(this);
+	flushTimer->setInterval(FLUSH_CHECK_INTERVAL);
+	connect(flushTimer, SIGNAL(timeout()), this, SLOT(flushOld()));
+	flushTimer->start();
+
+	start(QThread::LowPriority);
+}
+
+HistoryStore::~HistoryStore() {
+	flush();
+
+	mutex.lock();
+	stopping = true;
+	wake.wakeAll();
+	mutex.unlock();
+
+	wait();
+}
+
+QString HistoryStore::defaultLocation() {
+#if QT_VERSION >= 0x050000
+	QString storagePath = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+#else
+	QString storagePath = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
+#endif
+	return storagePath + "/history";
+}
+
+void HistoryStore::append(int site, enum PMDisplayNumber display, qint64 time, int value) {
+	QPair<int, int> key(site, display);
+	QHash<QPair<int, int>, Block>::iterator it = openBlocks.find(key);
+	if(it != openBlocks.end()) {
+		Block & block = it.value();
+		// Blocks can't span files, so a new day always starts a new block
+		if(dayOf(time) == dayOf(block.firstTime) && time >= block.prevTime) {
+			encodeSample(block, time, value);
+			if(block.payload.size() >= BLOCK_BYTES || block.count == 0xffff) {
+				seal(block);
+				openBlocks.erase(it);
+			}
+			return;
+		}
+		seal(block);
+		openBlocks.erase(it);
+	}
+
+	Block block;
+	startBlock(block, site, display, time, value);
+	openBlocks.insert(key, block);
+}
+
+void HistoryStore::flush() {
+	foreach(QPair<int, int> key, openBlocks.keys()) {
+		seal(openBlocks[key]);
+	}
+	openBlocks.clear();
+}
+
+void HistoryStore::flushOld() {
+	qint64 now = QDateTime::currentDateTime().toTime_t();
+	QHash<QPair<int, int>, Block>::iterator it = openBlocks.begin();
+	while(it != openBlocks.end()) {
+		if(now - it.value().firstTime >= MAX_BLOCK_AGE) {
+			seal(it.value());
+			it = openBlocks.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void HistoryStore::seal(Block & block) {
+	QMutexLocker locker(&mutex);
+	pending.append(block);
+	wake.wakeAll();
+}
+
+void HistoryStore::startBlock(Block & block, int site, quint16 display, qint64 time, int value) {
+	block.site = site;
+	block.display = display;
+	block.count = 1;
+	block.firstTime = time;
+	block.firstValue = value;
+	block.payload.clear();
+	block.prevTime = time;
+	block.prevDelta = 0;
+	block.prevValue = value;
+}
+
+void HistoryStore::encodeSample(Block & block, qint64 time, int value) {
+	qint64 delta = time - block.prevTime;
+	putVarint(block.payload, zigzag(delta - block.prevDelta));
+	putVarint(block.payload, zigzag((qint64) value - block.prevValue));
+
+	block.prevTime = time;
+	block.prevDelta = delta;
+	block.prevValue = value;
+	block.count++;
+}
+
+void HistoryStore::writeBlock(QByteArray & out, const Block & block) {
+	putFixed(out, block.display, 2);
+	putFixed(out, block.count, 2);
+	putFixed(out, block.payload.size(), 4);
+	putFixed(out, block.firstTime, 8);
+	putFixed(out, (quint32) block.firstValue, 4);
+	out.append(block.payload);
+}
+
+bool HistoryStore::decodeBlocks(const QByteArray & data, int display, qint64 from, qint64 to, QMap<int, QVector<HistorySample> > & samples) {
+	if(!data.startsWith(MAGIC))
+		return false;
+
+	const char *p = data.constData() + 4;
+	const char *end = data.constData() + data.size();
+	while(end - p >= BLOCK_HEADER_BYTES) {
+		int blockDisplay = getFixed(p, 2);
+		int count = getFixed(p + 2, 2);
+		int length = getFixed(p + 4, 4);
+		HistorySample sample;
+		sample.time = getFixed(p + 8, 8);
+		sample.value = (qint32) getFixed(p + 16, 4);
+		p += BLOCK_HEADER_BYTES;
+
+		const char *blockEnd = p + length;
+		if(length < 0 || blockEnd > end)
+			return true; // A block that is still being written; everything before it is good
+
+		if((display != -1 && blockDisplay != display) || sample.time > to) {
+			p = blockEnd;
+			continue;
+		}
+
+		QVector<HistorySample> & out = samples[blockDisplay];
+		qint64 delta = 0;
+		qint64 value = sample.value;
+		for(int i = 0; i < count; i++) {
+			if(i > 0) {
+				quint64 dod, dv;
+				if(!getVarint(p, blockEnd, dod) || !getVarint(p, blockEnd, dv))
+					return false;
+				delta += unzigzag(dod);
+				value += unzigzag(dv);
+				sample.time += delta;
+				sample.value = (int) value;
+			}
+			if(sample.time > to)
+				break;
+			if(sample.time >= from)
+				out.append(sample);
+		}
+		p = blockEnd;
+	}
+	return true;
+}
+
+qint64 HistoryStore::dayOf(qint64 time) {
+	return time >= 0 ? time / SECS_PER_DAY : (time - SECS_PER_DAY + 1) / SECS_PER_DAY;
+}
+
+QString HistoryStore::siteDir(int site) {
+	return QString("%1/site%2").arg(path).arg(site);
+}
+
+QString HistoryStore::dayFile(int site, qint64 day, bool downsampled) {
+	QString date = QDateTime::fromTime_t(day * SECS_PER_DAY).toUTC().toString("yyyyMMdd");
+	return QString("%1/%2%3").arg(siteDir(site)).arg(date).arg(downsampled ? ".min.pmh" : ".pmh");
+}
+
+QVector<HistorySample> HistoryStore::read(int site, enum PMDisplayNumber display, qint64 from, qint64 to) {
+	QMap<int, QVector<HistorySample> > samples;
+	if(to < from)
+		return samples[display];
+
+	QMutexLocker locker(&fileMutex);
+	for(qint64 day = dayOf(from); day <= dayOf(to); day++) {
+		// A day is only ever in one of the two files, except for a moment while it is downsampled
+		QFile file(dayFile(site, day, true));
+		if(!file.exists())
+			file.setFileName(dayFile(site, day, false));
+		if(!file.open(QIODevice::ReadOnly))
+			continue;
+		if(!decodeBlocks(file.readAll(), display, from, to, samples))
+			qDebug() << "Corrupt history file " << file.fileName();
+	}
+	return samples[display];
+}
+
+void HistoryStore::run() {
+	QDateTime lastMaintenance;
+
+	mutex.lock();
+	while(true) {
+		if(!lastMaintenance.isValid() || lastMaintenance.secsTo(QDateTime::currentDateTime()) * 1000 >= MAINTENANCE_INTERVAL) {
+			mutex.unlock();
+			maintain();
+			lastMaintenance = QDateTime::currentDateTime();
+			mutex.lock();
+		}
+
+		if(!pending.isEmpty()) {
+			QList<Block> blocks = pending;
+			pending.clear();
+			mutex.unlock();
+			writeBlocks(blocks);
+			mutex.lock();
+			continue;
+		}
+
+		if(stopping)
+			break;
+		wake.wait(&mutex, MAINTENANCE_INTERVAL);
+	}
+	mutex.unlock();
+}
+
+void HistoryStore::writeBlocks(const QList<Block> & blocks) {
+	// Group the blocks by file, so each file is only opened once. read() ignores the raw file of a
+	// day that has been downsampled, so late blocks for one go to the minute file instead
+	QMap<QString, QByteArray> files;
+	foreach(const Block & block, blocks) {
+		qint64 day = dayOf(block.firstTime);
+		QString minPath = dayFile(block.site, day, true);
+		writeBlock(files[QFile::exists(minPath) ? minPath : dayFile(block.site, day, false)], block);
+	}
+
+	QMutexLocker locker(&fileMutex);
+	QMap<QString, QByteArray>::const_iterator it;
+	for(it = files.constBegin(); it != files.constEnd(); ++it) {
+		QFileInfo info(it.key());
+		if(!QDir("/").mkpath(info.absolutePath())) {
+			qDebug() << "Could not create history directory " << info.absolutePath();
+			continue;
+		}
+
+		QFile file(it.key());
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+			qDebug() << "Could not open history file " << it.key();
+			continue;
+		}
+		if(file.size() == 0)
+			file.write(MAGIC, 4);
+		file.write(it.value());
+	}
+}
+
+void HistoryStore::maintain() {
+	qint64 today = dayOf(QDateTime::currentDateTime().toTime_t());
+	QDate epoch(1970, 1, 1);
+
+	QDir root(path);
+	foreach(QString siteName, root.entryList(QStringList("site*"), QDir::Dirs | QDir::NoDotAndDotDot)) {
+		QDir dir(root.filePath(siteName));
+		foreach(QString name, dir.entryList(QStringList("*.pmh"), QDir::Files)) {
+			QDate date = QDate::fromString(name.left(8), "yyyyMMdd");
+			if(!date.isValid())
+				continue;
+			qint64 age = today - epoch.daysTo(date);
+			bool downsampled = name.endsWith(".min.pmh");
+
+			if(retentionDays > 0 && age > retentionDays) {
+				QMutexLocker locker(&fileMutex);
+				dir.remove(name);
+			} else if(!downsampled && age > rawDays) {
+				downsample(dir.filePath(name), dir.filePath(name.left(8) + ".min.pmh"));
+			}
+		}
+	}
+}
+
+// Reduces the samples of one display in one minute to one value. Measurements are averaged,
+// leaving out the values the PentaMetric uses to mean "unknown". The alarm word is a bitmask, so
+// its bits are ORed, and the other combined displays keep their last value
+int HistoryStore::minuteValue(int display, const HistorySample *samples, int n) {
+	if(display == PM_DALARM) {
+		int bits = 0;
+		for(int i = 0; i < n; i++) {
+			bits |= samples[i].value;
+		}
+		return bits;
+	}
+	if(display == PM_D29_34 || display == PM_D35_40)
+		return samples[n - 1].value;
+
+	int invalid;
+	if(display == PM_D28)
+		invalid = -21; // Temperature
+	else if(display == PM_D24 || display == PM_D25)
+		invalid = 65535; // Days since charged
+	else
+		invalid = std::numeric_limits<int>::min();
+
+	qint64 sum = 0;
+	int count = 0;
+	for(int i = 0; i < n; i++) {
+		if(samples[i].value != invalid) {
+			sum += samples[i].value;
+			count++;
+		}
+	}
+	if(count == 0)
+		return invalid;
+	return (int) ((sum + (sum >= 0 ? count / 2 : -count / 2)) / count);
+}
+
+// Replaces a day of raw samples with one value for each minute
+bool HistoryStore::downsample(const QString & rawPath, const QString & minPath) {
+	if(QFile::exists(minPath)) {
+		// Already done, but stopped before the raw file was removed. Nothing is appended to the raw
+		// file once the minute file exists, so the raw file holds nothing new
+		QMutexLocker locker(&fileMutex);
+		return QFile::remove(rawPath);
+	}
+
+	QFile raw(rawPath);
+	if(!raw.open(QIODevice::ReadOnly))
+		return false;
+	QMap<int, QVector<HistorySample> > samples;
+	if(!decodeBlocks(raw.readAll(), -1, std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max(), samples)) {
+		qDebug() << "Corrupt history file " << rawPath;
+		return false;
+	}
+	raw.close();
+
+	QByteArray out(MAGIC, 4);
+	QMap<int, QVector<HistorySample> >::const_iterator it;
+	for(it = samples.constBegin(); it != samples.constEnd(); ++it) {
+		const QVector<HistorySample> & displaySamples = it.value();
+		Block block;
+		block.count = 0;
+		int i = 0;
+		while(i < displaySamples.size()) {
+			qint64 minute = displaySamples[i].time - (displaySamples[i].time % 60 + 60) % 60;
+			int start = i;
+			while(i < displaySamples.size() && displaySamples[i].time < minute + 60) {
+				i++;
+			}
+			int value = minuteValue(it.key(), displaySamples.constData() + start, i - start);
+
+			if(block.count == 0) {
+				startBlock(block, 0, it.key(), minute, value);
+			} else {
+				encodeSample(block, minute, value);
+			}
+			if(block.payload.size() >= BLOCK_BYTES || block.count == 0xffff) {
+				writeBlock(out, block);
+				block.count = 0;
+			}
+		}
+		if(block.count > 0)
+			writeBlock(out, block);
+	}
+
+	QString tmpPath = minPath + ".tmp";
+	QFile tmp(tmpPath);
+	if(!tmp.open(QIODevice::WriteOnly | QIODevice::Truncate) || tmp.write(out) != out.size()) {
+		tmp.remove();
+		return false;
+	}
+	tmp.close();
+
+	QMutexLocker locker(&fileMutex);
+	if(!QFile::rename(tmpPath, minPath)) {
+		QFile::remove(tmpPath);
+		return false;
+	}
+	return QFile::remove(rawPath);
+}
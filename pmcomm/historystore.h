@@ -0,0 +1,128 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include "pmdefs.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QPair>
+#include <QList>
+#include <QMap>
+#include <QVector>
+
+class QTimer;
+
+// A single polled value. Times are in seconds since the epoch (UTC)
+struct HistorySample {
+	qint64 time;
+	int value; // The raw value, as returned by DisplayValue::getRawIntValue()
+};
+
+/* This class keeps the history of every display value polled by the SiteManagers, so that
+   second-resolution data is available for every site, not just what the PentaMetric logs itself.
+
+   Samples are not stored one per row. Each (site, display) pair has an open block in memory,
+   and each sample is appended to it as the difference from the previous one: the timestamp as
+   a delta-of-delta and the value as a delta, both zigzag encoded as variable length integers.
+   Polling is periodic, so most samples take two or three bytes. Once a block is full, or has
+   been open for a while, it is handed to the writer thread, which appends it to a file for
+   that site and day:
+
+	<path>/site<id>/<yyyyMMdd>.pmh       every polled sample
+	<path>/site<id>/<yyyyMMdd>.min.pmh   one value per minute, once the day is older than rawDays
+
+   Each file starts with the magic "PMH1", followed by blocks. A block is a 20 byte header
+   (little-endian quint16 display, quint16 sample count, quint32 payload length, qint64 time of
+   the first sample, qint32 value of the first sample) followed by the payload. Blocks for a
+   display are in time order, but blocks of different displays are interleaved.
+
+   Once an hour the writer thread downsamples days older than rawDays and deletes days older than
+   retentionDays (0 keeps them forever). Blocks that arrive for a day after it has been
+   downsampled, such as after a clock change, are appended to its .min.pmh as they are.
+
+   append() and flush() must be called from the thread that created the store. read() can be
+   called from any thread, but only returns samples that have already been handed to the writer.
+ */
+class HistoryStore : public QThread {
+	Q_OBJECT
+
+public:
+	HistoryStore(QString path, int rawDays, int retentionDays, QObject *parent = NULL);
+	~HistoryStore();
+
+	static HistoryStore *getInstance() { return singletonInstance; }
+	static void setSingletonInstance(HistoryStore *instance) { singletonInstance = instance; }
+
+	// The directory used when none is configured
+	static QString defaultLocation();
+
+	void append(int site, enum PMDisplayNumber display, qint64 time, int value);
+
+	// Returns the samples of one display with from <= time <= to, in time order
+	QVector<HistorySample> read(int site, enum PMDisplayNumber display, qint64 from, qint64 to);
+
+	// Hands every open block to the writer thread
+	void flush();
+
+protected:
+	void run();
+
+private slots:
+	void flushOld();
+
+private:
+	struct Block {
+		int site;
+		quint16 display;
+		quint16 count;
+		qint64 firstTime;
+		qint32 firstValue;
+		QByteArray payload;
+
+		// Encoder state; not stored
+		qint64 prevTime;
+		qint64 prevDelta;
+		qint64 prevValue;
+	};
+
+	static void startBlock(Block & block, int site, quint16 display, qint64 time, int value);
+	static void encodeSample(Block & block, qint64 time, int value);
+	static void writeBlock(QByteArray & out, const Block & block);
+	// Appends the samples in the range to samples[display]. A display of -1 decodes every display
+	static bool decodeBlocks(const QByteArray & data, int display, qint64 from, qint64 to, QMap<int, QVector<HistorySample> > & samples);
+
+	static qint64 dayOf(qint64 time);
+	QString siteDir(int site);
+	QString dayFile(int site, qint64 day, bool downsampled);
+
+	void seal(Block & block);
+
+	// Writer thread
+	void writeBlocks(const QList<Block> & blocks);
+	void maintain();
+	bool downsample(const QString & rawPath, const QString & minPath);
+	static int minuteValue(int display, const HistorySample *samples, int n);
+
+	static HistoryStore *singletonInstance;
+
+	QString path;
+	int rawDays;
+	int retentionDays;
+
+	// Only used by the creating thread
+	QHash<QPair<int, int>, Block> openBlocks;
+	QTimer *flushTimer;
+
+	QMutex mutex; // Protects pending and stopping
+	QWaitCondition wake;
+	QList<Block> pending;
+	bool stopping;
+
+	QMutex fileMutex; // Held while a file is written or replaced, so read() never sees a half-replaced day
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "ioscheduler.h"
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutexLocker>
+
+IOScheduler *IOScheduler::singletonInstance = NULL;
+
+// Runs a single request from a strand on one of the pool's threads
+class StrandRunner : public QRunnable {
+public:
+	StrandRunner(IOScheduler *scheduler, PMConnectionWrapper *wrapper) : scheduler(scheduler), wrapper(wrapper) {}
+
+	void run() {
+		scheduler->runNext(wrapper);
+	}
+
+private:
+	IOScheduler *scheduler;
+	PMConnectionWrapper *wrapper;
+};
+
+IOScheduler::IOScheduler(int maxThreads, QObject *parent) : QObject(parent) {
+	shuttingDown = false;
+	pool = new QThreadPool(this);
+	setMaxThreadCount(maxThreads);
+}
+
+IOScheduler::~IOScheduler() {
+	{
+		QMutexLocker locker(&mutex);
+		shuttingDown = true;
+
+		// Only let the connections close; nobody is left to receive the other results
+		foreach(Strand *strand, strands) {
+			QQueue<PMConnectionWrapper::Request> remaining;
+			foreach(const PMConnectionWrapper::Request & request, strand->requests) {
+				if(request.kind == PMConnectionWrapper::Request::Disconnect)
+					remaining.enqueue(request);
+			}
+			strand->requests = remaining;
+		}
+	}
+
+	pool->waitForDone();
+
+	// The event loop has already stopped, so deleteLater() would never get to these
+	foreach(PMConnectionWrapper *wrapper, closedAtShutdown) {
+		delete wrapper;
+	}
+	closedAtShutdown.clear();
+
+	foreach(Strand *strand, strands) {
+		delete strand;
+	}
+	strands.clear();
+}
+
+int IOScheduler::maxThreadCount() {
+	return pool->maxThreadCount();
+}
+
+void IOScheduler::setMaxThreadCount(int maxThreads) {
+	pool->setMaxThreadCount(qMax(1, maxThreads));
+}
+
+// Queues a request for the given wrapper. The wrapper's signals are emitted from a worker thread.
+void IOScheduler::submit(PMConnectionWrapper *wrapper, const PMConnectionWrapper::Request & request) {
+	QMutexLocker locker(&mutex);
+	if(shuttingDown)
+		return;
+
+	Strand *strand = strands.value(wrapper);
+	if(strand == NULL) {
+		strand = new Strand;
+		strand->running = false;
+		strand->released = false;
+		strands.insert(wrapper, strand);
+	}
+
+	if(strand->released)
+		return;
+
+	strand->requests.enqueue(request);
+	if(!strand->running) {
+		strand->running = true;
+		schedule(wrapper);
+	}
+}
+
+// Drops any requests that haven't started yet, then disconnects and deletes the wrapper
+void IOScheduler::release(PMConnectionWrapper *wrapper) {
+	QMutexLocker locker(&mutex);
+
+	Strand *strand = strands.value(wrapper);
+	if(strand == NULL) {
+		// Nothing was ever run, so there is no connection to close
+		locker.unlock();
+		delete wrapper;
+		return;
+	}
+
+	strand->requests.clear();
+	strand->released = true;
+	strand->requests.enqueue(PMConnectionWrapper::Request(PMConnectionWrapper::Request::Disconnect, -1));
+	if(!strand->running) {
+		strand->running = true;
+		schedule(wrapper);
+	}
+}
+
+// Must be called with the mutex held
+void IOScheduler::schedule(PMConnectionWrapper *wrapper) {
+	StrandRunner *runner = new StrandRunner(this, wrapper);
+	runner->setAutoDelete(true);
+	pool->start(runner);
+}
+
+void IOScheduler::runNext(PMConnectionWrapper *wrapper) {
+	PMConnectionWrapper::Request request;
+	{
+		QMutexLocker locker(&mutex);
+		Strand *strand = strands.value(wrapper);
+		if(strand == NULL)
+			return;
+
+		if(strand->requests.isEmpty()) {
+			strand->running = false;
+			return;
+		}
+		request = strand->requests.dequeue();
+	}
+
+	wrapper->execute(request);
+
+	QMutexLocker locker(&mutex);
+	Strand *strand = strands.value(wrapper);
+	if(strand->released && request.kind == PMConnectionWrapper::Request::Disconnect) {
+		strands.remove(wrapper);
+		delete strand;
+		if(shuttingDown) {
+			closedAtShutdown.append(wrapper);
+			return;
+		}
+		locker.unlock();
+		wrapper->deleteLater(); // Deleted on the thread that owns it, after any queued signals
+		return;
+	}
+
+	if(strand->requests.isEmpty()) {
+		strand->running = false;
+	} else {
+		schedule(wrapper); // Go to the back of the line so other sites get a turn
+	}
+}
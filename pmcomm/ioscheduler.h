@@ -0,0 +1,64 @@
+#ifndef IOSCHEDULER_H
+#define IOSCHEDULER_H
+
+#include "pmconnectionwrapper.h"
+
+#include <QObject>
+#include <QMutex>
+#include <QQueue>
+#include <QHash>
+
+class QThreadPool;
+
+/* This class runs the blocking libpmcomm calls for every PMConnectionWrapper in the
+   application on a small, shared pool of worker threads, instead of giving each site
+   its own thread.
+
+   Each wrapper has its own queue of requests (a "strand"). Requests for one wrapper are
+   always run one at a time and in the order they were submitted, but requests for
+   different wrappers run concurrently on up to maxThreadCount() threads. A strand only
+   runs one request each time it gets a worker, and then goes to the back of the line,
+   so a site with a long queue can't starve the others.
+
+   The wrapper is owned by the scheduler once it has been attached. Call release() instead
+   of deleting it: the connection is closed on a worker thread and the wrapper is deleted
+   once any request that is currently running has finished.
+ */
+class IOScheduler : public QObject {
+	Q_OBJECT
+
+public:
+	IOScheduler(int maxThreads, QObject *parent = NULL);
+	~IOScheduler();
+
+	static IOScheduler *getInstance() { return singletonInstance; }
+	static void setSingletonInstance(IOScheduler *instance) { singletonInstance = instance; }
+
+	int maxThreadCount();
+	void setMaxThreadCount(int maxThreads);
+
+	void submit(PMConnectionWrapper *wrapper, const PMConnectionWrapper::Request & request);
+	void release(PMConnectionWrapper *wrapper);
+
+	// Called by the worker threads
+	void runNext(PMConnectionWrapper *wrapper);
+
+private:
+	struct Strand {
+		QQueue<PMConnectionWrapper::Request> requests;
+		bool running; // True while a worker has been scheduled for this strand
+		bool released; // True once release() has been called; no more requests are accepted
+	};
+
+	void schedule(PMConnectionWrapper *wrapper);
+
+	static IOScheduler *singletonInstance;
+
+	QMutex mutex;
+	QHash<PMConnectionWrapper *, Strand *> strands;
+	QList<PMConnectionWrapper *> closedAtShutdown; // Released wrappers left for the destructor to delete
+	QThreadPool *pool;
+	bool shuttingDown;
+};
+
+#endif
@@ -1,11 +1,137 @@
 #include "loggeddata.h"
+#include "csvwriter.h"
+#include "columnwriter.h"
+#include "periodicrollup.h"
 
 #include <QSqlQuery>
 #include <QDateTime>
 #include <QVariant>
 #include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QtAlgorithms>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+
+// Column definitions of the record tables. These are shared by every version of the schema
+static const char *periodicValueColumns = "ahr1man INTEGER,"
+	"ahr1exp INTEGER,"
+	"ahr2man INTEGER,"
+	"ahr2exp INTEGER,"
+	"ahr3man INTEGER,"
+	"ahr3exp INTEGER,"
+	"whr1man INTEGER,"
+	"whr1exp INTEGER,"
+	"whr2man INTEGER,"
+	"whr2exp INTEGER,"
+	"minTemp INTEGER,"
+	"maxTemp INTEGER,"
+	"volts1 INTEGER,"
+	"volts2 INTEGER,"
+	"amps1man INTEGER,"
+	"amps1exp INTEGER,"
+	"bat1percent INTEGER,"
+	"bat1charged INTEGER,"
+	"bat2percent INTEGER,"
+	"bat2charged INTEGER";
+
+// The per-download periodic table of versions 1 and 2
+static const char *periodicColumns = "downloadid INTEGER NOT NULL,"
+	"recordid INTEGER NOT NULL,"
+	"meastime INTEGER NOT NULL,";
+
+// One row per periodic record of a site, keyed by its absolute time. downloadid is the download
+// that first contained the record, and gap is set on a record that doesn't follow on from the one
+// before it (the unit lost power, or its log wrapped before it was downloaded again)
+static const char *timelineColumns = "siteid INTEGER NOT NULL,"
+	"abstime INTEGER NOT NULL,"
+	"downloadid INTEGER NOT NULL,"
+	"gap INTEGER NOT NULL,"
+	"meastime INTEGER NOT NULL,";
+
+static const char *profileColumns = "downloadid INTEGER NOT NULL,"
+	"recordid INTEGER NOT NULL,"
+	"battery INTEGER NOT NULL,"
+	"day INTEGER,"
+	"percent INTEGER,"
+	"volts INTEGER,"
+	"ampsman INTEGER,"
+	"ampsexp INTEGER";
+
+static const char *efficiencyColumns = "downloadid INTEGER NOT NULL,"
+	"recordid INTEGER NOT NULL,"
+	"battery INTEGER NOT NULL,"
+	"endtime INTEGER NOT NULL,"
+	"valid INTEGER NOT NULL,"
+	"length INTEGER,"
+	"discharge INTEGER,"
+	"charge INTEGER,"
+	"net INTEGER,"
+	"efficiency REAL,"
+	"selfdischarge REAL";
+
+// Version of the schema created by setupDB(), stored in PRAGMA user_version:
+//  0: no tables, or the original tables without any indexes
+//  1: the original tables
+//  2: record tables clustered on their primary keys, index on downloadinfo (siteid, realtime)
+//  3: periodic records stored once per site in periodic_timeline, instead of once per download
+//  4: rawdownload, for downloads archived as the unit's compressed raw memory
+//  5: periodic_hourly and periodic_daily, the rollups kept by PeriodicRollup
+//  6: downloadinfo.periodicstart, the time of the first record in each download's periodic log
+static const int SCHEMA_VERSION = 6;
+
+// WITHOUT ROWID needs SQLite 3.8.2. Older versions still get the primary key's index
+static QString clusteredSuffix(QSqlDatabase db) {
+	QSqlQuery query(db);
+	if(!query.exec("SELECT sqlite_version();") || !query.next())
+		return "";
+
+	QStringList parts = query.value(0).toString().split('.');
+	int v = 0;
+	for(int i = 0; i < 3; i++) {
+		v = v * 1000 + (i < parts.size() ? parts[i].toInt() : 0);
+	}
+	return v >= 3008002 ? " WITHOUT ROWID" : "";
+}
 
+// Creates the tables, or brings the tables of an older version up to date
 bool LoggedData::setupDB(QSqlDatabase db) {
+	QSqlQuery query(db);
+	if(!query.exec("PRAGMA user_version;") || !query.next())
+		return false;
+	int version = query.value(0).toInt();
+	query.finish();
+
+	if(version >= SCHEMA_VERSION)
+		return true;
+
+	if(!query.exec("BEGIN IMMEDIATE;"))
+		return false;
+
+	bool success = true;
+	if(version < 1)
+		success = createTablesV1(db);
+	if(version < 2)
+		success = success && migrateToV2(db);
+	if(version < 3)
+		success = success && migrateToV3(db);
+	if(version < 4)
+		success = success && migrateToV4(db);
+	if(version < 5)
+		success = success && migrateToV5(db);
+	if(version < 6)
+		success = success && migrateToV6(db);
+
+	success = success && query.exec(QString("PRAGMA user_version = %1;").arg(SCHEMA_VERSION));
+	success = success && query.exec("COMMIT;");
+	if(!success)
+		query.exec("ROLLBACK;");
+
+	return success;
+}
+
+bool LoggedData::createTablesV1(QSqlDatabase db) {
 	QSqlQuery query(db);
 	bool success = query.exec("CREATE TABLE IF NOT EXISTS downloadinfo ("
 		"downloadid INTEGER PRIMARY KEY,"
@@ -19,57 +145,121 @@ bool LoggedData::setupDB(QSqlDatabase db) {
 		"amps2label INTEGER,"
 		"amps3label INTEGER);");
 
-	success = success && query.exec("CREATE TABLE IF NOT EXISTS periodic ("
-		"downloadid INTEGER NOT NULL,"
-		"recordid INTEGER NOT NULL,"
-		"meastime INTEGER NOT NULL,"
-		"ahr1man INTEGER,"
-		"ahr1exp INTEGER,"
-		"ahr2man INTEGER,"
-		"ahr2exp INTEGER,"
-		"ahr3man INTEGER,"
-		"ahr3exp INTEGER,"
-		"whr1man INTEGER,"
-		"whr1exp INTEGER,"
-		"whr2man INTEGER,"
-		"whr2exp INTEGER,"
-		"minTemp INTEGER,"
-		"maxTemp INTEGER,"
-		"volts1 INTEGER,"
-		"volts2 INTEGER,"
-		"amps1man INTEGER,"
-		"amps1exp INTEGER,"
-		"bat1percent INTEGER,"
-		"bat1charged INTEGER,"
-		"bat2percent INTEGER,"
-		"bat2charged INTEGER);");
-
-	success = success && query.exec("CREATE TABLE IF NOT EXISTS profile ("
-		"downloadid INTEGER NOT NULL,"
-		"recordid INTEGER NOT NULL,"
-		"battery INTEGER NOT NULL,"
-		"day INTEGER,"
-		"percent INTEGER,"
-		"volts INTEGER,"
-		"ampsman INTEGER,"
-		"ampsexp INTEGER);");
-
-	success = success && query.exec("CREATE TABLE IF NOT EXISTS efficiency ("
-		"downloadid INTEGER NOT NULL,"
-		"recordid INTEGER NOT NULL,"
-		"battery INTEGER NOT NULL,"
-		"endtime INTEGER NOT NULL,"
-		"valid INTEGER NOT NULL,"
-		"length INTEGER,"
-		"discharge INTEGER,"
-		"charge INTEGER,"
-		"net INTEGER,"
-		"efficiency REAL,"
-		"selfdischarge REAL);");
+	success = success && query.exec(QString("CREATE TABLE IF NOT EXISTS periodic (%1%2);").arg(periodicColumns).arg(periodicValueColumns));
+	success = success && query.exec(QString("CREATE TABLE IF NOT EXISTS profile (%1);").arg(profileColumns));
+	success = success && query.exec(QString("CREATE TABLE IF NOT EXISTS efficiency (%1);").arg(efficiencyColumns));
+
+	return success;
+}
+
+// Rebuilds the record tables so that the rows of a download are stored together, in the order
+// they are read. Loading or deleting a download then only touches that download's rows
+bool LoggedData::migrateToV2(QSqlDatabase db) {
+	QSqlQuery query(db);
+	QString suffix = clusteredSuffix(db);
+
+	bool success = rebuildTable(db, "periodic", QString(periodicColumns) + periodicValueColumns, "downloadid, recordid", suffix);
+	success = success && rebuildTable(db, "profile", profileColumns, "downloadid, battery, recordid", suffix);
+	success = success && rebuildTable(db, "efficiency", efficiencyColumns, "downloadid, battery, recordid", suffix);
+
+	// Used by LoggedStorage to list downloads and read download times. downloadid is the rowid, so it is covered too
+	success = success && query.exec("CREATE INDEX IF NOT EXISTS downloadinfo_site_time ON downloadinfo (siteid, realtime);");
 
 	return success;
 }
 
+// Moves the periodic records into one timeline per site. Each site's downloads are fed through
+// PeriodicLoggedValue::writeToDB() in the order they were made, which keeps only the records that
+// weren't already stored, and the old table is dropped
+bool LoggedData::migrateToV3(QSqlDatabase db) {
+	QSqlQuery query(db);
+	bool success = query.exec(QString("CREATE TABLE periodic_timeline (%1%2, PRIMARY KEY (siteid, abstime))%3;")
+		.arg(timelineColumns).arg(periodicValueColumns).arg(clusteredSuffix(db)));
+
+	// Used to load and delete the records of a download
+	success = success && query.exec("CREATE INDEX periodic_timeline_download ON periodic_timeline (downloadid);");
+
+	QList<int> ids;
+	success = success && query.exec(QString("SELECT downloadid FROM downloadinfo WHERE datatypes & %1 "
+		"ORDER BY siteid, realtime;").arg(LOGGEDBITS_PERIODIC));
+	while(success && query.next()) {
+		ids.append(query.value(0).toInt());
+	}
+	query.finish();
+
+	for(int i = 0; success && i < ids.size(); i++) {
+		LoggedData data(db, ids[i]);
+		PeriodicLoggedValue value(db, ids[i], true);
+		if(!data.isInitialized() || !value.isValid())
+			return false;
+
+		value.setContext(&data);
+		success = value.writeToDB(db, ids[i]);
+	}
+
+	success = success && query.exec("DROP TABLE periodic;");
+	return success;
+}
+
+// Downloads stored with setRawStorage() keep their periodic and profile data here instead of in
+// periodic_timeline and profile. Each column holds the pointer bytes followed by the pages, as read
+// by libpmcomm, compressed with qCompress(). They are decoded again whenever they are read
+bool LoggedData::migrateToV4(QSqlDatabase db) {
+	QSqlQuery query(db);
+	return query.exec("CREATE TABLE rawdownload ("
+		"downloadid INTEGER PRIMARY KEY,"
+		"periodic BLOB,"
+		"profile BLOB);");
+}
+
+// Adds the rollup tables, filled from the records already in the timeline
+bool LoggedData::migrateToV5(QSqlDatabase db) {
+	return PeriodicRollup::createTables(db, clusteredSuffix(db)) && PeriodicRollup::rebuild(db);
+}
+
+// Records how far back each download's periodic log went, so that deleting a download can hand the
+// records that later downloads also had over to them. Downloads stored before this only show the
+// records they added. Where those followed on from records already stored, how far back the log
+// went is unknown, so it is taken to cover the whole site; deleting an earlier download then keeps
+// more than it has to, rather than losing records
+bool LoggedData::migrateToV6(QSqlDatabase db) {
+	QSqlQuery query(db);
+	bool success = query.exec("ALTER TABLE downloadinfo ADD COLUMN periodicstart INTEGER;");
+
+	success = success && query.exec("UPDATE downloadinfo SET periodicstart = "
+		"(SELECT CASE WHEN t.gap = 1 OR NOT EXISTS (SELECT 1 FROM periodic_timeline p WHERE p.siteid = t.siteid AND p.abstime < t.abstime) "
+		"THEN t.abstime ELSE (SELECT MIN(abstime) FROM periodic_timeline p WHERE p.siteid = t.siteid) END "
+		"FROM periodic_timeline t WHERE t.downloadid = downloadinfo.downloadid ORDER BY t.abstime LIMIT 1);");
+
+	// Downloads whose records had all been stored already
+	success = success && query.exec(QString("UPDATE downloadinfo SET periodicstart = "
+		"(SELECT MIN(abstime) FROM periodic_timeline p WHERE p.siteid = downloadinfo.siteid) "
+		"WHERE periodicstart IS NULL AND datatypes & %1 "
+		"AND downloadid NOT IN (SELECT downloadid FROM rawdownload WHERE periodic IS NOT NULL);").arg(LOGGEDBITS_PERIODIC));
+
+	return success;
+}
+
+bool LoggedData::rebuildTable(QSqlDatabase db, QString table, QString columns, QString primaryKey, QString suffix) {
+	QSqlQuery query(db);
+	bool success = query.exec(QString("ALTER TABLE %1 RENAME TO %1_old;").arg(table));
+	success = success && query.exec(QString("CREATE TABLE %1 (%2, PRIMARY KEY (%3))%4;").arg(table).arg(columns).arg(primaryKey).arg(suffix));
+	success = success && query.exec(QString("INSERT OR IGNORE INTO %1 SELECT * FROM %1_old;").arg(table));
+	success = success && query.exec(QString("DROP TABLE %1_old;").arg(table));
+	return success;
+}
+
+// Sets up a newly opened connection. Write-ahead logging lets the GUI read while a download is
+// being stored, and with it, NORMAL is enough to keep the database consistent after a crash.
+// More than one connection writes, so each waits for the others instead of failing
+bool LoggedData::configureConnection(QSqlDatabase db) {
+	QSqlQuery query(db);
+	bool success = query.exec("PRAGMA journal_mode=WAL;");
+	success = success && query.exec("PRAGMA synchronous=NORMAL;");
+	success = success && query.exec("PRAGMA busy_timeout=5000;");
+	return success;
+}
+
 LoggedData::LoggedData(int siteId) {
 	this->siteId = siteId;
 	unitTime = -1;
@@ -77,6 +267,7 @@ LoggedData::LoggedData(int siteId) {
 	shuntsValid = false;
 	batteryMask = ~0;
 	types = 0;
+	rawStorage = false;
 }
 
 void LoggedData::setBatteryEnabled(int battery, bool enabled) {
@@ -92,6 +283,12 @@ void LoggedData::setBatteryEnabled(int battery, bool enabled) {
 		batteryMask &= ~bits;
 }
 
+// If set, writeToDB() archives the raw memory that periodic and profile data were read as,
+// rather than the decoded records. This is much smaller, and quicker to store
+void LoggedData::setRawStorage(bool raw) {
+	rawStorage = raw;
+}
+
 int LoggedData::enabledMask() {
 	return types & batteryMask;
 }
@@ -167,6 +364,7 @@ LoggedData::LoggedData(QSqlDatabase db, int downloadid) {
 	labelsValid = false;
 	shuntsValid = false;
 	batteryMask = ~0;
+	rawStorage = false;
 	initialized = false;
 
 	QSqlQuery query(db);
@@ -199,21 +397,43 @@ bool LoggedData::readDataFromDB(QSqlDatabase db) {
 	if(downloadId < 1)
 		return false;
 
+	// Data archived as raw memory is decoded here
 	int tmask = enabledMask();
+	QByteArray periodicRaw, profileRaw;
+	if(tmask & LOGGEDBITS_PERIODIC)
+		periodicRaw = LoggedValue::readRawData(db, downloadId, LoggedValue::TYPE_PERIODIC);
+	if(tmask & (LOGGEDBITS_PROFILE1 | LOGGEDBITS_PROFILE2))
+		profileRaw = LoggedValue::readRawData(db, downloadId, LoggedValue::TYPE_PROFILE);
+
 	if(tmask & LOGGEDBITS_PERIODIC) {
-		periodic = QSharedPointer<PeriodicLoggedValue>(new PeriodicLoggedValue(db, downloadId));
+		if(!periodicRaw.isEmpty())
+			periodic = QSharedPointer<PeriodicLoggedValue>(new PeriodicLoggedValue(periodicRaw));
+		else
+			periodic = QSharedPointer<PeriodicLoggedValue>(new PeriodicLoggedValue(db, downloadId));
 		if(!periodic->isValid())
 			return false;
 		periodic->setContext(this);
 	}
+	// Both batteries come from the same memory, so it is only decoded once
+	ProfileLoggedValue *decoded1 = NULL, *decoded2 = NULL;
+	if(!profileRaw.isEmpty() && !ProfileLoggedValue::decodeRaw(profileRaw, decoded1, decoded2))
+		return false;
+	QSharedPointer<ProfileLoggedValue> raw1(decoded1), raw2(decoded2);
+
 	if(tmask & LOGGEDBITS_PROFILE1) {
-		profile1 = QSharedPointer<ProfileLoggedValue>(new ProfileLoggedValue(db, downloadId, 1));
+		if(raw1)
+			profile1 = raw1;
+		else
+			profile1 = QSharedPointer<ProfileLoggedValue>(new ProfileLoggedValue(db, downloadId, 1));
 		if(!profile1->isValid())
 			return false;
 		profile1->setContext(this);
 	}
 	if(tmask & LOGGEDBITS_PROFILE2) {
-		profile2 = QSharedPointer<ProfileLoggedValue>(new ProfileLoggedValue(db, downloadId, 2));
+		if(raw2)
+			profile2 = raw2;
+		else
+			profile2 = QSharedPointer<ProfileLoggedValue>(new ProfileLoggedValue(db, downloadId, 2));
 		if(!profile2->isValid())
 			return false;
 		profile2->setContext(this);
@@ -272,11 +492,25 @@ int LoggedData::writeToDB(QSqlDatabase db) {
 		success = false;
 
 	int tmask = enabledMask();
-	if(tmask & LOGGEDBITS_PERIODIC)
+	bool periodicRaw = rawStorage && (tmask & LOGGEDBITS_PERIODIC) && !periodic->getRawData().isEmpty();
+	QSharedPointer<ProfileLoggedValue> profile = (tmask & LOGGEDBITS_PROFILE1) ? profile1 : profile2;
+	bool profileRaw = rawStorage && (tmask & (LOGGEDBITS_PROFILE1 | LOGGEDBITS_PROFILE2)) && !profile->getRawData().isEmpty();
+	if(periodicRaw || profileRaw)
+		success = success && writeRawToDB(db, periodicRaw, profileRaw);
+
+	if((tmask & LOGGEDBITS_PERIODIC) && !periodicRaw) {
 		success = success && periodic->writeToDB(db, downloadId);
-	if(tmask & LOGGEDBITS_PROFILE1)
+		success = success && updateRollups(db, downloadId);
+
+		int64_t start = periodic->startTime();
+		query.prepare("UPDATE downloadinfo SET periodicstart = :start WHERE downloadid = :downloadid;");
+		query.bindValue(":start", start >= 0 ? QVariant((qint64) start) : QVariant(QVariant::LongLong));
+		query.bindValue(":downloadid", downloadId);
+		success = success && query.exec();
+	}
+	if((tmask & LOGGEDBITS_PROFILE1) && !profileRaw)
 		success = success && profile1->writeToDB(db, downloadId);
-	if(tmask & LOGGEDBITS_PROFILE2)
+	if((tmask & LOGGEDBITS_PROFILE2) && !profileRaw)
 		success = success && profile2->writeToDB(db, downloadId);
 	if(tmask & LOGGEDBITS_EFFICIENCY1)
 		success = success && efficiency1->writeToDB(db, downloadId);
@@ -292,6 +526,44 @@ int LoggedData::writeToDB(QSqlDatabase db) {
 	return -1;
 }
 
+// Archives the raw memory of the periodic and/or profile data under the current downloadId
+bool LoggedData::writeRawToDB(QSqlDatabase db, bool periodicRaw, bool profileRaw) {
+	QSqlQuery query(db);
+	query.prepare("INSERT INTO rawdownload (downloadid, periodic, profile) VALUES (:downloadid, :periodic, :profile);");
+	query.bindValue(":downloadid", downloadId);
+
+	QSharedPointer<ProfileLoggedValue> profile = (enabledMask() & LOGGEDBITS_PROFILE1) ? profile1 : profile2;
+	query.bindValue(":periodic", periodicRaw ? QVariant(qCompress(periodic->getRawData())) : QVariant(QVariant::ByteArray));
+	query.bindValue(":profile", profileRaw ? QVariant(qCompress(profile->getRawData())) : QVariant(QVariant::ByteArray));
+	return query.exec();
+}
+
+// Brings the rollups up to date with the timeline records of a download
+bool LoggedData::updateRollups(QSqlDatabase db, int id) {
+	QSqlQuery query(db);
+	query.prepare("SELECT siteid, MIN(abstime), MAX(abstime) FROM periodic_timeline WHERE downloadid = :downloadid;");
+	query.bindValue(":downloadid", id);
+	if(!query.exec() || !query.next())
+		return false;
+	if(query.value(1).isNull())
+		return true; // Every record was already stored by an earlier download
+
+	return PeriodicRollup::update(db, query.value(0).toInt(), query.value(1).toLongLong(), query.value(2).toLongLong());
+}
+
+// Recomputes all of the rollups from the timeline
+bool LoggedData::rebuildRollups(QSqlDatabase db) {
+	QSqlQuery query(db);
+	if(!query.exec("BEGIN IMMEDIATE;"))
+		return false;
+
+	bool success = PeriodicRollup::rebuild(db) && query.exec("COMMIT;");
+	if(!success)
+		query.exec("ROLLBACK;");
+
+	return success;
+}
+
 bool LoggedData::writeToFiles(QString baseName) {
 	bool success = true;
 	int tmask = enabledMask();
@@ -321,53 +593,140 @@ bool LoggedData::writeToFiles(QString baseName) {
 	return success;
 }
 
-bool LoggedData::writeRecordsToFiles(QList<QSharedPointer<LoggedData> > & data, QString baseName) {
-	QList<PeriodicLoggedValue *> periodicList;
-	QList<ProfileLoggedValue *> profile1List, profile2List;
-	QList<EfficiencyLoggedValue *> efficiency1List, efficiency2List;
+static bool downloadedBefore(LoggedData *one, LoggedData *two) {
+	return one->getDownloadTime() < two->getDownloadTime();
+}
 
-	for(int i = 0; i < data.size(); i++) {
-		int tmask = data[i]->enabledMask();
-		if(tmask & LOGGEDBITS_PERIODIC) {
-			periodicList.append(data[i]->periodic.data());
-		}
-		if(tmask & LOGGEDBITS_PROFILE1) {
-			profile1List.append(data[i]->profile1.data());
-		}
-		if(tmask & LOGGEDBITS_PROFILE2) {
-			profile2List.append(data[i]->profile2.data());
-		}
-		if(tmask & LOGGEDBITS_EFFICIENCY1) {
-			efficiency1List.append(data[i]->efficiency1.data());
+// Exports one type of data to one file on one of the pool's threads. Each runner reads the
+// database through its own connection, since a connection can only be used by the thread
+// that opened it
+class ExportRunner : public QRunnable {
+public:
+	ExportRunner(QString path, QList<LoggedData *> downloads, LoggedValue::LoggedDataType type, int battery, LoggedFileWriter *out, bool *result, QAtomicInt *finished) :
+		path(path), downloads(downloads), type(type), battery(battery), out(out), result(result), finished(finished) {}
+
+	~ExportRunner() {
+		delete out;
+	}
+
+	void run() {
+		QString connectionName = QString("loggeddata-export-%1").arg((quintptr) this);
+		{
+			QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+			db.setDatabaseName(path);
+			*result = db.open() && LoggedData::configureConnection(db) && out->open() && exportTo(db);
+			*result = out->close() && *result;
+			db.close();
 		}
-		if(tmask & LOGGEDBITS_EFFICIENCY2) {
-			efficiency1List.append(data[i]->efficiency1.data());
+		QSqlDatabase::removeDatabase(connectionName);
+		finished->fetchAndAddOrdered(1);
+	}
+
+private:
+	bool exportTo(QSqlDatabase db) {
+		switch(type) {
+			case LoggedValue::TYPE_PERIODIC: return PeriodicLoggedValue::exportToFile(db, downloads, *out);
+			case LoggedValue::TYPE_PROFILE: return ProfileLoggedValue::exportToFile(db, downloads, battery, *out);
+			case LoggedValue::TYPE_EFFICIENCY: return EfficiencyLoggedValue::exportToFile(db, downloads, battery, *out);
 		}
+		return false;
 	}
 
+	QString path;
+	QList<LoggedData *> downloads;
+	LoggedValue::LoggedDataType type;
+	int battery;
+	LoggedFileWriter *out;
+	bool *result;
+	QAtomicInt *finished; // Counts the runners that are done, for the progress
+};
+
+// Creates a writer for a file in the chosen format. name is the file name without an extension
+static LoggedFileWriter *createWriter(LoggedData::ExportFormat format, const LoggedFileWriter::Settings & settings, QString name) {
+	if(format == LoggedData::EXPORT_COLUMNS)
+		return new ColumnWriter(name + ".pmcol", settings);
+	return new CsvWriter(name + ".csv", settings);
+}
+
+// Exports the records of a set of downloads straight out of the database, without loading them
+// all first. Each type of data is written to its own file, in the order the downloads were made.
+// The files don't depend on each other, so they are all written at once. If progress isn't NULL,
+// it is told how many of the files are done every PROGRESS_INTERVAL ms while they are written
+bool LoggedData::exportFromDB(QSqlDatabase db, QList<int> ids, QString baseName, ExportFormat format, const LoggedFileWriter::Settings & settings, Progress *progress) {
+	QList<LoggedData *> downloads;
 	bool success = true;
-	if(!periodicList.empty()) {
-		QString filename = QString("%1_PeriodicData-export.csv").arg(baseName);
-		success = success && PeriodicLoggedValue::writeGroupToFile(periodicList, filename);
-	}
-	if(!profile1List.empty()) {
-		QString filename = QString("%1_Bat1DischProfile-export.csv").arg(baseName);
-		success = success && ProfileLoggedValue::writeGroupToFile(profile1List, filename);
+	foreach(int id, ids) {
+		LoggedData *curr = new LoggedData(db, id);
+		if(!curr->isInitialized()) {
+			delete curr;
+			success = false;
+			break;
+		}
+		downloads.append(curr);
 	}
-	if(!profile2List.empty()) {
-		QString filename = QString("%1_Bat2DischProfile-export.csv").arg(baseName);
-		success = success && ProfileLoggedValue::writeGroupToFile(profile2List, filename);
+	qStableSort(downloads.begin(), downloads.end(), downloadedBefore);
+
+	QList<LoggedData *> periodicList, profile1List, profile2List, efficiency1List, efficiency2List;
+	foreach(LoggedData *curr, downloads) {
+		int tmask = curr->enabledMask();
+		if(tmask & LOGGEDBITS_PERIODIC)
+			periodicList.append(curr);
+		if(tmask & LOGGEDBITS_PROFILE1)
+			profile1List.append(curr);
+		if(tmask & LOGGEDBITS_PROFILE2)
+			profile2List.append(curr);
+		if(tmask & LOGGEDBITS_EFFICIENCY1)
+			efficiency1List.append(curr);
+		if(tmask & LOGGEDBITS_EFFICIENCY2)
+			efficiency2List.append(curr);
 	}
-	if(!efficiency1List.empty()) {
-		QString filename = QString("%1_Bat1CycleEfficy-export.csv").arg(baseName);
-		success = success && EfficiencyLoggedValue::writeGroupToFile(efficiency1List, filename);
+
+	bool results[5] = { true, true, true, true, true };
+	if(success) {
+		QString path = db.databaseName();
+		QThreadPool pool;
+		pool.setMaxThreadCount(5);
+		QAtomicInt finished(0);
+		int files = 0;
+		if(!periodicList.empty()) {
+			LoggedFileWriter *out = createWriter(format, settings, QString("%1_PeriodicData-export").arg(baseName));
+			pool.start(new ExportRunner(path, periodicList, LoggedValue::TYPE_PERIODIC, 0, out, &results[0], &finished));
+			files++;
+		}
+		if(!profile1List.empty()) {
+			LoggedFileWriter *out = createWriter(format, settings, QString("%1_Bat1DischProfile-export").arg(baseName));
+			pool.start(new ExportRunner(path, profile1List, LoggedValue::TYPE_PROFILE, 1, out, &results[1], &finished));
+			files++;
+		}
+		if(!profile2List.empty()) {
+			LoggedFileWriter *out = createWriter(format, settings, QString("%1_Bat2DischProfile-export").arg(baseName));
+			pool.start(new ExportRunner(path, profile2List, LoggedValue::TYPE_PROFILE, 2, out, &results[2], &finished));
+			files++;
+		}
+		if(!efficiency1List.empty()) {
+			LoggedFileWriter *out = createWriter(format, settings, QString("%1_Bat1CycleEfficy-export").arg(baseName));
+			pool.start(new ExportRunner(path, efficiency1List, LoggedValue::TYPE_EFFICIENCY, 1, out, &results[3], &finished));
+			files++;
+		}
+		if(!efficiency2List.empty()) {
+			LoggedFileWriter *out = createWriter(format, settings, QString("%1_Bat2CycleEfficy-export").arg(baseName));
+			pool.start(new ExportRunner(path, efficiency2List, LoggedValue::TYPE_EFFICIENCY, 2, out, &results[4], &finished));
+			files++;
+		}
+		while(!pool.waitForDone(PROGRESS_INTERVAL)) {
+			if(progress != NULL)
+				progress->reportProgress(finished.fetchAndAddOrdered(0), files);
+		}
+		if(progress != NULL)
+			progress->reportProgress(files, files);
 	}
-	if(!efficiency2List.empty()) {
-		QString filename = QString("%1_Bat2CycleEfficy-export.csv").arg(baseName);
-		success = success && EfficiencyLoggedValue::writeGroupToFile(efficiency2List, filename);
+
+	for(int i = 0; i < 5; i++) {
+		success = success && results[i];
 	}
 
-	return success;	
+	qDeleteAll(downloads);
+	return success;
 }
 
 bool LoggedData::deleteFromDB(QSqlDatabase db, int id) {
@@ -375,10 +734,58 @@ bool LoggedData::deleteFromDB(QSqlDatabase db, int id) {
 	if(!query.exec("BEGIN IMMEDIATE;"))
 		return false;
 
-	query.prepare("DELETE FROM downloadinfo WHERE downloadid = :downloadid;");
+	query.prepare("SELECT siteid, realtime FROM downloadinfo WHERE downloadid = :downloadid;");
 	query.bindValue(":downloadid", id);
 	bool success = query.exec();
-	query.prepare("DELETE FROM periodic WHERE downloadid = :downloadid;");
+	if(success && query.next()) {
+		int site = query.value(0).toInt();
+		qint64 realTime = query.value(1).toLongLong();
+		query.finish();
+
+		// Each record is stored under the first download that had it, so the records that a later
+		// download's log also went back to are handed over to the first such download instead
+		query.prepare("UPDATE periodic_timeline SET downloadid = COALESCE((SELECT d.downloadid FROM downloadinfo d "
+			"WHERE d.siteid = :siteid AND d.realtime > :realtime AND d.periodicstart <= periodic_timeline.abstime "
+			"ORDER BY d.realtime LIMIT 1), downloadid) WHERE downloadid = :downloadid;");
+		query.bindValue(":siteid", site);
+		query.bindValue(":realtime", realTime);
+		query.bindValue(":downloadid", id);
+		success = query.exec();
+	}
+	query.finish();
+
+	query.prepare("DELETE FROM downloadinfo WHERE downloadid = :downloadid;");
+	query.bindValue(":downloadid", id);
+	success = success && query.exec();
+
+	// The record after the deleted ones no longer follows on from the one before it, and the
+	// rollups over the deleted records' range have to be recomputed once they are gone
+	query.prepare("SELECT siteid, MIN(abstime), MAX(abstime) FROM periodic_timeline WHERE downloadid = :downloadid;");
+	query.bindValue(":downloadid", id);
+	success = success && query.exec() && query.next();
+	int site = -1;
+	qint64 firstTime = 0, lastTime = 0;
+	if(success && !query.value(1).isNull()) {
+		site = query.value(0).toInt();
+		firstTime = query.value(1).toLongLong();
+		lastTime = query.value(2).toLongLong();
+		query.finish();
+
+		query.prepare("UPDATE periodic_timeline SET gap = 1 WHERE siteid = :siteid AND abstime = "
+			"(SELECT MIN(abstime) FROM periodic_timeline WHERE siteid = :siteid2 AND abstime > :abstime);");
+		query.bindValue(":siteid", site);
+		query.bindValue(":siteid2", site);
+		query.bindValue(":abstime", lastTime);
+		success = query.exec();
+	}
+	query.finish();
+
+	query.prepare("DELETE FROM periodic_timeline WHERE downloadid = :downloadid;");
+	query.bindValue(":downloadid", id);
+	success = success && query.exec();
+	if(site >= 0)
+		success = success && PeriodicRollup::update(db, site, firstTime, lastTime);
+	query.prepare("DELETE FROM rawdownload WHERE downloadid = :downloadid;");
 	query.bindValue(":downloadid", id);
 	success = success && query.exec();
 	query.prepare("DELETE FROM profile WHERE downloadid = :downloadid;");
@@ -395,3 +802,33 @@ bool LoggedData::deleteFromDB(QSqlDatabase db, int id) {
 	return success;
 }
 
+// Deletes all of a site's data in one transaction. Nothing of the site is left for the gaps or
+// the rollups to be kept up to date with, so they are just deleted along with the rest
+bool LoggedData::deleteSiteFromDB(QSqlDatabase db, int site) {
+	QSqlQuery query(db);
+	if(!query.exec("BEGIN IMMEDIATE;"))
+		return false;
+
+	QStringList statements;
+	statements << "DELETE FROM rawdownload WHERE downloadid IN (SELECT downloadid FROM downloadinfo WHERE siteid = :siteid);"
+		<< "DELETE FROM profile WHERE downloadid IN (SELECT downloadid FROM downloadinfo WHERE siteid = :siteid);"
+		<< "DELETE FROM efficiency WHERE downloadid IN (SELECT downloadid FROM downloadinfo WHERE siteid = :siteid);"
+		<< "DELETE FROM periodic_timeline WHERE siteid = :siteid;"
+		<< QString("DELETE FROM %1 WHERE siteid = :siteid;").arg(PeriodicRollup::tableName(PeriodicRollup::HOUR_SECONDS))
+		<< QString("DELETE FROM %1 WHERE siteid = :siteid;").arg(PeriodicRollup::tableName(PeriodicRollup::DAY_SECONDS))
+		<< "DELETE FROM downloadinfo WHERE siteid = :siteid;";
+
+	bool success = true;
+	for(int i = 0; success && i < statements.size(); i++) {
+		query.prepare(statements[i]);
+		query.bindValue(":siteid", site);
+		success = query.exec();
+	}
+
+	success = success && query.exec("COMMIT;");
+	if(!success)
+		query.exec("ROLLBACK;");
+
+	return success;
+}
+
@@ -2,15 +2,29 @@
 #define LOGGEDDATA_H
 
 #include "loggedvalue.h"
+#include "loggedfilewriter.h"
 
 #include <QSharedPointer>
 #include <QSqlDatabase>
 
 class LoggedData {
 public:
+	enum ExportFormat {
+		EXPORT_CSV, // Text files for spreadsheets
+		EXPORT_COLUMNS // Column files for analysis tools, see ColumnWriter
+	};
+
+	// Told how far a long operation has got, on the thread that is running it
+	class Progress {
+	public:
+		virtual ~Progress() {}
+		virtual void reportProgress(int done, int total) = 0;
+	};
+
 	LoggedData(int siteId);
 
 	static bool setupDB(QSqlDatabase db);
+	static bool configureConnection(QSqlDatabase db);
 
 	bool isInitialized() { return initialized; }
 
@@ -19,6 +33,7 @@ public:
 	void setLabels(struct PMLabels & labels);
 	void setShuntTypes(bool *smallShunt);
 	void setBatteryEnabled(int battery, bool enabled);
+	void setRawStorage(bool raw);
 
 	int64_t getDownloadTime();
 
@@ -31,14 +46,19 @@ public:
 
 	bool writeToFiles(QString baseName);
 
-	static bool writeRecordsToFiles(QList<QSharedPointer<LoggedData> > & data, QString baseName);
+	static bool exportFromDB(QSqlDatabase db, QList<int> ids, QString baseName, ExportFormat format,
+		const LoggedFileWriter::Settings & settings, Progress *progress = NULL);
 	static bool deleteFromDB(QSqlDatabase db, int id);
+	static bool deleteSiteFromDB(QSqlDatabase db, int site);
+	static bool rebuildRollups(QSqlDatabase db);
 
 	friend class PeriodicLoggedValue;
 	friend class ProfileLoggedValue;
 	friend class EfficiencyLoggedValue;
 
 private:
+	enum { PROGRESS_INTERVAL = 200 };
+
 	enum LoggedTypeField {
 		LOGGEDBITS_PERIODIC = 1,
 		LOGGEDBITS_PROFILE1 = 2,
@@ -47,7 +67,17 @@ private:
 		LOGGEDBITS_EFFICIENCY2 = 16
 	};
 
+	static bool createTablesV1(QSqlDatabase db);
+	static bool migrateToV2(QSqlDatabase db);
+	static bool migrateToV3(QSqlDatabase db);
+	static bool migrateToV4(QSqlDatabase db);
+	static bool migrateToV5(QSqlDatabase db);
+	static bool migrateToV6(QSqlDatabase db);
+	static bool rebuildTable(QSqlDatabase db, QString table, QString columns, QString primaryKey, QString suffix);
+
 	int createDownloadRecordDB(QSqlDatabase db);
+	bool writeRawToDB(QSqlDatabase db, bool periodicRaw, bool profileRaw);
+	static bool updateRollups(QSqlDatabase db, int id);
 	int enabledMask();
 
 	QSharedPointer<PeriodicLoggedValue> periodic;
@@ -67,6 +97,7 @@ private:
 	bool labelsValid;
 	unsigned int shuntTypes;
 	bool shuntsValid;
+	bool rawStorage; // If true, periodic and profile data are stored as the unit's raw memory
 
 	bool initialized;
 };
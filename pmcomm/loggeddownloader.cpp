@@ -1,12 +1,17 @@
 #include "loggeddownloader.h"
 
 #include "siteslist.h"
+#include "appsettings.h"
+#include "ioscheduler.h"
 
 #include <QString>
 #include <QDir>
-#include <QSqlQuery>
 #include <QDateTime>
 #include <QTimer>
+#include <QThread>
+
+#include <algorithm>
+#include <functional>
 
 #include <QDebug>
 
@@ -17,11 +22,15 @@
 #include <QDesktopServices>
 #endif
 
-static const int retryDelaySecs = 3600; // After this time, try to reconnect
+static const int minRetryDelaySecs = 60; // Delay after the first failure; doubled after each one after that
+static const int maxRetryDelaySecs = 3600;
+static const int maxStaggerSecs = 600; // Overdue sites are spread over at most this long
+static const int maxTimerSecs = 3600; // Wake up at least this often, in case the clock changes
 
 LoggedDownloader::LoggedDownloader(SitesList *sitesList, QObject *parent) : QObject(parent) {
 	initialized = false;
-	currManager = NULL;
+	storageThread = NULL;
+	storage = NULL;
 	downloadTimer = new QTimer(this);
 	downloadTimer->setSingleShot(true);
 	connect(downloadTimer, SIGNAL(timeout()), this, SLOT(checkTime()));
@@ -31,24 +40,24 @@ LoggedDownloader::LoggedDownloader(SitesList *sitesList, QObject *parent) : QObj
 	connect(sitesList, SIGNAL(managersAdded(const QList<SiteManager *> &)), this, SLOT(managersAdded(const QList<SiteManager *> &)));
 	connect(sitesList, SIGNAL(managersRemoved(const QList<SiteManager *> &)), this, SLOT(managersRemoved(const QList<SiteManager *> &)));
 
-#if QT_VERSION >= 0x050000
-	QString storagePath = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
-#else
-	QString storagePath = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
-#endif
-
-	if(!QDir("/").mkpath(storagePath))
-		return;
-
-	storagePath.append("/loggeddata.db");
-
-	db = QSqlDatabase::addDatabase("QSQLITE", "loggeddata");
-	db.setHostName("localhost");
-	db.setDatabaseName(storagePath);
-	if(!db.open())
+	QString storagePath = databasePath();
+	if(storagePath.isEmpty())
 		return;
 
-	if(!LoggedData::setupDB(db))
+	LoggedStorage::registerTypes();
+	storageThread = new QThread(this);
+	storage = new LoggedStorage(storagePath);
+	storage->moveToThread(storageThread);
+	connect(storage, SIGNAL(stored(int, int, qint64)), this, SLOT(downloadStored(int, int, qint64)));
+	connect(storage, SIGNAL(storeFailed(int)), this, SLOT(downloadStoreFailed(int)));
+	connect(storage, SIGNAL(downloadTimesRead(const DownloadList &, bool)), this, SLOT(downloadTimesRead(const DownloadList &, bool)));
+	storageThread->start();
+
+	// The tables have to be ready before anything else is sent, and this is before the event
+	// loop is running, so waiting here doesn't hold anything up
+	bool opened = false;
+	QMetaObject::invokeMethod(storage, "open", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, opened));
+	if(!opened)
 		return;
 
 	initialized = true;
@@ -57,70 +66,143 @@ LoggedDownloader::LoggedDownloader(SitesList *sitesList, QObject *parent) : QObj
 	managersAdded(sitesList->getManagers().values());
 }
 
+// Gets the path of the logged data database, creating its directory if needed. Returns an
+// empty string if the directory can't be created
+QString LoggedDownloader::databasePath() {
+#if QT_VERSION >= 0x050000
+	QString storagePath = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+#else
+	QString storagePath = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
+#endif
+
+	if(!QDir("/").mkpath(storagePath))
+		return QString();
+
+	return storagePath + "/loggeddata.db";
+}
+
 bool LoggedDownloader::downloadNow(SiteManager *manager) {
-	if(currManager != NULL)
+	if(activeDownloads.contains(manager) || activeDownloads.size() >= maxConcurrent())
 		return false;
 	bool forceReconnect = stats[manager->getSettings()->getId()].forceReconnect;
 	if(!forceReconnect && (manager->getStatus() == SiteManager::SiteError)) // Don't retry if there are errors
 		return false;
 
 	qDebug() << "Downloading from site " << manager->getSettings()->getName();
-	currManager = manager;
+	activeDownloads.insert(manager);
 
-	connect(currManager, SIGNAL(loggedDataDownloaded()), this, SLOT(downloadFinished()));
-	connect(currManager, SIGNAL(errorCanceled()), this, SLOT(errorCanceled()));
+	connect(manager, SIGNAL(loggedDataDownloaded()), this, SLOT(downloadFinished()));
+	connect(manager, SIGNAL(errorCanceled()), this, SLOT(errorCanceled()));
 
-	return currManager->downloadLogged(true, true, true);
+	if(!manager->downloadLogged(true, true, true)) {
+		finishDownload(manager);
+		return false;
+	}
+	return true;
 }
 
 void LoggedDownloader::downloadFinished() {
-	if(currManager == NULL) {
+	SiteManager *manager = (SiteManager *) sender();
+	if(!activeDownloads.contains(manager)) {
 		checkTime();
 		return;
 	}
+	finishDownload(manager);
 
-	disconnect(currManager, SIGNAL(loggedDataDownloaded()), this, SLOT(downloadFinished()));
-	disconnect(currManager, SIGNAL(errorCanceled()), this, SLOT(errorCanceled()));
-
-	QSharedPointer<LoggedData> data = currManager->retrieveLogged();
+	int site = manager->getSettings()->getId();
+	QSharedPointer<LoggedData> data = manager->retrieveLogged();
 	if(data != NULL) {
-		int recordId = data->writeToDB(db);
-		if(recordId > 0) {
-			int site = currManager->getSettings()->getId();
-			stats[site].lastDownloadTime = data->getDownloadTime();
-			stats[site].retryTime = 0;
-			stats[site].forceReconnect = false;
-		} else {
-			emit downloadDBError();
-		}
+		data->setRawStorage(AppSettings::getInstance()->getRawLoggedStorage());
+
+		// The site is rescheduled once the storage thread reports back
+		storingSites.insert(site);
+		QMetaObject::invokeMethod(storage, "store", Qt::QueuedConnection, Q_ARG(QSharedPointer<LoggedData>, data), Q_ARG(int, site));
+	} else {
+		backOff(site);
 	}
 
-	currManager = NULL;
 	checkTime();
 }
 
+void LoggedDownloader::downloadStored(int site, int downloadId, qint64 downloadTime) {
+	Q_UNUSED(downloadId);
+	storingSites.remove(site);
+	if(!stats.contains(site))
+		return;
+
+	stats[site].lastDownloadTime = downloadTime;
+	stats[site].retryTime = 0;
+	stats[site].forceReconnect = false;
+	stats[site].failures = 0;
+	schedule(site);
+	checkTime();
+}
+
+void LoggedDownloader::downloadStoreFailed(int site) {
+	storingSites.remove(site);
+	if(stats.contains(site)) {
+		backOff(site); // Otherwise it would be due again immediately
+		checkTime();
+	}
+	emit downloadDBError();
+}
+
 void LoggedDownloader::errorCanceled() {
-	if(currManager == NULL) {
+	SiteManager *manager = (SiteManager *) sender();
+	if(!activeDownloads.contains(manager)) {
 		checkTime();
 		return;
 	}
+	finishDownload(manager);
 
-	disconnect(currManager, SIGNAL(loggedDataDownloaded()), this, SLOT(downloadFinished()));
-	disconnect(currManager, SIGNAL(errorCanceled()), this, SLOT(errorCanceled()));
+	int site = manager->getSettings()->getId();
+	backOff(site);
+	stats[site].forceReconnect = true;
 
-	int64_t currTime = QDateTime::currentDateTime().toTime_t();
+	checkTime();
+}
 
-	int site = currManager->getSettings()->getId();
-	stats[site].retryTime = currTime + retryDelaySecs; // Wait a long while before trying to reconnect
-	stats[site].forceReconnect = true;
+void LoggedDownloader::finishDownload(SiteManager *manager) {
+	disconnect(manager, SIGNAL(loggedDataDownloaded()), this, SLOT(downloadFinished()));
+	disconnect(manager, SIGNAL(errorCanceled()), this, SLOT(errorCanceled()));
+	activeDownloads.remove(manager);
+}
 
-	currManager = NULL;
-	checkTime();	
+// Number of sites that can be downloading at the same time. A download holds an IOScheduler
+// worker until it is done, so one worker is always left free for polling the displays. There are
+// always at least two workers (see AppSettings::getIOThreadCount()), so this is at least 1
+int LoggedDownloader::maxConcurrent() {
+	int limit = qMin(AppSettings::getInstance()->getMaxConcurrentDownloads(), IOScheduler::getInstance()->maxThreadCount() - 1);
+	return qMax(0, limit);
 }
 
+// Refreshes the download times, then reschedules every site once they have been read
 void LoggedDownloader::checkIfDownloadNeeded() {
-   	retrieveDownloadTimes(); // Refresh download time
-   	downloadTimer->start(0); // Don't run now to prevent constructor from trying to download data
+	QMetaObject::invokeMethod(storage, "readDownloadTimes", Qt::QueuedConnection, Q_ARG(QList<int>, stats.keys()));
+}
+
+// If the times couldn't be read, the sites keep the times they had and are scheduled as they
+// were, and the times are read again later. Sites added since the last read stay unscheduled
+// until then, rather than all being downloaded at once
+void LoggedDownloader::downloadTimesRead(const DownloadList & times, bool success) {
+	if(!success) {
+		qDebug() << "Could not read the download times; trying again in" << minRetryDelaySecs << "s";
+		QTimer::singleShot(minRetryDelaySecs * 1000, this, SLOT(checkIfDownloadNeeded()));
+		return;
+	}
+
+	QMap<int, qint64> latest;
+	for(int i = 0; i < times.size(); i++) {
+		latest.insert(times[i].first, times[i].second);
+	}
+
+	foreach(int site, stats.keys()) {
+		stats[site].lastDownloadTime = latest.value(site, 0);
+		qDebug() << "Last download time for site " << site << " : " << stats[site].lastDownloadTime;
+	}
+
+	scheduleAll();
+	downloadTimer->start(0);
 }
 
 void LoggedDownloader::siteStatusChanged(SiteManager::Status newStatus) {
@@ -129,59 +211,120 @@ void LoggedDownloader::siteStatusChanged(SiteManager::Status newStatus) {
 		return;
 	int siteId = site->getSettings()->getId();
 
-	// Error won't be cleared until it is actually working for sure
+	if(!stats.contains(siteId))
+		return;
+
+	// A site with errors is dropped from the queue when it comes due, so it is put back once it is
+	// working again. A site that is still queued keeps its place, and any backoff from failed
+	// downloads stays until one succeeds; the displays working says nothing about logged data
+	DownloadStats & s = stats[siteId];
 	if(newStatus != SiteManager::SiteError && newStatus != SiteManager::SiteDownloadingLogged) {
-		stats[siteId].retryTime = 0; // Make the site reconnect now
-		stats[siteId].forceReconnect = false; // Disable, since the connection seems to be working
+		s.forceReconnect = false; // Disable, since the connection seems to be working
+		if(!s.queued && !activeDownloads.contains(site))
+			schedule(siteId);
 	}
 	checkTime();
 }
 
+// Starts every download that is due, as far as the limit allows, and sets the timer for the next one.
+// Sites that are due but over the limit stay at the top of the queue until another download finishes.
 void LoggedDownloader::checkTime() {
-	if(currManager != NULL)
-		return;
-
-	int64_t currTime, nextTime;
-	int toDownloadNow;
-	while(true) {
-		currTime = QDateTime::currentDateTime().toTime_t();
-		nextTime = -1;
-
-		toDownloadNow = -1;
-
-		foreach(int site, stats.keys()) {
-			int interval = sitesList->getSites()[site]->getDownloadInterval() * 60;
-			int64_t downloadTime = stats[site].lastDownloadTime;
-
-			if(interval > 0) {
-				downloadTime += interval;
-				if(stats[site].retryTime > downloadTime) {
-					downloadTime = stats[site].retryTime;
-				}
-				if(downloadTime <= currTime)
-					toDownloadNow = site;
-				else if(nextTime == -1 || downloadTime <= nextTime)
-					nextTime = downloadTime;
-			}
-		}
+	int64_t currTime = QDateTime::currentDateTime().toTime_t();
 
-		if(toDownloadNow == -1)
+	while(!queue.isEmpty()) {
+		const ScheduledDownload & next = queue.first();
+		bool stale = !stats.contains(next.site) || stats[next.site].generation != next.generation;
+		if(!stale && (next.dueTime > currTime || activeDownloads.size() >= maxConcurrent()))
 			break;
 
-		SiteManager *manager = sitesList->getManagers()[toDownloadNow];
-		if(manager && downloadNow(manager)) {
-			return;
-		}
+		int site = next.site;
+		std::pop_heap(queue.begin(), queue.end(), std::greater<ScheduledDownload>());
+		queue.removeLast();
+		if(stale)
+			continue;
+		stats[site].queued = false;
+
+		// A site that is already downloading is rescheduled when it finishes, and a site
+		// with errors is rescheduled when its status changes
+		SiteManager *manager = sitesList->getManagers().value(site);
+		if(manager != NULL && !activeDownloads.contains(manager))
+			downloadNow(manager);
 	}
 
-	if(nextTime != -1)
-		downloadTimer->start((nextTime - currTime) * 1000);
+	if(!queue.isEmpty() && queue.first().dueTime > currTime)
+		downloadTimer->start(qMin(queue.first().dueTime - currTime, (int64_t) maxTimerSecs) * 1000);
 	else
-		downloadTimer->stop();
+		downloadTimer->stop(); // Either nothing is scheduled, or the next site is waiting for a free slot
+}
+
+// Puts the site in the queue at its next due time, replacing any earlier entry
+void LoggedDownloader::schedule(int site) {
+	DownloadStats & s = stats[site];
+	s.generation++;
+	s.queued = false;
+	if(storingSites.contains(site))
+		return;
+
+	int interval = sitesList->getSites()[site]->getDownloadInterval() * 60;
+	if(interval <= 0)
+		return;
+
+	int64_t currTime = QDateTime::currentDateTime().toTime_t();
+	int64_t dueTime = s.lastDownloadTime + interval;
+	if(s.retryTime > dueTime)
+		dueTime = s.retryTime; // Already jittered
+	else if(dueTime <= currTime)
+		dueTime = currTime + phaseOffset(site, interval);
+
+	ScheduledDownload entry;
+	entry.dueTime = dueTime;
+	entry.site = site;
+	entry.generation = s.generation;
+	queue.append(entry);
+	std::push_heap(queue.begin(), queue.end(), std::greater<ScheduledDownload>());
+	s.queued = true;
+}
+
+void LoggedDownloader::scheduleAll() {
+	queue.clear();
+	foreach(int site, stats.keys()) {
+		stats[site].queued = false;
+		SiteManager *manager = sitesList->getManagers().value(site);
+		if(manager == NULL || !activeDownloads.contains(manager))
+			schedule(site);
+	}
+}
+
+// Reschedules a site after a failure: 1, 2, 4, ... minutes up to an hour, +/- 25% so that
+// sites that failed together don't all retry together
+void LoggedDownloader::backOff(int site) {
+	DownloadStats & s = stats[site];
+	int64_t delay = maxRetryDelaySecs;
+	if(s.failures < 6)
+		delay = qMin((int64_t) minRetryDelaySecs << s.failures, delay);
+	s.failures++;
+
+	delay = delay * (75 + qrand() % 51) / 100;
+	s.retryTime = QDateTime::currentDateTime().toTime_t() + delay;
+	schedule(site);
+}
+
+// A fixed delay for each site, used to spread out sites that are overdue at the same time. It
+// depends only on the site id, so the order is the same every time the program starts.
+int64_t LoggedDownloader::phaseOffset(int site, int interval) {
+	quint32 hash = (quint32) site * 2654435761u; // Knuth's multiplicative hash
+	hash ^= hash >> 16;
+	return hash % (quint32) qMin(interval, maxStaggerSecs);
 }
 
 LoggedDownloader::~LoggedDownloader() {
-	db.close();
+	if(storageThread != NULL) {
+		// Finishes storing anything that is already queued
+		QMetaObject::invokeMethod(storage, "close", Qt::BlockingQueuedConnection);
+		storageThread->quit();
+		storageThread->wait();
+		delete storage;
+	}
 }
 
 void LoggedDownloader::managersAdded(const QList<SiteManager *> & managers) {
@@ -193,6 +336,9 @@ void LoggedDownloader::managersAdded(const QList<SiteManager *> & managers) {
 		s.retryTime = 0;
 		s.lastDownloadTime = 0;
 		s.forceReconnect = false;
+		s.failures = 0;
+		s.generation = 0;
+		s.queued = false;
 		stats[id] = s;
 
 		connect(manager, SIGNAL(statusChanged(SiteManager::Status)), this, SLOT(siteStatusChanged(SiteManager::Status)));
@@ -202,86 +348,19 @@ void LoggedDownloader::managersAdded(const QList<SiteManager *> & managers) {
 
 // Note that this permanently erases all data for these sites as well!
 void LoggedDownloader::managersRemoved(const QList<SiteManager *> & managers) {
+	QList<int> sites;
 	foreach(SiteManager *manager, managers) {
-		disconnect(currManager, 0, this, 0);
-		if(manager == currManager) {
+		if(activeDownloads.contains(manager)) {
 		 	// If we delete in the middle of the download, make sure things don't get screwed up
-			currManager = NULL;
+			finishDownload(manager);
 		}
+		disconnect(manager, 0, this, 0);
 		QSharedPointer<SiteSettings> site = manager->getSettings();
 		int id = site->getId();
 		stats.remove(id);
-		
-		// Delete data
-		bool success;
-		QList<QPair<int, int64_t> > toDelete = downloadsForSite(id, success);
-		if(success) { // Not much sane we can do about a failure here
-			QPair<int, int64_t> download;
-			foreach(download, toDelete) {
-				LoggedData::deleteFromDB(db, download.first);
-			}
-		}
-	}
-}
-
-QList<QPair<int, int64_t> > LoggedDownloader::downloadsForSite(int site, bool & success) {
-	QSqlQuery query(db);
-	query.prepare("SELECT downloadid, realtime FROM downloadinfo WHERE siteid = :siteid ORDER BY realtime ASC;");
-	query.bindValue(":siteid", QVariant(site));
-	QList<QPair<int, int64_t> > result;
-	if(!query.exec()) {
-		success = false;
-		return result;
-	}
-
-	while(query.next()) {
-		result.append(QPair<int, int64_t>(query.value(0).toInt(), query.value(1).toLongLong()));
-	}
-	success = true;
-	return result;
-}
-
-QList<QSharedPointer<LoggedData> > LoggedDownloader::retrieveLoggedSet(QList<int> & ids, bool & success) {
-	QList<QSharedPointer<LoggedData> > result;
-
-	foreach(int id, ids) {
-		LoggedData *curr = new LoggedData(db, id);
-		if(!curr->isInitialized() || !curr->readDataFromDB(db)) {
-			delete curr;
-			success = false;
-			return result;
-		}
-		result.append(QSharedPointer<LoggedData>(curr));
-	}
-
-	success = true;
-	return result;
-}
-
-bool LoggedDownloader::deleteLoggedSet(QList<int> & ids) {
-	bool success = true;
-
-	foreach(int id, ids) {
-		success = success && LoggedData::deleteFromDB(db, id);
+		sites.append(id);
 	}
 
-	return success;
-}
-
-void LoggedDownloader::retrieveDownloadTimes() {
-	QSqlQuery query(db);
-	query.prepare("SELECT realtime FROM downloadinfo WHERE siteid = :siteid ORDER BY realtime DESC LIMIT 1;");
-
-	foreach(int site, stats.keys()) {
-		query.bindValue(":siteid", QVariant(site));
-		if(!query.exec())
-			break;
-
-		if(query.next()) {
-			stats[site].lastDownloadTime = query.value(0).toLongLong();
-		} else {
-			stats[site].lastDownloadTime = 0;
-		}
-		qDebug() << "Last download time for site " << site << " : " << stats[site].lastDownloadTime;
-	}	
+	// Not much sane we can do about a failure here, so nothing waits for the answer
+	QMetaObject::invokeMethod(storage, "deleteSites", Qt::QueuedConnection, Q_ARG(int, -1), Q_ARG(QList<int>, sites));
 }
@@ -4,19 +4,32 @@
 #include "pmdefs.h"
 #include "loggeddata.h"
 #include "sitemanager.h"
+#include "loggedstorage.h"
 
 #include <QObject>
-#include <QSqlDatabase>
 #include <QMap>
 #include <QList>
 #include <QPair>
+#include <QSet>
+#include <QVector>
 #include <QSharedPointer>
 
 class SiteManager;
 class SitesList;
-
 class QTimer;
-
+class QThread;
+
+/* This class downloads the logged data from every site on its download interval and stores
+   it in the database. Downloads from different sites run at the same time, up to the limit
+   set by AppSettings::getMaxConcurrentDownloads(); each one is stored as soon as it finishes,
+   by a LoggedStorage on its own thread. The LoggedStorage does all of the work with the
+   database, and is shared with the dialogs through getStorage().
+
+   The sites are kept in a min-heap ordered by when their next download is due, so finding the
+   next site costs O(log n) rather than a scan of every site. Overdue sites (e.g. at startup) are
+   spread out by a fixed per-site offset, so sites with the same interval don't all connect at
+   once, and a site that fails is retried with an exponential, jittered backoff.
+ */
 class LoggedDownloader : public QObject {
 	Q_OBJECT
 
@@ -26,17 +39,18 @@ public:
 
 	bool isInitialized() { return initialized; }
 
-	QList<QPair<int, int64_t> > downloadsForSite(int site, bool & success);
-	QList<QSharedPointer<LoggedData> > retrieveLoggedSet(QList<int> & sites, bool & success);
-	bool deleteLoggedSet(QList<int> & ids);
-
-	void checkIfDownloadNeeded();
+	static QString databasePath();
+	LoggedStorage *getStorage() { return storage; }
 
 public slots:
+	void checkIfDownloadNeeded();
 	void checkTime();
 	void downloadFinished();
 	void errorCanceled();
 	void siteStatusChanged(SiteManager::Status newStatus);
+	void downloadStored(int site, int downloadId, qint64 downloadTime);
+	void downloadStoreFailed(int site);
+	void downloadTimesRead(const DownloadList & times, bool success);
 
 	bool downloadNow(SiteManager *manager);
 
@@ -48,21 +62,42 @@ signals:
 	void downloadDBError();
 
 private:
-	void retrieveDownloadTimes();
+	void finishDownload(SiteManager *manager);
+	int maxConcurrent();
+
+	void schedule(int site);
+	void scheduleAll();
+	void backOff(int site);
+	static int64_t phaseOffset(int site, int interval);
 
 	struct DownloadStats {
 		int64_t retryTime;
 		int64_t lastDownloadTime;
 		bool forceReconnect; // Set to true to ensure reconnection
+		int failures; // Consecutive failed downloads, for the backoff
+		unsigned int generation; // Incremented whenever the site is rescheduled, to invalidate its old heap entries
+		bool queued; // True while the heap has an entry of the current generation
 	};
 
-	QSqlDatabase db;
+	// An entry in the heap. Entries are never removed from the middle of the heap; instead an entry
+	// whose generation doesn't match the site's is skipped when it reaches the top
+	struct ScheduledDownload {
+		int64_t dueTime;
+		int site;
+		unsigned int generation;
+
+		bool operator>(const ScheduledDownload & other) const { return dueTime > other.dueTime; }
+	};
 
 	SitesList *sitesList;
-	SiteManager *currManager;
+	QSet<SiteManager *> activeDownloads;
+	QSet<int> storingSites; // Sites whose download has been handed to the storage thread
 	QMap<int, DownloadStats> stats;
+	QVector<ScheduledDownload> queue; // Min-heap on dueTime
 
 	QTimer *downloadTimer;
+	QThread *storageThread;
+	LoggedStorage *storage;
 	bool initialized;
 };
 
@@ -0,0 +1,31 @@
+#include "loggedfilewriter.h"
+
+#include "appsettings.h"
+
+#include <QtGlobal>
+
+// Powers of ten from 10^-MAX_POWER to 10^MAX_POWER. These are the same doubles that
+// std::pow(10.0, n) gives, so values round exactly as they do in DisplayValue::toString()
+static const int MAX_POWER = 18;
+static const double powersOf10[2 * MAX_POWER + 1] = {
+	1e-18, 1e-17, 1e-16, 1e-15, 1e-14, 1e-13, 1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6,
+	1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+LoggedFileWriter::LoggedFileWriter(const Settings & settings) : settings(settings) {
+}
+
+// Reads the settings that change the output. Only call this on the main thread
+LoggedFileWriter::Settings LoggedFileWriter::currentSettings() {
+	AppSettings *appSettings = AppSettings::getInstance();
+	Settings result;
+	result.averageInterval = appSettings->getEfficiencyAverageInterval();
+	result.fahrenheit = appSettings->getTempUnit() == AppSettings::Fahrenheit;
+	return result;
+}
+
+// Gets 10^power, clamped to the range of the table
+double LoggedFileWriter::powerOf10(int power) {
+	return powersOf10[qBound(-MAX_POWER, power, MAX_POWER) + MAX_POWER];
+}
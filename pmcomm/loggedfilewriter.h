@@ -0,0 +1,64 @@
+#ifndef LOGGEDFILEWRITER_H
+#define LOGGEDFILEWRITER_H
+
+#include <QString>
+
+#include <stdint.h>
+
+/* This is the interface that logged values are written to files through. Its subclasses
+   decide what the file looks like: CsvWriter writes text for spreadsheets, and ColumnWriter
+   writes typed columns for analysis tools.
+
+   A file starts with its columns, each added with addColumn() and then ended with endHeader().
+   Each row is then made of one append call per column, in order, with skip() for a column
+   that has no value, followed by endRow(). spacerRow() writes a row with no values at all,
+   which marks a break in the records.
+
+   The settings that change the output are passed to the constructor as a Settings. These
+   are read from AppSettings by currentSettings(), which must be called on the main thread;
+   the writer can then be constructed and used on any thread.
+ */
+class LoggedFileWriter {
+public:
+	enum ColumnType {
+		COLUMN_TIME, // Seconds since the epoch, from appendTime()
+		COLUMN_INT, // From appendInt()
+		COLUMN_DECIMAL, // From appendDecimal() or appendFixed()
+		COLUMN_TEMPERATURE, // Degrees C, from appendTemperature()
+		COLUMN_BOOL // From appendBool()
+	};
+
+	struct Settings {
+		int averageInterval; // Number of efficiency cycles to average
+		bool fahrenheit; // Write temperatures in degrees F
+	};
+
+	LoggedFileWriter(const Settings & settings);
+	virtual ~LoggedFileWriter() {}
+
+	virtual bool open() = 0;
+	virtual bool close() = 0; // Returns false if anything couldn't be written
+
+	virtual void addColumn(QString name, ColumnType type) = 0;
+	virtual void endHeader() = 0;
+
+	virtual void appendTime(int64_t time) = 0;
+	virtual void appendInt(int64_t value) = 0;
+	virtual void appendDecimal(double value, int digitsDP, int digitsTotal) = 0;
+	virtual void appendFixed(double value, int digitsDP) = 0;
+	virtual void appendTemperature(int celsius) = 0;
+	virtual void appendBool(bool value) = 0;
+	virtual void skip() = 0;
+	virtual void endRow() = 0;
+	virtual void spacerRow() = 0;
+
+	int averageInterval() { return settings.averageInterval; }
+
+	static Settings currentSettings();
+	static double powerOf10(int power);
+
+protected:
+	Settings settings;
+};
+
+#endif
@@ -0,0 +1,343 @@
+#include "loggedhistorychart.h"
+
+#include "loggedstorage.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QTimer>
+#include <QDateTime>
+#include <QLineF>
+#include <QPointF>
+#include <qmath.h>
+#include <qnumeric.h>
+
+// The bucket sizes that the chart chooses from, smallest first
+static const int bucketSizes[] = {
+	60, 300, 900, 3600, 3 * 3600, 6 * 3600, 86400, 2 * 86400, 7 * 86400, 28 * 86400
+};
+static const int N_LEVELS = sizeof(bucketSizes) / sizeof(bucketSizes[0]);
+
+static const qint64 minSpan = 3600;
+static const qint64 maxSpan = (qint64) 50 * 365 * 86400;
+
+LoggedHistoryChart::LoggedHistoryChart(LoggedStorage *storage, QWidget *parent) : QWidget(parent) {
+	this->storage = storage;
+	site = -1;
+	field = PeriodicQuery::FIELD_VOLTS1;
+	to = QDateTime::currentDateTime().toTime_t();
+	from = to - 7 * 86400;
+	dragging = false;
+	dragX = 0;
+	dragFrom = 0;
+	tileRetries = 0;
+
+	setMinimumSize(300, 150);
+	setFocusPolicy(Qt::WheelFocus);
+
+	requestTimer = new QTimer(this);
+	requestTimer->setSingleShot(true);
+	requestTimer->setInterval(50);
+	connect(requestTimer, SIGNAL(timeout()), this, SLOT(requestTiles()));
+
+	connect(this, SIGNAL(historyRequested(int, PeriodicQuery)), storage, SLOT(query(int, PeriodicQuery)));
+	connect(storage, SIGNAL(queried(int, const PeriodicSeries &, bool)), this, SLOT(historyLoaded(int, const PeriodicSeries &, bool)));
+}
+
+void LoggedHistoryChart::setSite(int site) {
+	this->site = site;
+	clearTiles();
+	rangeChanged();
+}
+
+void LoggedHistoryChart::setField(PeriodicQuery::Field field, QString units) {
+	this->field = field;
+	this->units = units;
+	clearTiles();
+	rangeChanged();
+}
+
+void LoggedHistoryChart::setRange(qint64 from, qint64 to) {
+	this->from = from;
+	this->to = qMax(to, from + minSpan);
+	rangeChanged();
+}
+
+QSize LoggedHistoryChart::sizeHint() const {
+	return QSize(700, 350);
+}
+
+void LoggedHistoryChart::historyLoaded(int request, const PeriodicSeries & series, bool success) {
+	if(!requests.contains(request))
+		return; // Another chart's, or from before the site or field changed
+
+	QMap<TileKey, Tile>::iterator tile = tiles.find(requests.take(request));
+	if(tile == tiles.end())
+		return;
+
+	// A failed query, such as one that found the database busy, is forgotten so that the tile is
+	// asked for again, instead of staying blank
+	if(!success || series.values.size() != 2) {
+		tiles.erase(tile);
+		if(tileRetries++ < MAX_TILE_RETRIES)
+			QTimer::singleShot(RETRY_INTERVAL, this, SLOT(requestTiles()));
+		update();
+		return;
+	}
+
+	tileRetries = 0;
+	tile->loaded = true;
+	tile->times = series.times;
+	tile->mins = series.values[0];
+	tile->maxes = series.values[1];
+	update();
+}
+
+// Asks for the tiles of the visible range that aren't loaded or loading
+void LoggedHistoryChart::requestTiles() {
+	if(site < 0)
+		return;
+
+	int bucketSize = bucketSizes[level()];
+	qint64 tileSeconds = (qint64) bucketSize * TILE_BUCKETS;
+	for(qint64 n = tileNumber(from, bucketSize); n <= tileNumber(to, bucketSize); n++) {
+		TileKey key(bucketSize, n);
+		if(tiles.contains(key))
+			continue;
+
+		Tile tile;
+		tile.loaded = false;
+		tiles.insert(key, tile);
+
+		int request = LoggedStorage::newRequest();
+		requests.insert(request, key);
+
+		PeriodicQuery query(site, n * tileSeconds, (n + 1) * tileSeconds - 1);
+		query.setBuckets(bucketSize, PeriodicQuery::AGGREGATE_MIN);
+		query.addField(field, PeriodicQuery::AGGREGATE_MIN);
+		query.addField(field, PeriodicQuery::AGGREGATE_MAX);
+		emit historyRequested(request, query);
+	}
+
+	dropTiles();
+}
+
+void LoggedHistoryChart::rangeChanged() {
+	tileRetries = 0;
+	update();
+	requestTimer->start();
+}
+
+// Forgets every tile. Answers to requests already made are ignored
+void LoggedHistoryChart::clearTiles() {
+	tiles.clear();
+	requests.clear();
+}
+
+// Drops loaded tiles that are more than a screen away from the visible range, once there are
+// too many to keep
+void LoggedHistoryChart::dropTiles() {
+	if(tiles.size() <= MAX_TILES)
+		return;
+
+	qint64 span = to - from;
+	QMap<TileKey, Tile>::iterator it = tiles.begin();
+	while(it != tiles.end()) {
+		qint64 tileSeconds = (qint64) it.key().first * TILE_BUCKETS;
+		qint64 start = it.key().second * tileSeconds;
+		if(it->loaded && (start + tileSeconds <= from - span || start > to + span))
+			it = tiles.erase(it);
+		else
+			++it;
+	}
+}
+
+// Gets the index of the smallest bucket size that is at least a pixel wide
+int LoggedHistoryChart::level() {
+	qint64 perPixel = (to - from + 1) / qMax(plotRect().width(), 1);
+	for(int i = 0; i < N_LEVELS; i++) {
+		if(bucketSizes[i] >= perPixel)
+			return i;
+	}
+	return N_LEVELS - 1;
+}
+
+qint64 LoggedHistoryChart::tileNumber(qint64 time, int bucketSize) {
+	qint64 tileSeconds = (qint64) bucketSize * TILE_BUCKETS;
+	qint64 n = time / tileSeconds;
+	return (time < 0 && time % tileSeconds != 0) ? n - 1 : n;
+}
+
+// Gets the loaded tiles to draw for the visible range, falling back to coarser tiles for the
+// parts that haven't loaded yet
+QList<LoggedHistoryChart::Span> LoggedHistoryChart::visibleSpans() {
+	QList<Span> spans;
+	int current = level();
+	int bucketSize = bucketSizes[current];
+	qint64 tileSeconds = (qint64) bucketSize * TILE_BUCKETS;
+
+	for(qint64 n = tileNumber(from, bucketSize); n <= tileNumber(to, bucketSize); n++) {
+		Span span;
+		span.from = qMax(n * tileSeconds, from);
+		span.to = qMin((n + 1) * tileSeconds - 1, to);
+		span.tile = NULL;
+
+		for(int l = current; l < N_LEVELS && span.tile == NULL; l++) {
+			QMap<TileKey, Tile>::const_iterator tile = tiles.constFind(TileKey(bucketSizes[l], tileNumber(span.from, bucketSizes[l])));
+			if(tile != tiles.constEnd() && tile->loaded) {
+				span.tile = &tile.value();
+				span.bucketSize = bucketSizes[l];
+			}
+		}
+		if(span.tile != NULL)
+			spans.append(span);
+	}
+	return spans;
+}
+
+QRect LoggedHistoryChart::plotRect() const {
+	return rect().adjusted(70, 10, -10, -25);
+}
+
+double LoggedHistoryChart::xFor(qint64 time, const QRect & plot) const {
+	return plot.left() + (double) (time - from) * plot.width() / (to - from);
+}
+
+void LoggedHistoryChart::paintEvent(QPaintEvent *) {
+	QPainter painter(this);
+	painter.fillRect(rect(), palette().base());
+
+	QRect plot = plotRect();
+	painter.setPen(palette().color(QPalette::Mid));
+	painter.drawRect(plot);
+
+	// Scale to the buckets in view
+	QList<Span> spans = visibleSpans();
+	double low = qInf(), high = -qInf();
+	foreach(const Span & span, spans) {
+		const Tile & tile = *span.tile;
+		for(int i = 0; i < tile.times.size(); i++) {
+			if(tile.times[i] + span.bucketSize <= span.from || tile.times[i] > span.to || qIsNaN(tile.mins[i]))
+				continue;
+			low = qMin(low, tile.mins[i]);
+			high = qMax(high, tile.maxes[i]);
+		}
+	}
+
+	painter.setPen(palette().color(QPalette::Text));
+	QString fromLabel = QDateTime::fromTime_t((uint) from).toLocalTime().toString("MM/dd/yyyy hh:mm");
+	QString toLabel = QDateTime::fromTime_t((uint) to).toLocalTime().toString("MM/dd/yyyy hh:mm");
+	QRect labels(plot.left(), plot.bottom() + 4, plot.width(), 20);
+	painter.drawText(labels, Qt::AlignLeft | Qt::AlignTop, fromLabel);
+	painter.drawText(labels, Qt::AlignRight | Qt::AlignTop, toLabel);
+
+	if(low > high) {
+		// Downloads stored as raw memory aren't in the timeline, so the chart can't see them
+		QString message = requests.empty() ? "No logged data in this range\n"
+			"(downloads stored in the compact format are not charted)" : "Loading...";
+		painter.drawText(plot, Qt::AlignCenter, message);
+		return;
+	}
+
+	double margin = (high > low) ? (high - low) * 0.05 : qMax(qAbs(high) * 0.05, 0.5);
+	low -= margin;
+	high += margin;
+
+	QRect axis(0, plot.top(), plot.left() - 4, plot.height());
+	painter.drawText(axis, Qt::AlignRight | Qt::AlignTop, QString("%1 %2").arg(high, 0, 'g', 4).arg(units));
+	painter.drawText(axis, Qt::AlignRight | Qt::AlignBottom, QString("%1 %2").arg(low, 0, 'g', 4).arg(units));
+
+	painter.setClipRect(plot);
+	drawSpans(painter, spans, plot, low, high);
+}
+
+// Draws each bucket as a line from its minimum to its maximum, joined to the next bucket by
+// lines along the minimums and maximums. Buckets without records leave a break
+void LoggedHistoryChart::drawSpans(QPainter & painter, const QList<Span> & spans, const QRect & plot, double low, double high) {
+	painter.setPen(palette().color(QPalette::Highlight));
+	double scale = plot.height() / (high - low);
+
+	foreach(const Span & span, spans) {
+		const Tile & tile = *span.tile;
+		QVector<QLineF> bars;
+		QVector<QPointF> mins, maxes;
+		qint64 lastTime = 0;
+
+		for(int i = 0; i < tile.times.size(); i++) {
+			qint64 time = tile.times[i];
+			if(time + span.bucketSize <= span.from || time > span.to)
+				continue;
+
+			bool valid = !qIsNaN(tile.mins[i]);
+			if(!mins.empty() && (!valid || time != lastTime + span.bucketSize)) {
+				painter.drawPolyline(mins.constData(), mins.size());
+				painter.drawPolyline(maxes.constData(), maxes.size());
+				mins.clear();
+				maxes.clear();
+			}
+			if(!valid)
+				continue;
+
+			double x = xFor(time + span.bucketSize / 2, plot);
+			double yMin = plot.bottom() - (tile.mins[i] - low) * scale;
+			double yMax = plot.bottom() - (tile.maxes[i] - low) * scale;
+			bars.append(QLineF(x, yMin, x, yMax));
+			mins.append(QPointF(x, yMin));
+			maxes.append(QPointF(x, yMax));
+			lastTime = time;
+		}
+
+		if(!mins.empty()) {
+			painter.drawPolyline(mins.constData(), mins.size());
+			painter.drawPolyline(maxes.constData(), maxes.size());
+		}
+		painter.drawLines(bars);
+	}
+}
+
+void LoggedHistoryChart::resizeEvent(QResizeEvent *) {
+	rangeChanged();
+}
+
+void LoggedHistoryChart::mousePressEvent(QMouseEvent *event) {
+	if(event->button() != Qt::LeftButton) {
+		QWidget::mousePressEvent(event);
+		return;
+	}
+	dragging = true;
+	dragX = event->x();
+	dragFrom = from;
+}
+
+void LoggedHistoryChart::mouseMoveEvent(QMouseEvent *event) {
+	if(!dragging)
+		return;
+
+	qint64 span = to - from;
+	from = dragFrom - (qint64) ((double) (event->x() - dragX) * span / qMax(plotRect().width(), 1));
+	to = from + span;
+	rangeChanged();
+}
+
+void LoggedHistoryChart::mouseReleaseEvent(QMouseEvent *event) {
+	if(event->button() == Qt::LeftButton)
+		dragging = false;
+}
+
+// Zooms around the time under the pointer, by a fifth for each step of the wheel
+void LoggedHistoryChart::wheelEvent(QWheelEvent *event) {
+	QRect plot = plotRect();
+	qint64 span = to - from;
+	double position = qBound(0.0, (double) (event->x() - plot.left()) / qMax(plot.width(), 1), 1.0);
+	qint64 pointer = from + (qint64) (position * span);
+
+	double factor = qPow(0.8, event->delta() / 120.0);
+	qint64 newSpan = qBound(minSpan, (qint64) (span * factor), maxSpan);
+	from = pointer - (qint64) (position * newSpan);
+	to = from + newSpan;
+
+	rangeChanged();
+	event->accept();
+}
@@ -0,0 +1,114 @@
+#ifndef LOGGEDHISTORYCHART_H
+#define LOGGEDHISTORYCHART_H
+
+#include "periodicquery.h"
+
+#include <QWidget>
+#include <QMap>
+#include <QPair>
+#include <QVector>
+#include <QRect>
+
+class LoggedStorage;
+
+class QTimer;
+class QPainter;
+
+/* This widget charts one field of a site's stored periodic data over time. Dragging pans
+   the chart and the mouse wheel zooms around the pointer.
+
+   The chart never loads the records themselves. The visible range is split into buckets
+   about one pixel wide, and the LoggedStorage is asked for the minimum and maximum of each
+   bucket, which is all a column of pixels can show. The bucket sizes come from a fixed list
+   of whole minutes, hours and days, so that hourly and daily buckets are read from the
+   rollups.
+
+   The buckets are loaded in tiles of TILE_BUCKETS, which are kept while they stay near the
+   visible range, so panning only loads the tiles that come into view. Tiles are drawn as
+   they arrive; until a tile has loaded, any coarser tile already loaded for the same time is
+   drawn in its place.
+
+   Downloads stored in the PentaMetric's compact format aren't in the timeline, so they aren't
+   charted.
+ */
+class LoggedHistoryChart : public QWidget {
+	Q_OBJECT
+
+public:
+	LoggedHistoryChart(LoggedStorage *storage, QWidget *parent = NULL);
+
+	void setSite(int site);
+	void setField(PeriodicQuery::Field field, QString units);
+	void setRange(qint64 from, qint64 to);
+
+	QSize sizeHint() const;
+
+public slots:
+	void historyLoaded(int request, const PeriodicSeries & series, bool success);
+	void requestTiles();
+
+signals:
+	void historyRequested(int request, PeriodicQuery query);
+
+protected:
+	void paintEvent(QPaintEvent *event);
+	void resizeEvent(QResizeEvent *event);
+	void mousePressEvent(QMouseEvent *event);
+	void mouseMoveEvent(QMouseEvent *event);
+	void mouseReleaseEvent(QMouseEvent *event);
+	void wheelEvent(QWheelEvent *event);
+
+private:
+	enum {
+		TILE_BUCKETS = 256,
+		MAX_TILES = 256, // Loaded tiles away from the view are dropped above this
+		MAX_TILE_RETRIES = 5, // Failed tiles in a row that are asked for again by themselves
+		RETRY_INTERVAL = 1000
+	};
+
+	// The minimum and maximum of each bucket with records in one tile
+	struct Tile {
+		bool loaded;
+		QVector<qint64> times;
+		QVector<double> mins;
+		QVector<double> maxes;
+	};
+
+	typedef QPair<int, qint64> TileKey; // Bucket size and tile number
+
+	// Part of a tile to draw
+	struct Span {
+		const Tile *tile;
+		int bucketSize;
+		qint64 from;
+		qint64 to;
+	};
+
+	void rangeChanged();
+	void clearTiles();
+	void dropTiles();
+	int level();
+	static qint64 tileNumber(qint64 time, int bucketSize);
+	QList<Span> visibleSpans();
+	QRect plotRect() const;
+	double xFor(qint64 time, const QRect & plot) const;
+	void drawSpans(QPainter & painter, const QList<Span> & spans, const QRect & plot, double low, double high);
+
+	LoggedStorage *storage;
+	int site;
+	PeriodicQuery::Field field;
+	QString units;
+	qint64 from;
+	qint64 to;
+
+	QMap<TileKey, Tile> tiles;
+	QMap<int, TileKey> requests; // Tiles that are loading, by request number
+
+	QTimer *requestTimer; // Gathers the changes made while panning or zooming into one set of requests
+	int tileRetries; // Failed tiles since the last one that loaded or the last change to the view
+	bool dragging;
+	int dragX;
+	qint64 dragFrom;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "loggedhistorydialog.h"
+
+#include "loggedhistorychart.h"
+#include "loggeddownloader.h"
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QDialogButtonBox>
+#include <QComboBox>
+#include <QLabel>
+#include <QDateTime>
+#include <QStringList>
+
+LoggedHistoryDialog::LoggedHistoryDialog(QSharedPointer<SiteSettings> settings, LoggedDownloader *downloader, QWidget *parent) : QDialog(parent) {
+	setWindowTitle(QString("Logged data history - %1").arg(settings->getName()));
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+
+	fieldBox = new QComboBox();
+	fieldBox->addItem("Volts 1", PeriodicQuery::FIELD_VOLTS1);
+	fieldBox->addItem("Volts 2", PeriodicQuery::FIELD_VOLTS2);
+	fieldBox->addItem("Amps 1", PeriodicQuery::FIELD_AMPS1);
+	fieldBox->addItem("Amp hours 1", PeriodicQuery::FIELD_AHR1);
+	fieldBox->addItem("Amp hours 2", PeriodicQuery::FIELD_AHR2);
+	fieldBox->addItem("Amp hours 3", PeriodicQuery::FIELD_AHR3);
+	fieldBox->addItem("Watt hours 1", PeriodicQuery::FIELD_WHR1);
+	fieldBox->addItem("Watt hours 2", PeriodicQuery::FIELD_WHR2);
+	fieldBox->addItem("Minimum temperature", PeriodicQuery::FIELD_MIN_TEMP);
+	fieldBox->addItem("Maximum temperature", PeriodicQuery::FIELD_MAX_TEMP);
+	fieldBox->addItem("Battery 1 % full", PeriodicQuery::FIELD_BAT1_PERCENT);
+	fieldBox->addItem("Battery 2 % full", PeriodicQuery::FIELD_BAT2_PERCENT);
+
+	spanBox = new QComboBox();
+	spanBox->addItem("Last day", 1);
+	spanBox->addItem("Last week", 7);
+	spanBox->addItem("Last month", 30);
+	spanBox->addItem("Last year", 365);
+	spanBox->addItem("Last 5 years", 5 * 365);
+	spanBox->setCurrentIndex(1);
+
+	QHBoxLayout *optionsLayout = new QHBoxLayout();
+	optionsLayout->addWidget(fieldBox);
+	optionsLayout->addWidget(spanBox);
+	optionsLayout->addStretch();
+	optionsLayout->addWidget(new QLabel("Drag to pan, scroll to zoom"));
+	layout->addLayout(optionsLayout);
+
+	chart = new LoggedHistoryChart(downloader->getStorage());
+	layout->addWidget(chart, 1);
+
+	QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Close);
+	connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
+	layout->addWidget(buttonBox);
+
+	connect(fieldBox, SIGNAL(currentIndexChanged(int)), this, SLOT(fieldChanged()));
+	connect(spanBox, SIGNAL(currentIndexChanged(int)), this, SLOT(spanChanged()));
+
+	fieldChanged();
+	spanChanged();
+	chart->setSite(settings->getId());
+}
+
+void LoggedHistoryDialog::fieldChanged() {
+	PeriodicQuery::Field field = (PeriodicQuery::Field) fieldBox->itemData(fieldBox->currentIndex()).toInt();
+	QString units;
+	switch(field) {
+		case PeriodicQuery::FIELD_VOLTS1:
+		case PeriodicQuery::FIELD_VOLTS2: units = "V"; break;
+		case PeriodicQuery::FIELD_AMPS1: units = "A"; break;
+		case PeriodicQuery::FIELD_AHR1:
+		case PeriodicQuery::FIELD_AHR2:
+		case PeriodicQuery::FIELD_AHR3: units = "Ah"; break;
+		case PeriodicQuery::FIELD_WHR1:
+		case PeriodicQuery::FIELD_WHR2: units = "Wh"; break;
+		case PeriodicQuery::FIELD_MIN_TEMP:
+		case PeriodicQuery::FIELD_MAX_TEMP: units = QString::fromUtf8("\xc2\xb0" "C"); break;
+		default: units = "%"; break;
+	}
+	chart->setField(field, units);
+}
+
+// Shows the chosen span, ending now
+void LoggedHistoryDialog::spanChanged() {
+	qint64 days = spanBox->itemData(spanBox->currentIndex()).toInt();
+	qint64 now = QDateTime::currentDateTime().toTime_t();
+	chart->setRange(now - days * 86400, now);
+}
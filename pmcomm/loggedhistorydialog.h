@@ -0,0 +1,30 @@
+#ifndef LOGGEDHISTORYDIALOG_H
+#define LOGGEDHISTORYDIALOG_H
+
+#include "sitesettings.h"
+
+#include <QObject>
+#include <QDialog>
+#include <QSharedPointer>
+
+class LoggedDownloader;
+class LoggedHistoryChart;
+
+class QComboBox;
+
+class LoggedHistoryDialog : public QDialog {
+	Q_OBJECT
+public:
+	LoggedHistoryDialog(QSharedPointer<SiteSettings> settings, LoggedDownloader *downloader, QWidget *parent = NULL);
+
+public slots:
+	void fieldChanged();
+	void spanChanged();
+
+private:
+	LoggedHistoryChart *chart;
+	QComboBox *fieldBox;
+	QComboBox *spanBox;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include "loggedstorage.h"
+
+#include <QSqlQuery>
+#include <QVariant>
+#include <QTime>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <QDebug>
+
+// Runs one export on the export pool, through its own connection, and posts its progress and
+// result back to the storage thread
+class ExportJob : public QRunnable, private LoggedData::Progress {
+public:
+	ExportJob(LoggedStorage *storage, QString path, int request, QList<int> ids, QString baseName, LoggedData::ExportFormat format, const LoggedFileWriter::Settings & settings) :
+		storage(storage), path(path), request(request), ids(ids), baseName(baseName), format(format), settings(settings) {}
+
+	void run() {
+		QString connectionName = QString("loggeddata-exportjob-%1").arg((quintptr) this);
+		bool success;
+		{
+			QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+			db.setDatabaseName(path);
+			success = db.open() && LoggedData::configureConnection(db) && LoggedData::exportFromDB(db, ids, baseName, format, settings, this);
+			db.close();
+		}
+		QSqlDatabase::removeDatabase(connectionName);
+
+		QMetaObject::invokeMethod(storage, "exportFinished", Qt::QueuedConnection, Q_ARG(int, request), Q_ARG(bool, success));
+	}
+
+private:
+	void reportProgress(int done, int total) {
+		QMetaObject::invokeMethod(storage, "exportProgress", Qt::QueuedConnection, Q_ARG(int, request), Q_ARG(int, done), Q_ARG(int, total));
+	}
+
+	LoggedStorage *storage;
+	QString path;
+	int request;
+	QList<int> ids;
+	QString baseName;
+	LoggedData::ExportFormat format;
+	LoggedFileWriter::Settings settings;
+};
+
+LoggedStorage::LoggedStorage(QString path, QObject *parent) : QObject(parent) {
+	this->path = path;
+	connectionName = "loggeddata-storage";
+	exportPool = new QThreadPool(this);
+	exportPool->setMaxThreadCount(1); // Each export already writes its files in parallel
+}
+
+LoggedStorage::~LoggedStorage() {
+	close();
+}
+
+// Registers the types passed through the queued connections. Must be called before connecting
+void LoggedStorage::registerTypes() {
+	qRegisterMetaType<QSharedPointer<LoggedData> >("QSharedPointer<LoggedData>");
+	qRegisterMetaType<PeriodicQuery>("PeriodicQuery");
+	qRegisterMetaType<PeriodicSeries>("PeriodicSeries");
+	qRegisterMetaType<LoggedFileWriter::Settings>("LoggedFileWriter::Settings");
+	qRegisterMetaType<DownloadList>("DownloadList");
+	qRegisterMetaType<QList<int> >("QList<int>");
+}
+
+int LoggedStorage::newRequest() {
+	static int next = 0;
+	return next++;
+}
+
+bool LoggedStorage::open() {
+	db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+	db.setDatabaseName(path);
+	if(!db.open())
+		return false;
+
+	return LoggedData::setupDB(db) && LoggedData::configureConnection(db);
+}
+
+// Waits for any exports that are running, since they post back to this object
+void LoggedStorage::close() {
+	exportPool->waitForDone();
+
+	if(!db.isValid())
+		return;
+
+	db.close();
+	db = QSqlDatabase();
+	QSqlDatabase::removeDatabase(connectionName);
+}
+
+void LoggedStorage::store(QSharedPointer<LoggedData> data, int site) {
+	QTime timer;
+	timer.start();
+
+	int downloadId = -1;
+	if(db.isOpen())
+		downloadId = data->writeToDB(db);
+
+	if(downloadId > 0) {
+		qDebug() << "Stored download" << downloadId << "in" << timer.elapsed() << "ms";
+		emit stored(site, downloadId, data->getDownloadTime());
+	} else {
+		emit storeFailed(site);
+	}
+}
+
+void LoggedStorage::query(int request, PeriodicQuery query) {
+	PeriodicSeries series;
+	bool success = db.isOpen() && query.run(db, series);
+	emit queried(request, series, success);
+}
+
+// Reads the time of the latest download of each site. Sites without any are left out
+void LoggedStorage::readDownloadTimes(QList<int> sites) {
+	DownloadList times;
+	QSqlQuery query(db);
+	bool success = db.isOpen() && query.prepare("SELECT realtime FROM downloadinfo WHERE siteid = :siteid ORDER BY realtime DESC LIMIT 1;");
+
+	for(int i = 0; success && i < sites.size(); i++) {
+		query.bindValue(":siteid", QVariant(sites[i]));
+		success = query.exec();
+		if(success && query.next())
+			times.append(QPair<int, qint64>(sites[i], query.value(0).toLongLong()));
+	}
+	emit downloadTimesRead(times, success);
+}
+
+void LoggedStorage::listDownloads(int request, int site) {
+	DownloadList downloads;
+	bool success = downloadsForSite(site, downloads);
+	emit downloadsListed(request, downloads, success);
+}
+
+// Finds which of the sites have any downloads stored
+void LoggedStorage::listSitesWithDownloads(int request, QList<int> sites) {
+	QList<int> result;
+	QSqlQuery query(db);
+	query.prepare("SELECT 1 FROM downloadinfo WHERE siteid = :siteid LIMIT 1;");
+
+	foreach(int site, sites) {
+		query.bindValue(":siteid", QVariant(site));
+		if(query.exec() && query.next())
+			result.append(site);
+	}
+	emit sitesWithDownloadsListed(request, result);
+}
+
+// Deletes downloads one at a time, each in its own transaction, reporting progress after each
+void LoggedStorage::deleteDownloads(int request, QList<int> ids) {
+	bool success = db.isOpen();
+	for(int i = 0; success && i < ids.size(); i++) {
+		success = LoggedData::deleteFromDB(db, ids[i]);
+		emit progress(request, i + 1, ids.size());
+	}
+	emit finished(request, success);
+}
+
+// Permanently deletes all of the data of the sites, each in one transaction, reporting progress
+// after each
+void LoggedStorage::deleteSites(int request, QList<int> sites) {
+	bool success = db.isOpen();
+	for(int i = 0; success && i < sites.size(); i++) {
+		success = LoggedData::deleteSiteFromDB(db, sites[i]);
+		emit progress(request, i + 1, sites.size());
+	}
+	emit finished(request, success);
+}
+
+// Starts the export on the export pool and returns straight away. Its progress() and finished()
+// are emitted as they are posted back
+void LoggedStorage::exportDownloads(int request, QList<int> ids, QString baseName, int format, LoggedFileWriter::Settings settings) {
+	exportPool->start(new ExportJob(this, path, request, ids, baseName, (LoggedData::ExportFormat) format, settings));
+}
+
+void LoggedStorage::exportProgress(int request, int done, int total) {
+	emit progress(request, done, total);
+}
+
+void LoggedStorage::exportFinished(int request, bool success) {
+	emit finished(request, success);
+}
+
+bool LoggedStorage::downloadsForSite(int site, DownloadList & result) {
+	QSqlQuery query(db);
+	query.prepare("SELECT downloadid, realtime FROM downloadinfo WHERE siteid = :siteid ORDER BY realtime ASC;");
+	query.bindValue(":siteid", QVariant(site));
+	if(!query.exec())
+		return false;
+
+	while(query.next()) {
+		result.append(QPair<int, qint64>(query.value(0).toInt(), query.value(1).toLongLong()));
+	}
+	return true;
+}
@@ -0,0 +1,98 @@
+#ifndef LOGGEDSTORAGE_H
+#define LOGGEDSTORAGE_H
+
+#include "loggeddata.h"
+#include "loggedfilewriter.h"
+#include "periodicquery.h"
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QPair>
+#include <QSqlDatabase>
+#include <QSharedPointer>
+#include <QMetaType>
+
+class QThreadPool;
+
+// Pairs of an id and a time: (downloadid, download time) from listDownloads(), or
+// (siteid, last download time) from readDownloadTimes()
+typedef QList<QPair<int, qint64> > DownloadList;
+
+/* This class does all of the work with the logged data database. It lives on its own thread
+   with its own connection to the database, so the GUI never waits on the disk. Exports are the
+   exception: they read through connections of their own on exportPool, so a long export doesn't
+   hold up the other requests.
+
+   Everything is asked for through its slots, with queued connections, and answered through
+   its signals. The requests are handled one at a time, in the order they are sent; each
+   write is one transaction. Requests that are answered take a request number from
+   newRequest(), which comes back with the answer, so a caller can pick out its own answers
+   from the signals every caller sees.
+
+   The LoggedDownloader sends each finished download to store(), and gets the result back
+   through stored() or storeFailed(). query() runs a PeriodicQuery for views of the stored
+   history, such as the LoggedHistoryChart. Deletes and exports can take a while, so they
+   report progress() as they go and then finished().
+ */
+class LoggedStorage : public QObject {
+	Q_OBJECT
+
+public:
+	LoggedStorage(QString path, QObject *parent = NULL);
+	~LoggedStorage();
+
+	static void registerTypes();
+	static int newRequest(); // Only call this on the main thread
+
+public slots:
+	// Must be called on the storage thread before anything else. Creates or updates the tables
+	bool open();
+	void close();
+
+	void store(QSharedPointer<LoggedData> data, int site);
+	void query(int request, PeriodicQuery query);
+
+	void readDownloadTimes(QList<int> sites);
+	void listDownloads(int request, int site);
+	void listSitesWithDownloads(int request, QList<int> sites);
+
+	void deleteDownloads(int request, QList<int> ids);
+	void deleteSites(int request, QList<int> sites);
+	void exportDownloads(int request, QList<int> ids, QString baseName, int format, LoggedFileWriter::Settings settings);
+
+signals:
+	void stored(int site, int downloadId, qint64 downloadTime);
+	void storeFailed(int site);
+	void queried(int request, const PeriodicSeries & series, bool success);
+
+	void downloadTimesRead(const DownloadList & times, bool success);
+	void downloadsListed(int request, const DownloadList & downloads, bool success);
+	void sitesWithDownloadsListed(int request, const QList<int> & sites);
+
+	void progress(int request, int done, int total);
+	void finished(int request, bool success);
+
+private slots:
+	// Posted back by the exports running on exportPool
+	void exportProgress(int request, int done, int total);
+	void exportFinished(int request, bool success);
+
+private:
+	bool downloadsForSite(int site, DownloadList & result);
+
+	QString path;
+	QString connectionName;
+	QSqlDatabase db;
+	QThreadPool *exportPool;
+};
+
+Q_DECLARE_METATYPE(LoggedFileWriter::Settings)
+
+// Qt5 already knows these
+#if QT_VERSION < 0x050000
+Q_DECLARE_METATYPE(DownloadList)
+Q_DECLARE_METATYPE(QList<int>)
+#endif
+
+#endif
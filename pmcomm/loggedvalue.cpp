@@ -2,17 +2,17 @@
 
 #include "sitemanager.h"
 #include "loggeddata.h"
-#include "appsettings.h"
+#include "csvwriter.h"
+
+#include "libpmcomm.h"
 
 #include <QString>
-#include <QDateTime>
 #include <QSqlQuery>
 #include <QVariant>
-#include <QFile>
-#include <QIODevice>
-#include <QTextStream>
+#include <QSharedPointer>
 #include <cmath> // pow()
 #include <cstdlib> // llabs()
+#include <cstring> // memset()
 
 static const unsigned int TIME_MATCH_THRESHOLD = 3600 * 4; // Four hours
 
@@ -31,6 +31,35 @@ int LoggedValue::getBattery() {
 	return battery;
 }
 
+// Sets up a query to be read once, from start to end. QtSql hands every column over as a
+// QVariant; with integersOnly, SQLite's integers are put in it as ints, rather than as
+// 64-bit values that are then narrowed. It also turns REAL columns into ints, so it
+// must only be used for queries without any
+static void prepareCursor(QSqlQuery & query, bool integersOnly) {
+	query.setForwardOnly(true);
+	if(integersOnly)
+		query.setNumericalPrecisionPolicy(QSql::LowPrecisionInt32);
+}
+
+// Reads the raw memory archived for a download by LoggedData::writeToDB(), if there is any
+QByteArray LoggedValue::readRawData(QSqlDatabase db, int downloadid, LoggedDataType type) {
+	QSqlQuery query(db);
+	prepareCursor(query, false);
+	QString column = (type == TYPE_PERIODIC) ? "periodic" : "profile";
+	query.prepare(QString("SELECT %1 FROM rawdownload WHERE downloadid = :downloadid;").arg(column));
+	query.bindValue(":downloadid", downloadid);
+	if(!query.exec() || !query.next() || query.value(0).isNull())
+		return QByteArray();
+
+	return qUncompress(query.value(0).toByteArray());
+}
+
+// Keeps the logged data memory that the records were decoded from: the pointer bytes
+// followed by the pages, as read by PMReadPeriodicRaw() or PMReadProfileRaw()
+void LoggedValue::setRawData(QByteArray data) {
+	rawData = data;
+}
+
 // LoggedDisplayValue constructor for int-valued types 
 LoggedDisplayValue::LoggedDisplayValue(enum PMDisplayNumber display, int value) : DisplayValue() {
 	disp = display;
@@ -55,29 +84,38 @@ double LoggedDisplayValue::toDouble() {
 	return DisplayValue::toDouble();
 }
 
+// The columns read by readRecord(), in order
+static const char *periodicSelectColumns = "meastime,"
+	"ahr1man,ahr1exp,ahr2man,ahr2exp,ahr3man,ahr3exp,"
+	"whr1man,whr1exp,whr2man,whr2exp,minTemp,maxTemp,"
+	"volts1,volts2,amps1man,amps1exp,bat1percent,bat1charged,"
+	"bat2percent,bat2charged";
+
 // Constructs a PeriodicLoggedValue from a linked list of PMPeriodicRecord
 // structs, as returned by libpmcomm
 PeriodicLoggedValue::PeriodicLoggedValue(struct PMPeriodicRecord *records) {
 	loggedType = TYPE_PERIODIC;
 
-	while(records) {
-		rs.prepend(*records);
-		records = records->next;
-	}
+	setRecords(records);
 	initialized = true;
 }
 
-// Constructs a PeriodicLoggedValue from a particular download in the database
-PeriodicLoggedValue::PeriodicLoggedValue(QSqlDatabase db, int downloadid) {
+// Constructs a PeriodicLoggedValue from the records that a particular download added to the
+// database. legacyTable reads the whole download from the periodic table of schema version 2
+// instead, which is only needed to migrate it
+PeriodicLoggedValue::PeriodicLoggedValue(QSqlDatabase db, int downloadid, bool legacyTable) {
 	loggedType = TYPE_PERIODIC;
 
 	QSqlQuery query(db);
-	bool success = query.prepare("SELECT meastime,"
-		"ahr1man,ahr1exp,ahr2man,ahr2exp,ahr3man,ahr3exp,"
-		"whr1man,whr1exp,whr2man,whr2exp,minTemp,maxTemp,"
-		"volts1,volts2,amps1man,amps1exp,bat1percent,bat1charged,"
-		"bat2percent,bat2charged FROM periodic WHERE downloadid = "
-		":downloadid ORDER BY recordid ASC;");
+	prepareCursor(query, true);
+	bool success;
+	if(legacyTable) {
+		success = query.prepare(QString("SELECT %1,0 FROM periodic WHERE downloadid = "
+			":downloadid ORDER BY recordid ASC;").arg(periodicSelectColumns));
+	} else {
+		success = query.prepare(QString("SELECT %1,gap FROM periodic_timeline WHERE downloadid = "
+			":downloadid ORDER BY abstime ASC;").arg(periodicSelectColumns));
+	}
 
 	if(!success)
 		return;
@@ -87,346 +125,437 @@ PeriodicLoggedValue::PeriodicLoggedValue(QSqlDatabase db, int downloadid) {
 		return;
 
 	while(query.next()) {
-		PMPeriodicRecord curr;
-		memset(&curr, 0, sizeof(PMPeriodicRecord));
-
-		curr.measTime = query.value(0).toInt();
-		if(!query.value(1).isNull()) {
-			curr.ahr1.mantissa = query.value(1).toInt();
-			curr.ahr1.exponent = query.value(2).toInt();
-			curr.validData |= PM_PERIODIC_AHR1_VALID;
-		}
-		if(!query.value(3).isNull()) {
-			curr.ahr2.mantissa = query.value(3).toInt();
-			curr.ahr2.exponent = query.value(4).toInt();
-			curr.validData |= PM_PERIODIC_AHR2_VALID;
-		}
-		if(!query.value(5).isNull()) {
-			curr.ahr3.mantissa = query.value(5).toInt();
-			curr.ahr3.exponent = query.value(6).toInt();
-			curr.validData |= PM_PERIODIC_AHR3_VALID;
-		}
-		if(!query.value(7).isNull()) {
-			curr.whr1.mantissa = query.value(7).toInt();
-			curr.whr1.exponent = query.value(8).toInt();
-			curr.validData |= PM_PERIODIC_WHR1_VALID;
-		}
-		if(!query.value(9).isNull()) {
-			curr.whr2.mantissa = query.value(9).toInt();
-			curr.whr2.exponent = query.value(10).toInt();
-			curr.validData |= PM_PERIODIC_WHR2_VALID;
-		}
-		if(!query.value(11).isNull()) {
-			curr.maxTemp = query.value(11).toInt();
-			curr.minTemp = query.value(12).toInt();
-			curr.validData |= PM_PERIODIC_TEMP_VALID;
-		}
-		if(!query.value(13).isNull()) {
-			curr.volts1 = query.value(13).toInt();
-			curr.validData |= PM_PERIODIC_VOLTS1_VALID;
-		}
-		if(!query.value(14).isNull()) {
-			curr.amps1.mantissa = query.value(14).toInt();
-			curr.amps1.exponent = query.value(15).toInt();
-			curr.validData |= PM_PERIODIC_AMPS1_VALID;
+		LoggedPeriodicRecord curr;
+		readRecord(query, curr);
+		if(query.value(21).toBool())
+			curr.validData |= LoggedPeriodicRecord::GAP;
+		rs.append(curr);
+	}
+	initialized = true;
+}
+
+// Constructs a PeriodicLoggedValue by decoding the unit's periodic data memory, as kept by setRawData()
+PeriodicLoggedValue::PeriodicLoggedValue(QByteArray raw) {
+	loggedType = TYPE_PERIODIC;
+
+	if(raw.size() != PM_PERIODIC_PTR_SIZE + PM_PERIODIC_RAW_SIZE)
+		return;
+
+	unsigned char *ptrBuffer = (unsigned char *) raw.data();
+	struct PMPeriodicRecord *records = NULL;
+	if(PMDecodePeriodicData(ptrBuffer + PM_PERIODIC_PTR_SIZE, ptrBuffer, &records) < 0)
+		return;
+
+	setRecords(records);
+	PMFreePeriodicData(records);
+
+	rawData = raw;
+	initialized = true;
+}
+
+// Copies the records from a linked list returned by libpmcomm, which is newest first
+void PeriodicLoggedValue::setRecords(struct PMPeriodicRecord *records) {
+	int n = 0;
+	for(struct PMPeriodicRecord *curr = records; curr; curr = curr->next) {
+		n++;
+	}
+	rs.resize(n);
+
+	for(struct PMPeriodicRecord *curr = records; curr; curr = curr->next) {
+		LoggedPeriodicRecord & packed = rs[--n];
+		memset(&packed, 0, sizeof(packed));
+		packed.measTime = curr->measTime;
+		packed.validData = curr->validData & LoggedPeriodicRecord::VALID_BITS;
+		const struct PMScientificValue *values[LoggedPeriodicRecord::N_SCIENTIFIC] = {
+			&curr->ahr1, &curr->ahr2, &curr->ahr3, &curr->whr1, &curr->whr2, &curr->amps1
+		};
+		for(int i = 0; i < LoggedPeriodicRecord::N_SCIENTIFIC; i++) {
+			packed.mantissa[i] = values[i]->mantissa;
+			packed.exponent[i] = values[i]->exponent;
 		}
-		if(!query.value(16).isNull()) {
-			curr.volts1 = query.value(16).toInt();
-			curr.validData |= PM_PERIODIC_VOLTS2_VALID;
+		packed.minTemp = curr->minTemp;
+		packed.maxTemp = curr->maxTemp;
+		packed.volts1 = curr->volts1;
+		packed.volts2 = curr->volts2;
+		packed.bat1Percent = curr->bat1Percent.percent;
+		packed.bat2Percent = curr->bat2Percent.percent;
+		if(curr->bat1Percent.charged)
+			packed.validData |= LoggedPeriodicRecord::BAT1_CHARGED;
+		if(curr->bat2Percent.charged)
+			packed.validData |= LoggedPeriodicRecord::BAT2_CHARGED;
+	}
+}
+
+// Reads a record from the current row of a query that selected periodicSelectColumns first
+void PeriodicLoggedValue::readRecord(QSqlQuery & query, LoggedPeriodicRecord & curr) {
+	memset(&curr, 0, sizeof(curr));
+
+	curr.measTime = query.value(0).toInt();
+	const int validBits[] = {
+		PM_PERIODIC_AHR1_VALID, PM_PERIODIC_AHR2_VALID, PM_PERIODIC_AHR3_VALID,
+		PM_PERIODIC_WHR1_VALID, PM_PERIODIC_WHR2_VALID
+	};
+	for(int i = LoggedPeriodicRecord::AHR1; i <= LoggedPeriodicRecord::WHR2; i++) {
+		if(!query.value(1 + 2 * i).isNull()) {
+			curr.mantissa[i] = query.value(1 + 2 * i).toInt();
+			curr.exponent[i] = query.value(2 + 2 * i).toInt();
+			curr.validData |= validBits[i];
 		}
-		if(!query.value(17).isNull()) {
-			curr.bat1Percent.percent = query.value(17).toInt();
-			curr.bat1Percent.charged = query.value(18).toBool();
-			curr.bat2Percent.percent = query.value(19).toInt();
-			curr.bat2Percent.charged = query.value(20).toBool();
-			curr.validData |= PM_PERIODIC_BATTSTATE_VALID;
-		}	
+	}
+	if(!query.value(11).isNull()) {
+		curr.minTemp = query.value(11).toInt();
+		curr.maxTemp = query.value(12).toInt();
+		curr.validData |= PM_PERIODIC_TEMP_VALID;
+	}
+	if(!query.value(13).isNull()) {
+		curr.volts1 = query.value(13).toInt();
+		curr.validData |= PM_PERIODIC_VOLTS1_VALID;
+	}
+	if(!query.value(14).isNull()) {
+		curr.volts2 = query.value(14).toInt();
+		curr.validData |= PM_PERIODIC_VOLTS2_VALID;
+	}
+	if(!query.value(15).isNull()) {
+		curr.mantissa[LoggedPeriodicRecord::AMPS1] = query.value(15).toInt();
+		curr.exponent[LoggedPeriodicRecord::AMPS1] = query.value(16).toInt();
+		curr.validData |= PM_PERIODIC_AMPS1_VALID;
+	}
+	if(!query.value(17).isNull()) {
+		curr.bat1Percent = query.value(17).toInt();
+		curr.bat2Percent = query.value(19).toInt();
+		if(query.value(18).toBool())
+			curr.validData |= LoggedPeriodicRecord::BAT1_CHARGED;
+		if(query.value(20).toBool())
+			curr.validData |= LoggedPeriodicRecord::BAT2_CHARGED;
+		curr.validData |= PM_PERIODIC_BATTSTATE_VALID;
+	}
+}
 
-		rs.append(curr);
+// Returns the time a record was measured, in seconds since the epoch
+int64_t PeriodicLoggedValue::absoluteTime(const LoggedPeriodicRecord & record) {
+	Q_ASSERT(context);
+	return context->realTime + ((int) record.measTime - context->unitTime) * 60;
+}
+
+// Gets the time of the first record, or -1 if there are none
+int64_t PeriodicLoggedValue::startTime() {
+	return rs.empty() ? -1 : absoluteTime(rs.first());
+}
+
+// Finds the first row measured at or after time. The rows are in time order, so this is a
+// binary search
+int PeriodicLoggedValue::firstRowAt(int64_t time) {
+	int low = 0;
+	int high = rs.size();
+	while(low < high) {
+		int mid = low + (high - low) / 2;
+		if(absoluteTime(rs[mid]) < time)
+			low = mid + 1;
+		else
+			high = mid;
 	}
-	initialized = true;
+	return low;
 }
 
-// Determines if two periodic records are exactly equal
-bool PeriodicLoggedValue::rowsEqual(struct PMPeriodicRecord & one, struct PMPeriodicRecord & two) {
-	if(one.validData != two.validData || one.measTime != two.measTime)
-		return false;
-	if((one.validData & PM_PERIODIC_AHR1_VALID) && (one.ahr1.mantissa != two.ahr1.mantissa || one.ahr1.exponent != two.ahr1.exponent))
-		return false;
-	if((one.validData & PM_PERIODIC_AHR2_VALID) && (one.ahr2.mantissa != two.ahr2.mantissa || one.ahr2.exponent != two.ahr2.exponent))
-		return false;
-	if((one.validData & PM_PERIODIC_AHR3_VALID) && (one.ahr3.mantissa != two.ahr3.mantissa || one.ahr3.exponent != two.ahr3.exponent))
+// Determines if two periodic records are exactly equal. Whether a record follows a gap depends
+// on the records before it, so that isn't compared
+bool PeriodicLoggedValue::rowsEqual(const LoggedPeriodicRecord & one, const LoggedPeriodicRecord & two) {
+	int valid = one.validData & LoggedPeriodicRecord::VALID_BITS;
+	if(valid != (two.validData & LoggedPeriodicRecord::VALID_BITS) || one.measTime != two.measTime)
 		return false;
-	if((one.validData & PM_PERIODIC_WHR1_VALID) && (one.whr1.mantissa != two.whr1.mantissa || one.whr1.exponent != two.whr1.exponent))
-		return false;
-	if((one.validData & PM_PERIODIC_WHR2_VALID) && (one.whr2.mantissa != two.whr2.mantissa || one.whr2.exponent != two.whr2.exponent))
-		return false;
-	if((one.validData & PM_PERIODIC_TEMP_VALID) && (one.minTemp != two.minTemp || one.maxTemp != two.maxTemp))
-		return false;
-	if((one.validData & PM_PERIODIC_VOLTS1_VALID) && (one.volts1 != two.volts1))
+
+	const int validBits[LoggedPeriodicRecord::N_SCIENTIFIC] = {
+		PM_PERIODIC_AHR1_VALID, PM_PERIODIC_AHR2_VALID, PM_PERIODIC_AHR3_VALID,
+		PM_PERIODIC_WHR1_VALID, PM_PERIODIC_WHR2_VALID, PM_PERIODIC_AMPS1_VALID
+	};
+	for(int i = 0; i < LoggedPeriodicRecord::N_SCIENTIFIC; i++) {
+		if((valid & validBits[i]) && (one.mantissa[i] != two.mantissa[i] || one.exponent[i] != two.exponent[i]))
+			return false;
+	}
+	if((valid & PM_PERIODIC_TEMP_VALID) && (one.minTemp != two.minTemp || one.maxTemp != two.maxTemp))
 		return false;
-	if((one.validData & PM_PERIODIC_VOLTS2_VALID) && (one.volts2 != two.volts2))
+	if((valid & PM_PERIODIC_VOLTS1_VALID) && (one.volts1 != two.volts1))
 		return false;
-	if((one.validData & PM_PERIODIC_AMPS1_VALID) && (one.amps1.mantissa != two.amps1.mantissa || one.amps1.exponent != two.amps1.exponent))
+	if((valid & PM_PERIODIC_VOLTS2_VALID) && (one.volts2 != two.volts2))
 		return false;
-	if((one.validData & PM_PERIODIC_BATTSTATE_VALID) && (one.bat1Percent.percent != two.bat1Percent.percent || one.bat1Percent.charged != two.bat1Percent.charged))
+
+	int charged = LoggedPeriodicRecord::BAT1_CHARGED | LoggedPeriodicRecord::BAT2_CHARGED;
+	if((valid & PM_PERIODIC_BATTSTATE_VALID) && (one.bat1Percent != two.bat1Percent || one.bat2Percent != two.bat2Percent))
 		return false;
-	if((one.validData & PM_PERIODIC_BATTSTATE_VALID) && (one.bat2Percent.percent != two.bat2Percent.percent || one.bat2Percent.charged != two.bat2Percent.charged))
+	if((valid & PM_PERIODIC_BATTSTATE_VALID) && (one.validData & charged) != (two.validData & charged))
 		return false;
 	return true;
 }
 
 // Writes the headers for periodic data to a file
-void PeriodicLoggedValue::writeHeadersToFile(QTextStream & loggedfile) {
+void PeriodicLoggedValue::writeHeadersToFile(LoggedFileWriter & out) {
 	Q_ASSERT(context);
 
 	PMLabels & labels = context->labels;
-	loggedfile << "Date Time,";
-	loggedfile << SiteManager::getLabelStatic(PM_D13, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D14, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D15, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D20, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D21, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D28, labels) << " Min,";
-	loggedfile << SiteManager::getLabelStatic(PM_D28, labels) << " Max,";
-	loggedfile << SiteManager::getLabelStatic(PM_D3, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D10, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D4, labels) << ",";
-	loggedfile << SiteManager::getLabelStatic(PM_D22, labels) << ",";
-	loggedfile << "Battery 1 Charged,";
-	loggedfile << SiteManager::getLabelStatic(PM_D23, labels) << ",";
-	loggedfile << "Battery 2 Charged,";
-	loggedfile << endl;
-}
-
-// Writes a set of PeriodicLoggedValue objects, which should comprise a continuous record,
-// to a file
-bool PeriodicLoggedValue::writeGroupToFile(QList<PeriodicLoggedValue *> values, QString filename) {
-	QFile lf(filename);
-	if(!lf.open(QIODevice::WriteOnly | QIODevice::Text))
-		return false;
-	QTextStream loggedfile(&lf);
-
-	values.last()->writeHeadersToFile(loggedfile);
+	out.addColumn("Date Time", LoggedFileWriter::COLUMN_TIME);
+	out.addColumn(SiteManager::getLabelStatic(PM_D13, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D14, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D15, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D20, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D21, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D28, labels) + " Min", LoggedFileWriter::COLUMN_TEMPERATURE);
+	out.addColumn(SiteManager::getLabelStatic(PM_D28, labels) + " Max", LoggedFileWriter::COLUMN_TEMPERATURE);
+	out.addColumn(SiteManager::getLabelStatic(PM_D3, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D10, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D4, labels), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D22, labels), LoggedFileWriter::COLUMN_INT);
+	out.addColumn("Battery 1 Charged", LoggedFileWriter::COLUMN_BOOL);
+	out.addColumn(SiteManager::getLabelStatic(PM_D23, labels), LoggedFileWriter::COLUMN_INT);
+	out.addColumn("Battery 2 Charged", LoggedFileWriter::COLUMN_BOOL);
+	out.endHeader();
+}
 
-	for(int i = 0; i < values.size(); i++) {
-		int startRow = 0;
-		bool extraRow = false;
-		if(i != 0) {
-			startRow = values[i]->findMatchingRow(*values[i - 1], extraRow);
+// Writes the periodic records of a set of downloads, in the order they were made, out of the
+// database to a file. Records read from the timeline weren't stored before, so they are written
+// as they are read, with a spacer row wherever the timeline has a gap. Whole logs decoded from
+// raw memory start after the last record already written
+bool PeriodicLoggedValue::exportToFile(QSqlDatabase db, QList<LoggedData *> downloads, LoggedFileWriter & out) {
+	PeriodicLoggedValue cursor((struct PMPeriodicRecord *) NULL); // Writes the records read from the timeline
+	cursor.setContext(downloads.last());
+	cursor.writeHeadersToFile(out);
+
+	bool wroteRows = false;
+	LoggedPeriodicRecord last;
+	int64_t lastTime = 0;
+	for(int i = 0; i < downloads.size(); i++) {
+		LoggedData *download = downloads[i];
+
+		QByteArray raw = readRawData(db, download->downloadId, TYPE_PERIODIC);
+		if(!raw.isEmpty()) {
+			PeriodicLoggedValue value(raw);
+			if(!value.isValid())
+				return false;
+			value.setContext(download);
+
+			int startRow = 0;
+			bool gap = false;
+			if(wroteRows)
+				startRow = value.findNewRows(last, lastTime, gap);
+			if(startRow >= value.rs.size())
+				continue;
+
+			if(wroteRows && gap) {
+				out.spacerRow();
+			}
+			value.writeRowsToFile(out, startRow, value.rs.size());
+			wroteRows = true;
+			last = value.rs.last();
+			lastTime = value.absoluteTime(last);
+			continue;
 		}
 
-		int endRow = values[i]->rs.size();
-		if(startRow < endRow && extraRow) {
-			loggedfile << ",,,,,,,,,,,,,," << endl;
-		}
+		QSqlQuery query(db);
+		prepareCursor(query, true);
+		bool success = query.prepare(QString("SELECT %1,gap FROM periodic_timeline WHERE downloadid = "
+			":downloadid ORDER BY abstime ASC;").arg(periodicSelectColumns));
+		query.bindValue(":downloadid", download->downloadId);
+		if(!success || !query.exec())
+			return false;
 
-		values[i]->writeRowsToFile(loggedfile, startRow, endRow);
+		cursor.setContext(download);
+		while(query.next()) {
+			LoggedPeriodicRecord curr;
+			readRecord(query, curr);
+			int64_t currTime = cursor.absoluteTime(curr);
+			if(wroteRows && currTime <= lastTime)
+				continue;
+
+			if(wroteRows && query.value(21).toBool()) {
+				out.spacerRow();
+			}
+			cursor.writeRecordToFile(out, curr);
+			wroteRows = true;
+			last = curr;
+			lastTime = currTime;
+		}
 	}
 
-	return loggedfile.status() == QTextStream::Ok;
+	return true;
 }
 
-// Finds the row in this object that corresponds to the last row in previous.
-// If the times don't match up to show that the record was continuous (i.e. power was
-// lost), extraRow is set to true
-int PeriodicLoggedValue::findMatchingRow(PeriodicLoggedValue & previous, bool & extraRow) {
-	Q_ASSERT(context);
-	Q_ASSERT(previous.context);
-
-	if(previous.rs.empty())
-		return 0;
-
-	struct PMPeriodicRecord & prev = previous.rs.last();
+// Finds the first row in this object that is newer than last, the last record stored for the
+// site, which was measured at lastTime. If the times don't match up to show that the record was
+// continuous (i.e. power was lost), gap is set to true. Only the rows within
+// TIME_MATCH_THRESHOLD of lastTime can match, so only those are compared
+int PeriodicLoggedValue::findNewRows(const LoggedPeriodicRecord & last, int64_t lastTime, bool & gap) {
 	int startRow = 0;
 
-	uint64_t prevMeasTime = previous.context->realTime + ((int) prev.measTime - previous.context->unitTime) * 60;
-
 	// Search for matching time
-	extraRow = true; // True if a spacer row is to be inserted
-	uint64_t bestTimeDiff = 0;
+	gap = true;
+	int64_t bestTimeDiff = 0;
 	bool approxMatch = false;
-	for(int row = 0; row < rs.size(); row++) {
-		struct PMPeriodicRecord & curr = rs[row];
-		uint64_t currMeasTime = context->realTime + ((int) curr.measTime - context->unitTime) * 60;
-		uint64_t timeDiff = llabs(currMeasTime - prevMeasTime);
-		bool timeMatch = timeDiff <= TIME_MATCH_THRESHOLD;
-		if(rowsEqual(curr, prev)) {
+	for(int row = firstRowAt(lastTime - TIME_MATCH_THRESHOLD); row < rs.size(); row++) {
+		const LoggedPeriodicRecord & curr = rs[row];
+		int64_t currMeasTime = absoluteTime(curr);
+		if(currMeasTime > lastTime + TIME_MATCH_THRESHOLD)
+			break;
+
+		int64_t timeDiff = llabs(currMeasTime - lastTime);
+		if(rowsEqual(curr, last)) {
 			startRow = row + 1;
-			extraRow = !timeMatch;
+			gap = false;
 			break;
 		}
-		if(timeMatch && (!approxMatch || timeDiff < bestTimeDiff)) {
+		if(!approxMatch || timeDiff < bestTimeDiff) {
 			approxMatch = true;
 			bestTimeDiff = timeDiff;
-			startRow = row + (currMeasTime > prevMeasTime ? 0 : 1);
+			startRow = row + (currMeasTime > lastTime ? 0 : 1);
 		}
 	}
 
-	return startRow;
+	// Whatever the match, nothing at or before the last stored record is new
+	return qMax(startRow, firstRowAt(lastTime + 1));
 }
 
 // Writes the data in this object to a file
 bool PeriodicLoggedValue::writeToFile(QString filename) {
-	QFile lf(filename);
-	if(!lf.open(QIODevice::WriteOnly | QIODevice::Text))
+	CsvWriter out(filename, LoggedFileWriter::currentSettings());
+	if(!out.open())
 		return false;
-	QTextStream loggedfile(&lf);
 
-	writeHeadersToFile(loggedfile);
+	writeHeadersToFile(out);
 
-	writeRowsToFile(loggedfile, 0, rs.size());
+	writeRowsToFile(out, 0, rs.size());
 
-	return loggedfile.status() == QTextStream::Ok;
+	return out.close();
 }
 
 // Writes specified rows of this object to a file
-void PeriodicLoggedValue::writeRowsToFile(QTextStream & loggedfile, int startRow, int endRow) {
+void PeriodicLoggedValue::writeRowsToFile(LoggedFileWriter & out, int startRow, int endRow) {
+	for(int i = startRow; i < endRow; i++) {
+		writeRecordToFile(out, rs[i]);
+	}
+}
+
+// Writes one record to a file, as a row
+void PeriodicLoggedValue::writeRecordToFile(LoggedFileWriter & out, const LoggedPeriodicRecord & curr) {
 	Q_ASSERT(context);
 
-	for(int i = startRow; i < endRow; i++) {
-		struct PMPeriodicRecord & curr = rs[i];
-
-		int64_t measTime = context->realTime + ((int) curr.measTime - context->unitTime) * 60;
-		QDateTime localTime = QDateTime::fromTime_t(measTime).toLocalTime();
-		QString formattedTime = localTime.toString("MM/dd/yyyy hh:mm");
-
-		loggedfile << formattedTime;
-		loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_AHR1_VALID) {
-	    	LoggedDisplayValue value(PM_D13, curr.ahr1);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_AHR2_VALID) {
-	    	LoggedDisplayValue value(PM_D14, curr.ahr2);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_AHR3_VALID) {
-	    	LoggedDisplayValue value(PM_D15, curr.ahr3);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_WHR1_VALID) {
-	    	LoggedDisplayValue value(PM_D20, curr.whr1);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_WHR2_VALID) {
-	    	LoggedDisplayValue value(PM_D21, curr.whr2);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_TEMP_VALID) {
-	    	LoggedDisplayValue valueMin(PM_D28, curr.minTemp);
-	     	loggedfile << valueMin.toString() << ",";
-	    	LoggedDisplayValue valueMax(PM_D28, curr.maxTemp);
-	     	loggedfile << valueMax.toString();
-	    } else {
-	    	loggedfile << ",";
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_VOLTS1_VALID) {
-	    	LoggedDisplayValue value(PM_D3, curr.volts1);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_AMPS1_VALID) {
-	    	LoggedDisplayValue value(PM_D10, curr.amps1);
-	    	value.setPrecision((context->shuntTypes & 1) ? 2 : 1);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_VOLTS2_VALID) {
-	    	LoggedDisplayValue value(PM_D4, curr.volts2);
-	     	loggedfile << value.toString();
-	    }
-	    loggedfile << ",";
-	    if(curr.validData & PM_PERIODIC_BATTSTATE_VALID) {
-	    	LoggedDisplayValue valueB1(PM_D22, curr.bat1Percent.percent);
-	     	loggedfile << valueB1.toString() << ",";
-	     	loggedfile << (curr.bat1Percent.charged ? "TRUE" : "FALSE") << ",";
-	    	LoggedDisplayValue valueB2(PM_D23, curr.bat2Percent.percent);
-	     	loggedfile << valueB2.toString() << ",";
-	     	loggedfile << (curr.bat2Percent.charged ? "TRUE" : "FALSE");
-	    } else {
-	    	loggedfile << ",,,";
-	    }
-	    loggedfile << endl;
+	out.appendTime(absoluteTime(curr));
+	const int validBits[] = {
+		PM_PERIODIC_AHR1_VALID, PM_PERIODIC_AHR2_VALID, PM_PERIODIC_AHR3_VALID,
+		PM_PERIODIC_WHR1_VALID, PM_PERIODIC_WHR2_VALID
+	};
+	for(int i = LoggedPeriodicRecord::AHR1; i <= LoggedPeriodicRecord::WHR2; i++) {
+		if(curr.validData & validBits[i])
+			out.appendDecimal(curr.mantissa[i] * LoggedFileWriter::powerOf10(curr.exponent[i]), i <= LoggedPeriodicRecord::AHR3 ? 2 : 0, 0);
+		else
+			out.skip();
+	}
+	if(curr.validData & PM_PERIODIC_TEMP_VALID) {
+		out.appendTemperature(curr.minTemp);
+		out.appendTemperature(curr.maxTemp);
+	} else {
+		out.skip();
+		out.skip();
 	}
+	if(curr.validData & PM_PERIODIC_VOLTS1_VALID)
+		out.appendDecimal(curr.volts1 / 10.0, 1, 4);
+	else
+		out.skip();
+	if(curr.validData & PM_PERIODIC_AMPS1_VALID) {
+		double amps = curr.mantissa[LoggedPeriodicRecord::AMPS1] * LoggedFileWriter::powerOf10(curr.exponent[LoggedPeriodicRecord::AMPS1]);
+		out.appendDecimal(amps, (context->shuntTypes & 1) ? 2 : 1, 3);
+	} else {
+		out.skip();
+	}
+	if(curr.validData & PM_PERIODIC_VOLTS2_VALID)
+		out.appendDecimal(curr.volts2 / 10.0, 1, 4);
+	else
+		out.skip();
+	if(curr.validData & PM_PERIODIC_BATTSTATE_VALID) {
+		out.appendInt(curr.bat1Percent);
+		out.appendBool(curr.validData & LoggedPeriodicRecord::BAT1_CHARGED);
+		out.appendInt(curr.bat2Percent);
+		out.appendBool(curr.validData & LoggedPeriodicRecord::BAT2_CHARGED);
+	} else {
+		out.skip();
+		out.skip();
+		out.skip();
+		out.skip();
+	}
+	out.endRow();
 }
 
-// Writes the data in this object to the database using a specified downloadid
+// Adds the records in this object that are newer than the site's timeline to the database,
+// using a specified downloadid. The columns are bound as lists and inserted with a single execBatch()
 bool PeriodicLoggedValue::writeToDB(QSqlDatabase db, int downloadid) {
+	Q_ASSERT(context);
+
+	int siteId = context->siteId;
 	QSqlQuery query(db);
-	bool success = query.prepare("INSERT INTO periodic (downloadid,recordid,meastime,"
+	bool success = query.prepare(QString("SELECT %1,abstime FROM periodic_timeline WHERE siteid = :siteid "
+		"ORDER BY abstime DESC LIMIT 1;").arg(periodicSelectColumns));
+	query.bindValue(":siteid", siteId);
+	if(!success || !query.exec())
+		return false;
+
+	int startRow = 0;
+	bool gap = false;
+	if(query.next()) {
+		LoggedPeriodicRecord last;
+		readRecord(query, last);
+		startRow = findNewRows(last, query.value(21).toLongLong(), gap);
+	}
+	query.finish();
+
+	if(startRow >= rs.size())
+		return true;
+
+	success = query.prepare("INSERT OR IGNORE INTO periodic_timeline (siteid,abstime,downloadid,gap,meastime,"
 		"ahr1man,ahr1exp,ahr2man,ahr2exp,ahr3man,ahr3exp,"
 		"whr1man,whr1exp,whr2man,whr2exp,minTemp,maxTemp,"
 		"volts1,volts2,amps1man,amps1exp,bat1percent,bat1charged,"
-		"bat2percent,bat2charged) VALUES (:downloadid,:recordid,:meastime,"
-		":ahr1man,:ahr1exp,:ahr2man,:ahr2exp,:ahr3man,:ahr3exp,"
-		":whr1man,:whr1exp,:whr2man,:whr2exp,:minTemp,:maxTemp,"
-		":volts1,:volts2,:amps1man,:amps1exp,:bat1percent,:bat1charged,"
-		":bat2percent,:bat2charged);");
+		"bat2percent,bat2charged) VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);");
 
 	if(!success)
 		return false;
 
-	for(int i = 0; i < rs.size(); i++) {
-		struct PMPeriodicRecord  & curr = rs[i];
-
-		query.bindValue(":downloadid", downloadid);
-		query.bindValue(":recordid", i+1);
-		query.bindValue(":meastime", curr.measTime);
-
-    	QVariant ahr1man = (curr.validData & PM_PERIODIC_AHR1_VALID) ? QVariant(curr.ahr1.mantissa) : QVariant();
-    	QVariant ahr1exp = (curr.validData & PM_PERIODIC_AHR1_VALID) ? QVariant(curr.ahr1.exponent) : QVariant();
-     	QVariant ahr2man = (curr.validData & PM_PERIODIC_AHR2_VALID) ? QVariant(curr.ahr2.mantissa) : QVariant();
-    	QVariant ahr2exp = (curr.validData & PM_PERIODIC_AHR2_VALID) ? QVariant(curr.ahr2.exponent) : QVariant();
-    	QVariant ahr3man = (curr.validData & PM_PERIODIC_AHR3_VALID) ? QVariant(curr.ahr3.mantissa) : QVariant();
-    	QVariant ahr3exp = (curr.validData & PM_PERIODIC_AHR3_VALID) ? QVariant(curr.ahr3.exponent) : QVariant();
-    	QVariant whr1man = (curr.validData & PM_PERIODIC_WHR1_VALID) ? QVariant(curr.whr1.mantissa) : QVariant();
-    	QVariant whr1exp = (curr.validData & PM_PERIODIC_WHR1_VALID) ? QVariant(curr.whr1.exponent) : QVariant();
-    	QVariant whr2man = (curr.validData & PM_PERIODIC_WHR2_VALID) ? QVariant(curr.whr2.mantissa) : QVariant();
-    	QVariant whr2exp = (curr.validData & PM_PERIODIC_WHR2_VALID) ? QVariant(curr.whr2.exponent) : QVariant();
-    	QVariant maxTemp = (curr.validData & PM_PERIODIC_TEMP_VALID) ? QVariant(curr.maxTemp) : QVariant();
-    	QVariant minTemp = (curr.validData & PM_PERIODIC_TEMP_VALID) ? QVariant(curr.minTemp) : QVariant();
-    	QVariant volts1 = (curr.validData & PM_PERIODIC_VOLTS1_VALID) ? QVariant(curr.volts1) : QVariant();
-    	QVariant amps1man = (curr.validData & PM_PERIODIC_AMPS1_VALID) ? QVariant(curr.amps1.mantissa) : QVariant();
-    	QVariant amps1exp = (curr.validData & PM_PERIODIC_AMPS1_VALID) ? QVariant(curr.amps1.exponent) : QVariant();
-    	QVariant volts2 = (curr.validData & PM_PERIODIC_VOLTS2_VALID) ? QVariant(curr.volts2) : QVariant();
-    	QVariant bat1percent = (curr.validData & PM_PERIODIC_BATTSTATE_VALID) ? QVariant(curr.bat1Percent.percent) : QVariant();
-    	QVariant bat1charged = (curr.validData & PM_PERIODIC_BATTSTATE_VALID) ? QVariant((int) curr.bat1Percent.charged) : QVariant();
-    	QVariant bat2percent = (curr.validData & PM_PERIODIC_BATTSTATE_VALID) ? QVariant(curr.bat2Percent.percent) : QVariant();
-    	QVariant bat2charged = (curr.validData & PM_PERIODIC_BATTSTATE_VALID) ? QVariant((int) curr.bat2Percent.charged) : QVariant();
-
-		query.bindValue(":ahr1man", ahr1man);
-		query.bindValue(":ahr1exp", ahr1exp);
-		query.bindValue(":ahr2man", ahr2man);
-		query.bindValue(":ahr2exp", ahr2exp);
-		query.bindValue(":ahr3man", ahr3man);
-		query.bindValue(":ahr3exp", ahr3exp);
-		query.bindValue(":whr1man", whr1man);
-		query.bindValue(":whr1exp", whr1exp);
-		query.bindValue(":whr2man", whr2man);
-		query.bindValue(":whr2exp", whr2exp);
-		query.bindValue(":maxTemp", maxTemp);
-		query.bindValue(":minTemp", minTemp);
-		query.bindValue(":volts1", volts1);
-		query.bindValue(":amps1man", amps1man);
-		query.bindValue(":amps1exp", amps1exp);
-		query.bindValue(":volts2", volts2);
-		query.bindValue(":bat1percent", bat1percent);
-		query.bindValue(":bat1charged", bat1charged);
-		query.bindValue(":bat2percent", bat1percent);
-		query.bindValue(":bat2charged", bat1charged);
-
-		if(!query.exec())
-			return false;
+	enum { N_COLUMNS = 25 };
+	QVariantList columns[N_COLUMNS];
+	for(int c = 0; c < N_COLUMNS; c++) {
+		columns[c].reserve(rs.size() - startRow);
 	}
 
-	return true;
+	const QVariant null;
+	for(int i = startRow; i < rs.size(); i++) {
+		const LoggedPeriodicRecord & curr = rs[i];
+		int v = curr.validData;
+
+		columns[0] << siteId;
+		columns[1] << (qint64) absoluteTime(curr);
+		columns[2] << downloadid;
+		columns[3] << (int) (i == startRow && gap);
+		columns[4] << curr.measTime;
+		const int validBits[] = {
+			PM_PERIODIC_AHR1_VALID, PM_PERIODIC_AHR2_VALID, PM_PERIODIC_AHR3_VALID,
+			PM_PERIODIC_WHR1_VALID, PM_PERIODIC_WHR2_VALID
+		};
+		for(int f = LoggedPeriodicRecord::AHR1; f <= LoggedPeriodicRecord::WHR2; f++) {
+			columns[5 + 2 * f] << ((v & validBits[f]) ? QVariant(curr.mantissa[f]) : null);
+			columns[6 + 2 * f] << ((v & validBits[f]) ? QVariant(curr.exponent[f]) : null);
+		}
+		columns[15] << ((v & PM_PERIODIC_TEMP_VALID) ? QVariant(curr.minTemp) : null);
+		columns[16] << ((v & PM_PERIODIC_TEMP_VALID) ? QVariant(curr.maxTemp) : null);
+		columns[17] << ((v & PM_PERIODIC_VOLTS1_VALID) ? QVariant(curr.volts1) : null);
+		columns[18] << ((v & PM_PERIODIC_VOLTS2_VALID) ? QVariant(curr.volts2) : null);
+		columns[19] << ((v & PM_PERIODIC_AMPS1_VALID) ? QVariant(curr.mantissa[LoggedPeriodicRecord::AMPS1]) : null);
+		columns[20] << ((v & PM_PERIODIC_AMPS1_VALID) ? QVariant(curr.exponent[LoggedPeriodicRecord::AMPS1]) : null);
+		columns[21] << ((v & PM_PERIODIC_BATTSTATE_VALID) ? QVariant(curr.bat1Percent) : null);
+		columns[22] << ((v & PM_PERIODIC_BATTSTATE_VALID) ? QVariant((int) ((v & LoggedPeriodicRecord::BAT1_CHARGED) != 0)) : null);
+		columns[23] << ((v & PM_PERIODIC_BATTSTATE_VALID) ? QVariant(curr.bat2Percent) : null);
+		columns[24] << ((v & PM_PERIODIC_BATTSTATE_VALID) ? QVariant((int) ((v & LoggedPeriodicRecord::BAT2_CHARGED) != 0)) : null);
+	}
+
+	for(int c = 0; c < N_COLUMNS; c++) {
+		query.addBindValue(columns[c]);
+	}
+	return query.execBatch();
 }
 
 // Constructs a ProfileLoggedValue from a linked list of PMProfileRecord
@@ -434,13 +563,54 @@ bool PeriodicLoggedValue::writeToDB(QSqlDatabase db, int downloadid) {
 ProfileLoggedValue::ProfileLoggedValue(struct PMProfileRecord *records, int battery) {
 	loggedType = TYPE_PROFILE;
 	this->battery = battery;
-	while(records) {
-		rs.prepend(*records);
-		records = records->next;
-	}
+
+	setRecords(records);
 	initialized = true;	
 }
 
+// Constructs a ProfileLoggedValue for a particular battery by decoding the unit's
+// profile data memory, as kept by setRawData()
+ProfileLoggedValue::ProfileLoggedValue(QByteArray raw, int battery) {
+	loggedType = TYPE_PROFILE;
+	this->battery = battery;
+
+	if(raw.size() != PM_PROFILE_PTR_SIZE + PM_PROFILE_RAW_SIZE)
+		return;
+
+	unsigned char *ptrBuffer = (unsigned char *) raw.data();
+	struct PMProfileRecord *battery1Records = NULL, *battery2Records = NULL;
+	if(PMDecodeProfileData(ptrBuffer + PM_PROFILE_PTR_SIZE, ptrBuffer, &battery1Records, &battery2Records) < 0)
+		return;
+
+	setRecords((battery == 1) ? battery1Records : battery2Records);
+	PMFreeProfileData(battery1Records);
+	PMFreeProfileData(battery2Records);
+
+	rawData = raw;
+	initialized = true;
+}
+
+// Decodes the unit's profile data memory into the values of both batteries at once, instead of
+// decoding it once for each. Returns false if it can't be decoded
+bool ProfileLoggedValue::decodeRaw(QByteArray raw, ProfileLoggedValue *& battery1, ProfileLoggedValue *& battery2) {
+	battery1 = battery2 = NULL;
+	if(raw.size() != PM_PROFILE_PTR_SIZE + PM_PROFILE_RAW_SIZE)
+		return false;
+
+	unsigned char *ptrBuffer = (unsigned char *) raw.data();
+	struct PMProfileRecord *battery1Records = NULL, *battery2Records = NULL;
+	if(PMDecodeProfileData(ptrBuffer + PM_PROFILE_PTR_SIZE, ptrBuffer, &battery1Records, &battery2Records) < 0)
+		return false;
+
+	battery1 = new ProfileLoggedValue(battery1Records, 1);
+	battery2 = new ProfileLoggedValue(battery2Records, 2);
+	battery1->rawData = raw;
+	battery2->rawData = raw;
+	PMFreeProfileData(battery1Records);
+	PMFreeProfileData(battery2Records);
+	return true;
+}
+
 // Constructs a ProfileLoggedValue from a particular download in the database
 // for a particular battery
 ProfileLoggedValue::ProfileLoggedValue(QSqlDatabase db, int downloadid, int battery) {
@@ -448,6 +618,7 @@ ProfileLoggedValue::ProfileLoggedValue(QSqlDatabase db, int downloadid, int batt
 	this->battery = battery;
 
 	QSqlQuery query(db);
+	prepareCursor(query, true);
 	bool success = query.prepare("SELECT day,percent,volts,ampsman,ampsexp "
 		"FROM profile WHERE downloadid = :downloadid AND battery = :battery "
 		"ORDER BY recordid ASC;");
@@ -461,77 +632,111 @@ ProfileLoggedValue::ProfileLoggedValue(QSqlDatabase db, int downloadid, int batt
 		return;
 
 	while(query.next()) {
-		PMProfileRecord curr;
-		memset(&curr, 0, sizeof(PMProfileRecord));
+		LoggedProfileRecord curr;
+		memset(&curr, 0, sizeof(curr));
 
 		curr.day = query.value(0).toInt();
 		curr.percentFull = query.value(1).toInt();
 		curr.volts = query.value(2).toInt();
-		curr.amps.mantissa = query.value(3).toInt();
-		curr.amps.exponent = query.value(4).toInt();
+		curr.ampsMantissa = query.value(3).toInt();
+		curr.ampsExponent = query.value(4).toInt();
 		rs.append(curr);
 	}
 	initialized = true;
 }
 
+// Copies the records from a linked list returned by libpmcomm, which is newest first
+void ProfileLoggedValue::setRecords(struct PMProfileRecord *records) {
+	int n = 0;
+	for(struct PMProfileRecord *curr = records; curr; curr = curr->next) {
+		n++;
+	}
+	rs.resize(n);
+
+	for(struct PMProfileRecord *curr = records; curr; curr = curr->next) {
+		LoggedProfileRecord & packed = rs[--n];
+		memset(&packed, 0, sizeof(packed));
+		packed.day = curr->day;
+		packed.percentFull = curr->percentFull;
+		packed.volts = curr->volts;
+		packed.ampsMantissa = curr->amps.mantissa;
+		packed.ampsExponent = curr->amps.exponent;
+	}
+}
+
 // Determines if two profile records are exactly equal
-bool ProfileLoggedValue::rowsEqual(struct PMProfileRecord & one, struct PMProfileRecord & two) {
+bool ProfileLoggedValue::rowsEqual(const LoggedProfileRecord & one, const LoggedProfileRecord & two) {
 	if(one.day != two.day)
 		return false;
 	if(one.percentFull != two.percentFull)
 		return false;
 	if(one.volts != two.volts)
 		return false;
-	if(one.amps.mantissa != two.amps.mantissa || one.amps.exponent != two.amps.exponent)
+	if(one.ampsMantissa != two.ampsMantissa || one.ampsExponent != two.ampsExponent)
 		return false;
 	return true;
 }
 
 // Writes the headers for profile data to a file
-void ProfileLoggedValue::writeHeadersToFile(QTextStream & loggedfile) {
-	loggedfile << "Day,Percent Full,Filtered Volts,Filtered Amps" << endl;
+void ProfileLoggedValue::writeHeadersToFile(LoggedFileWriter & out) {
+	out.addColumn("Day", LoggedFileWriter::COLUMN_INT);
+	out.addColumn("Percent Full", LoggedFileWriter::COLUMN_INT);
+	out.addColumn("Filtered Volts", LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn("Filtered Amps", LoggedFileWriter::COLUMN_DECIMAL);
+	out.endHeader();
 }
 
 // Writes the data in this object to a file
 bool ProfileLoggedValue::writeToFile(QString filename) {
-	QFile lf(filename);
-	if(!lf.open(QIODevice::WriteOnly | QIODevice::Text))
+	CsvWriter out(filename, LoggedFileWriter::currentSettings());
+	if(!out.open())
 		return false;
-	QTextStream loggedfile(&lf);
 
-	writeHeadersToFile(loggedfile);
+	writeHeadersToFile(out);
 
-	writeRowsToFile(loggedfile, 0, rs.size());
+	writeRowsToFile(out, 0, rs.size());
 	
-	return loggedfile.status() == QTextStream::Ok;
+	return out.close();
 }
 
-// Writes a set of ProfileLoggedValue objects, which should comprise a continuous record,
-// to a file
-bool ProfileLoggedValue::writeGroupToFile(QList<ProfileLoggedValue *> values, QString filename) {
-	QFile lf(filename);
-	if(!lf.open(QIODevice::WriteOnly | QIODevice::Text))
-		return false;
-	QTextStream loggedfile(&lf);
+// Writes the profile records of a battery for a set of downloads, in the order they were made,
+// out of the database to a file. Each download is matched against the one before it, so only
+// those two are loaded at once
+bool ProfileLoggedValue::exportToFile(QSqlDatabase db, QList<LoggedData *> downloads, int battery, LoggedFileWriter & out) {
+	QSharedPointer<ProfileLoggedValue> previous;
+	for(int i = 0; i < downloads.size(); i++) {
+		QByteArray raw = readRawData(db, downloads[i]->downloadId, TYPE_PROFILE);
+		QSharedPointer<ProfileLoggedValue> value;
+		if(!raw.isEmpty())
+			value = QSharedPointer<ProfileLoggedValue>(new ProfileLoggedValue(raw, battery));
+		else
+			value = QSharedPointer<ProfileLoggedValue>(new ProfileLoggedValue(db, downloads[i]->downloadId, battery));
+		if(!value->isValid())
+			return false;
+		value->setContext(downloads[i]);
 
-	values.last()->writeHeadersToFile(loggedfile);
+		if(i == 0) {
+			ProfileLoggedValue header((struct PMProfileRecord *) NULL, battery);
+			header.setContext(downloads.last());
+			header.writeHeadersToFile(out);
+		}
 
-	for(int i = 0; i < values.size(); i++) {
 		int startRow = 0;
 		bool extraRow = false;
-		if(i != 0) {
-			startRow = values[i]->findMatchingRow(*values[i - 1], extraRow);
+		if(previous) {
+			startRow = value->findMatchingRow(*previous, extraRow);
 		}
 
-		int endRow = values[i]->rs.size();
+		int endRow = value->rs.size();
 		if(startRow < endRow && extraRow) {
-			loggedfile << ",,," << endl;
+			out.spacerRow();
 		}
 
-		values[i]->writeRowsToFile(loggedfile, startRow, endRow);
+		value->writeRowsToFile(out, startRow, endRow);
+		previous = value;
 	}
 
-	return loggedfile.status() == QTextStream::Ok;
+	return true;
 }
 
 // Finds the row in this object that corresponds to the last row in previous.
@@ -543,13 +748,13 @@ int ProfileLoggedValue::findMatchingRow(ProfileLoggedValue & previous, bool & ex
 	if(previous.rs.empty())
 		return 0;
 
-	struct PMProfileRecord & prev = previous.rs.last();
+	const LoggedProfileRecord & prev = previous.rs.last();
 	int startRow = 0;
 
 	// Search for matching row
 	extraRow = true; // True if a spacer row is to be inserted
 	for(int row = 0; row < rs.size(); row++) {
-		struct PMProfileRecord & curr = rs[row];
+		const LoggedProfileRecord & curr = rs[row];
 		if(rowsEqual(curr, prev)) {
 			startRow = row + 1;
 			extraRow = false;
@@ -561,49 +766,54 @@ int ProfileLoggedValue::findMatchingRow(ProfileLoggedValue & previous, bool & ex
 }
 
 // Writes specified rows of this object to a file
-void ProfileLoggedValue::writeRowsToFile(QTextStream & loggedfile, int startRow, int endRow) {
+void ProfileLoggedValue::writeRowsToFile(LoggedFileWriter & out, int startRow, int endRow) {
+	int ampsPrecision = (context->shuntTypes & (battery == 1 ? 1 : 2)) ? 2 : 1;
 	for(int i = startRow; i < endRow; i++) {
-	    struct PMProfileRecord & curr = rs[i];
+		const LoggedProfileRecord & curr = rs[i];
 
-	    loggedfile << (int) curr.day << ",";
-	    LoggedDisplayValue percentVal(PM_D22, curr.percentFull);
-	    loggedfile << percentVal.toString() << ",";
-    	LoggedDisplayValue voltsVal(PM_D3, curr.volts);
-     	loggedfile << voltsVal.toString() << ",";
-     	LoggedDisplayValue ampsVal(PM_D10, curr.amps);
-     	ampsVal.setPrecision((context->shuntTypes & (battery == 1 ? 1 : 2)) ? 2 : 1);
-	    loggedfile << ampsVal.toString();
-	    loggedfile << endl;
-	}	
+		out.appendInt(curr.day);
+		out.appendInt(curr.percentFull);
+		out.appendDecimal(curr.volts / 10.0, 1, 4);
+		out.appendDecimal(curr.ampsMantissa * LoggedFileWriter::powerOf10(curr.ampsExponent), ampsPrecision, 3);
+		out.endRow();
+	}
 }
 
 // Writes the data in this object to the database using a specified downloadid
 bool ProfileLoggedValue::writeToDB(QSqlDatabase db, int downloadid) {
+	if(rs.isEmpty())
+		return true;
+
 	QSqlQuery query(db);
 	bool success = query.prepare("INSERT INTO profile (downloadid,recordid,battery,"
-		"day,percent,volts,ampsman,ampsexp) VALUES (:downloadid,:recordid,:battery,"
-		":day,:percent,:volts,:ampsman,:ampsexp);");
+		"day,percent,volts,ampsman,ampsexp) VALUES (?,?,?,?,?,?,?,?);");
 
 	if(!success)
 		return false;
 
+	QVariantList downloadids, recordids, batteries, days, percents, volts, ampsmans, ampsexps;
 	for(int i = 0; i < rs.size(); i++) {
-		struct PMProfileRecord & curr = rs[i];
-
-		query.bindValue(":downloadid", downloadid);
-		query.bindValue(":recordid", i+i);
-		query.bindValue(":battery", battery);
-		query.bindValue(":day", curr.day);
-	    query.bindValue(":percent", curr.percentFull);
-	    query.bindValue(":volts", curr.volts);
-	    query.bindValue(":ampsman", curr.amps.mantissa);
-	    query.bindValue(":ampsexp", curr.amps.exponent);
-
-		if(!query.exec())
-			return false;
+		const LoggedProfileRecord & curr = rs[i];
+
+		downloadids << downloadid;
+		recordids << i+1;
+		batteries << battery;
+		days << curr.day;
+		percents << curr.percentFull;
+		volts << curr.volts;
+		ampsmans << curr.ampsMantissa;
+		ampsexps << curr.ampsExponent;
 	}
 
-	return true;	
+	query.addBindValue(downloadids);
+	query.addBindValue(recordids);
+	query.addBindValue(batteries);
+	query.addBindValue(days);
+	query.addBindValue(percents);
+	query.addBindValue(volts);
+	query.addBindValue(ampsmans);
+	query.addBindValue(ampsexps);
+	return query.execBatch();
 }
 
 // Constructs an EfficiencyLoggedValue from an array list of PMEfficiencyRecord
@@ -612,6 +822,7 @@ EfficiencyLoggedValue::EfficiencyLoggedValue(struct PMEfficiencyRecord *records,
 	loggedType = TYPE_EFFICIENCY;
 	this->battery = battery;
 
+	rs.reserve(nRecords);
 	for(int i = 0; i < nRecords; i++) {
 		rs.append(records[i]);
 	}
@@ -624,6 +835,7 @@ EfficiencyLoggedValue::EfficiencyLoggedValue(QSqlDatabase db, int downloadid, in
 	this->battery = battery;
 
 	QSqlQuery query(db);
+	prepareCursor(query, false); // efficiency and selfdischarge are REAL
 	bool success = query.prepare("SELECT endtime,valid,length,"
 		"discharge,charge,net,efficiency,selfdischarge FROM efficiency "
 		"WHERE downloadid = :downloadid AND battery = :battery ORDER BY recordid ASC;");
@@ -653,8 +865,29 @@ EfficiencyLoggedValue::EfficiencyLoggedValue(QSqlDatabase db, int downloadid, in
 	initialized = true;
 }
 
+// Returns the time a cycle ended, in seconds since the epoch
+int64_t EfficiencyLoggedValue::absoluteTime(const struct PMEfficiencyRecord & record) {
+	Q_ASSERT(context);
+	return context->realTime + ((int) record.endTime - context->unitTime) * 60;
+}
+
+// Finds the first row that ended at or after time. The rows are in time order, so this is a
+// binary search
+int EfficiencyLoggedValue::firstRowAt(int64_t time) {
+	int low = 0;
+	int high = rs.size();
+	while(low < high) {
+		int mid = low + (high - low) / 2;
+		if(absoluteTime(rs[mid]) < time)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
 // Determines if two efficiency records are exactly equal
-bool EfficiencyLoggedValue::rowsEqual(struct PMEfficiencyRecord & one, struct PMEfficiencyRecord & two) {
+bool EfficiencyLoggedValue::rowsEqual(const struct PMEfficiencyRecord & one, const struct PMEfficiencyRecord & two) {
 	if(one.validData != two.validData || one.endTime != two.endTime)
 		return false;
 	if(one.ahrCharge != two.ahrCharge)
@@ -667,111 +900,126 @@ bool EfficiencyLoggedValue::rowsEqual(struct PMEfficiencyRecord & one, struct PM
 }
 
 // Writes the headers for efficiency data to a file
-void EfficiencyLoggedValue::writeHeadersToFile(QTextStream & loggedfile) {
-	loggedfile << "Date Time,Valid,Cycle Hrs,Dis AHrs,Chrg AHrs,Net AHrs,Chrg Eff,Self DisChrg";
-	int interval = AppSettings::getInstance()->getEfficiencyAverageInterval();
-	loggedfile << "," << interval << " Cycle Chrg Eff," << interval << " Cycle Self DisChrg" << endl;
+void EfficiencyLoggedValue::writeHeadersToFile(LoggedFileWriter & out) {
+	out.addColumn("Date Time", LoggedFileWriter::COLUMN_TIME);
+	out.addColumn("Valid", LoggedFileWriter::COLUMN_BOOL);
+	out.addColumn("Cycle Hrs", LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn("Dis AHrs", LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn("Chrg AHrs", LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn("Net AHrs", LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn("Chrg Eff", LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn("Self DisChrg", LoggedFileWriter::COLUMN_DECIMAL);
+	int interval = out.averageInterval();
+	out.addColumn(QString("%1 Cycle Chrg Eff").arg(interval), LoggedFileWriter::COLUMN_DECIMAL);
+	out.addColumn(QString("%1 Cycle Self DisChrg").arg(interval), LoggedFileWriter::COLUMN_DECIMAL);
+	out.endHeader();
 }
 
 // Writes specified rows of this object to a file
-void EfficiencyLoggedValue::writeRowsToFile(QTextStream & loggedfile, int startRow, int endRow, QList<struct PMEfficiencyRecord *> & lastFewRows) {
-	int avgInterval = AppSettings::getInstance()->getEfficiencyAverageInterval();
+void EfficiencyLoggedValue::writeRowsToFile(LoggedFileWriter & out, int startRow, int endRow, QList<struct PMEfficiencyRecord> & lastFewRows) {
+	int avgInterval = out.averageInterval();
 	for(int i = startRow; i < endRow; i++) {
-		struct PMEfficiencyRecord & curr = rs[i];
+		const struct PMEfficiencyRecord & curr = rs[i];
 
 		while(lastFewRows.size() >= avgInterval)
 			lastFewRows.removeFirst();
 
-		int64_t measTime = context->realTime + ((int) curr.endTime - context->unitTime) * 60;
-		QDateTime localTime = QDateTime::fromTime_t(measTime).toLocalTime();
-		QString formattedTime = localTime.toString("MM/dd/yyyy hh:mm");
-
-		loggedfile << formattedTime << ",";
-		loggedfile << (curr.validData ? "TRUE" : "FALSE") << ",";
+		out.appendTime(absoluteTime(curr));
+		out.appendBool(curr.validData);
 		if(curr.validData) {
-			loggedfile << fixed << qSetRealNumberPrecision(2) << curr.cycleMinutes / 60.0 << ",";
-			loggedfile << fixed << qSetRealNumberPrecision(2) << curr.ahrDischarge / -100.0 << ",";
-			loggedfile << fixed << qSetRealNumberPrecision(2) << curr.ahrCharge / 100.0 << ",";
-			loggedfile << fixed << qSetRealNumberPrecision(2) << curr.ahrNet / 100.0 << ",";
-			loggedfile << fixed << qSetRealNumberPrecision(2) << curr.efficiency << ",";
-			loggedfile << fixed << qSetRealNumberPrecision(2) << curr.selfDischarge << ",";
+			out.appendFixed(curr.cycleMinutes / 60.0, 2);
+			out.appendFixed(curr.ahrDischarge / -100.0, 2);
+			out.appendFixed(curr.ahrCharge / 100.0, 2);
+			out.appendFixed(curr.ahrNet / 100.0, 2);
+			out.appendFixed(curr.efficiency, 2);
+			out.appendFixed(curr.selfDischarge, 2);
 
 			// Append only if the row is good
-			lastFewRows.append(&rs[i]);
+			lastFewRows.append(curr);
 			if(lastFewRows.size() == avgInterval) {
 				// Compute the average
 				int totalMinutes = 0;
 				int totalDischarge = 0;
 				int totalCharge = 0;
-				foreach(struct PMEfficiencyRecord *currAvg, lastFewRows) {
-					totalMinutes += currAvg->cycleMinutes;
-					totalDischarge += currAvg->ahrDischarge;
-					totalCharge += currAvg->ahrCharge;
+				foreach(const struct PMEfficiencyRecord & currAvg, lastFewRows) {
+					totalMinutes += currAvg.cycleMinutes;
+					totalDischarge += currAvg.ahrDischarge;
+					totalCharge += currAvg.ahrCharge;
 				}
 				double avgEfficiency = (double) totalDischarge * 100.0 / totalCharge;
 				int totalNet = totalCharge - totalDischarge;
 				double avgDischarege = ((double) totalNet / 100) / (totalMinutes / 60.0);
 
-				loggedfile << fixed << qSetRealNumberPrecision(2) << avgEfficiency << ",";
-				loggedfile << fixed << qSetRealNumberPrecision(2) << avgDischarege;
+				out.appendFixed(avgEfficiency, 2);
+				out.appendFixed(avgDischarege, 2);
 			} else {
-				loggedfile << ",";
+				out.skip();
+				out.skip();
 			}
 		} else {
-			loggedfile << ",,,,,,,";
+			for(int col = 0; col < 8; col++) {
+				out.skip();
+			}
 		}
-		loggedfile << endl;
+		out.endRow();
 	}
 }
 
 // Writes the data in this object to a file
 bool EfficiencyLoggedValue::writeToFile(QString filename) {
-	QFile lf(filename);
-	if(!lf.open(QIODevice::WriteOnly | QIODevice::Text))
+	CsvWriter out(filename, LoggedFileWriter::currentSettings());
+	if(!out.open())
 		return false;
-	QTextStream loggedfile(&lf);
 
-	writeHeadersToFile(loggedfile);
+	writeHeadersToFile(out);
 	
-	QList<struct PMEfficiencyRecord *> dummy;
-	writeRowsToFile(loggedfile, 0, rs.size(), dummy);
+	QList<struct PMEfficiencyRecord> dummy;
+	writeRowsToFile(out, 0, rs.size(), dummy);
 
-	return loggedfile.status() == QTextStream::Ok;
+	return out.close();
 }
 
-// Writes a set of EfficiencyLoggedValue objects, which should comprise a continuous record,
-// to a file
-bool EfficiencyLoggedValue::writeGroupToFile(QList<EfficiencyLoggedValue *> values, QString filename) {
-	QFile lf(filename);
-	if(!lf.open(QIODevice::WriteOnly | QIODevice::Text))
-		return false;
-	QTextStream loggedfile(&lf);
+// Writes the efficiency records of a battery for a set of downloads, in the order they were made,
+// out of the database to a file. Each download is matched against the one before it, so only
+// those two are loaded at once
+bool EfficiencyLoggedValue::exportToFile(QSqlDatabase db, QList<LoggedData *> downloads, int battery, LoggedFileWriter & out) {
+	QSharedPointer<EfficiencyLoggedValue> previous;
+	QList<struct PMEfficiencyRecord> lastFewRows; // Used to allow averaging over multiple downloads
+	for(int i = 0; i < downloads.size(); i++) {
+		QSharedPointer<EfficiencyLoggedValue> value(new EfficiencyLoggedValue(db, downloads[i]->downloadId, battery));
+		if(!value->isValid())
+			return false;
+		value->setContext(downloads[i]);
 
-	values.last()->writeHeadersToFile(loggedfile);
+		if(i == 0) {
+			EfficiencyLoggedValue header(NULL, 0, battery);
+			header.setContext(downloads.last());
+			header.writeHeadersToFile(out);
+		}
 
-	QList<struct PMEfficiencyRecord *> lastFewRows; // Used to allow averaging over multiple downloads
-	for(int i = 0; i < values.size(); i++) {
 		int startRow = 0;
 		bool extraRow = false;
-		if(i != 0) {
-			startRow = values[i]->findMatchingRow(*values[i - 1], extraRow);
+		if(previous) {
+			startRow = value->findMatchingRow(*previous, extraRow);
 		}
 
-		int endRow = values[i]->rs.size();
+		int endRow = value->rs.size();
 		if(startRow < endRow && extraRow) {
-			loggedfile << ",,,,,,,,," << endl;
+			out.spacerRow();
 			lastFewRows.clear(); // Don't keep data around if there is a gap
 		}
 
-		values[i]->writeRowsToFile(loggedfile, startRow, endRow, lastFewRows);
+		value->writeRowsToFile(out, startRow, endRow, lastFewRows);
+		previous = value;
 	}
 
-	return loggedfile.status() == QTextStream::Ok;
+	return true;
 }
 
 // Finds the row in this object that corresponds to the last row in previous.
 // If the times don't match up to show that the record was continuous (i.e. power was
-// lost), extraRow is set to true
+// lost), extraRow is set to true. Only the rows within TIME_MATCH_THRESHOLD of the last row
+// in previous can match, so only those are compared
 int EfficiencyLoggedValue::findMatchingRow(EfficiencyLoggedValue & previous, bool & extraRow) {
 	Q_ASSERT(context);
 	Q_ASSERT(previous.context);
@@ -779,26 +1027,28 @@ int EfficiencyLoggedValue::findMatchingRow(EfficiencyLoggedValue & previous, boo
 	if(previous.rs.empty())
 		return 0;
 
-	struct PMEfficiencyRecord & prev = previous.rs.last();
+	const struct PMEfficiencyRecord & prev = previous.rs.last();
 	int startRow = 0;
 
-	uint64_t prevMeasTime = previous.context->realTime + ((int) prev.endTime - previous.context->unitTime) * 60;
+	int64_t prevMeasTime = previous.absoluteTime(prev);
 
 	// Search for matching time
 	extraRow = true; // True if a spacer row is to be inserted
-	uint64_t bestTimeDiff = 0;
+	int64_t bestTimeDiff = 0;
 	bool approxMatch = false;
-	for(int row = 0; row < rs.size(); row++) {
-		struct PMEfficiencyRecord & curr = rs[row];
-		uint64_t currMeasTime = context->realTime + ((int) curr.endTime - context->unitTime) * 60;
-		uint64_t timeDiff = llabs(currMeasTime - prevMeasTime);
-		bool timeMatch = timeDiff <= TIME_MATCH_THRESHOLD;
+	for(int row = firstRowAt(prevMeasTime - TIME_MATCH_THRESHOLD); row < rs.size(); row++) {
+		const struct PMEfficiencyRecord & curr = rs[row];
+		int64_t currMeasTime = absoluteTime(curr);
+		if(currMeasTime > prevMeasTime + TIME_MATCH_THRESHOLD)
+			break;
+
+		int64_t timeDiff = llabs(currMeasTime - prevMeasTime);
 		if(rowsEqual(curr, prev)) {
 			startRow = row + 1;
-			extraRow = !timeMatch;
+			extraRow = false;
 			break;
 		}
-		if(timeMatch && (!approxMatch || timeDiff < bestTimeDiff)) {
+		if(!approxMatch || timeDiff < bestTimeDiff) {
 			approxMatch = true;
 			bestTimeDiff = timeDiff;
 			startRow = row + (currMeasTime > prevMeasTime ? 0 : 1);
@@ -810,35 +1060,45 @@ int EfficiencyLoggedValue::findMatchingRow(EfficiencyLoggedValue & previous, boo
 
 // Writes the data in this object to the database using a specified downloadid
 bool EfficiencyLoggedValue::writeToDB(QSqlDatabase db, int downloadid) {
+	if(rs.isEmpty())
+		return true;
+
 	QSqlQuery query(db);
 	bool success = query.prepare("INSERT INTO efficiency (downloadid,recordid,battery,"
 		"endtime,valid,length,discharge,charge,net,"
-		"efficiency,selfdischarge) VALUES (:downloadid,:recordid,:battery,"
-		":endtime,:valid,:length,:discharge,:charge,:net,"
-		":efficiency,:selfdischarge);");
+		"efficiency,selfdischarge) VALUES (?,?,?,?,?,?,?,?,?,?,?);");
 
 	if(!success)
 		return false;
 
+	QVariantList downloadids, recordids, batteries, endtimes, valids, lengths, discharges, charges, nets, efficiencies, selfdischarges;
 	for(int i = 0; i < rs.size(); i++) {
-		struct PMEfficiencyRecord  & curr = rs[i];
-
-	    query.bindValue(":downloadid", downloadid);
-	    query.bindValue(":recordid", i+1);
-	    query.bindValue(":battery", battery);
-	    query.bindValue(":endtime", curr.endTime);
-	    query.bindValue(":valid", (int) curr.validData);
-	    query.bindValue(":length", curr.cycleMinutes);
-	    query.bindValue(":discharge", curr.ahrDischarge);
-	    query.bindValue(":charge", curr.ahrCharge);
-	    query.bindValue(":net", curr.ahrNet);
-	    query.bindValue(":efficiency", curr.efficiency);
-	    query.bindValue(":selfdischarge", curr.selfDischarge);
-
-		if(!query.exec())
-			return false;
+		const struct PMEfficiencyRecord & curr = rs[i];
+
+		downloadids << downloadid;
+		recordids << i+1;
+		batteries << battery;
+		endtimes << curr.endTime;
+		valids << (int) curr.validData;
+		lengths << curr.cycleMinutes;
+		discharges << curr.ahrDischarge;
+		charges << curr.ahrCharge;
+		nets << curr.ahrNet;
+		efficiencies << curr.efficiency;
+		selfdischarges << curr.selfDischarge;
 	}
 
-	return true;
+	query.addBindValue(downloadids);
+	query.addBindValue(recordids);
+	query.addBindValue(batteries);
+	query.addBindValue(endtimes);
+	query.addBindValue(valids);
+	query.addBindValue(lengths);
+	query.addBindValue(discharges);
+	query.addBindValue(charges);
+	query.addBindValue(nets);
+	query.addBindValue(efficiencies);
+	query.addBindValue(selfdischarges);
+	return query.execBatch();
 }
 
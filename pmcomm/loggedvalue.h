@@ -5,11 +5,14 @@
 #include "pmdefs.h"
 
 #include <QList>
+#include <QVector>
 #include <QSqlDatabase>
+#include <QByteArray>
 
 class LoggedData;
 
-class QTextStream;
+class LoggedFileWriter;
+class QSqlQuery;
 
 /* This class represents a group of logged data records of a particular
    type, e.g. a bunch of periodic data records or a bunch of efficiency
@@ -20,14 +23,16 @@ class QTextStream;
    libpmcomm) or read out of the database, and can subsequently be written
    to a csv file or into the database.
 
-   Each subclass has a static writeGroupToFile() method that writes
-   a set of LoggedValue objects (i.e. a set of sets of records)
-   to a file. This allows exporting continuous records out of the database
-   into csv files.
+   Each subclass has a static exportToFile() method that writes the records
+   of a set of downloads (i.e. a set of sets of records) out of the database
+   to a file. This allows exporting continuous records into csv files. The
+   records are read with forward-only queries and written as they are read,
+   and at most two downloads are held in memory at once, so exporting any
+   amount of history takes the same memory.
    
    Each subclass also has writeRowsToFile() method that writes a particular
    group of records, starting at startRow and ending at endRow (indexed from 0)
-   to a file. This is used by writeGroupToFile() to ensure that only
+   to a file. This is used by exportToFile() to ensure that only
    non-overlapping data actually makes it into the file.
  */
 class LoggedValue {
@@ -45,18 +50,26 @@ public:
 	virtual bool writeToDB(QSqlDatabase db, int downloadid) = 0;
 
 	// This function writes the header line (with the names of the columns)
-	virtual void writeHeadersToFile(QTextStream & loggedfile) = 0;
+	virtual void writeHeadersToFile(LoggedFileWriter & out) = 0;
 	int getBattery();
 	LoggedDataType type() { return loggedType; }
 
+	static QByteArray readRawData(QSqlDatabase db, int downloadid, LoggedDataType type);
+
 	void setContext(LoggedData *loggedData);
 
 	bool isValid() { return initialized; }
 
+	// The logged data memory the records were decoded from, as given to the constructor
+	// that decodes it. Empty if it wasn't kept
+	QByteArray getRawData() { return rawData; }
+	void setRawData(QByteArray data);
+
 protected:
 	LoggedDataType loggedType;
 	LoggedData *context;
 	int battery;
+	QByteArray rawData;
 
 	bool initialized; // True if the constructor succeeded
 };
@@ -78,40 +91,100 @@ private:
 	struct PMScientificValue scientificValue;
 };
 
-/* This class represents a group of periodic data records
+/* These are the app's copies of the records from libpmcomm, packed so that a download's
+   records can be held in one contiguous QVector. The libpmcomm structs carry padding and a
+   next pointer, and a QList of them puts every record in its own heap node.
+
+   In a periodic record, the scientific values are split into arrays of mantissas and
+   exponents, so nothing needs padding, and the battery charged flags and the gap flag are
+   kept in the bits of validData that libpmcomm doesn't use. A record takes 32 bytes.
+ */
+struct LoggedPeriodicRecord {
+	enum ScientificField { AHR1, AHR2, AHR3, WHR1, WHR2, AMPS1, N_SCIENTIFIC };
+	enum Flag {
+		VALID_BITS = 0x3ff, // The PM_PERIODIC_*_VALID bits
+		BAT1_CHARGED = 1 << 13,
+		BAT2_CHARGED = 1 << 14,
+		GAP = 1 << 15 // The record doesn't follow on from the one before it
+	};
+
+	uint32_t measTime;
+	uint16_t validData;
+	int16_t mantissa[N_SCIENTIFIC];
+	int8_t exponent[N_SCIENTIFIC];
+	int8_t minTemp;
+	int8_t maxTemp;
+	uint8_t bat1Percent;
+	uint8_t bat2Percent;
+	uint16_t volts1;
+	uint16_t volts2;
+};
+
+struct LoggedProfileRecord {
+	uint8_t day;
+	uint8_t percentFull;
+	uint16_t volts;
+	int16_t ampsMantissa;
+	int8_t ampsExponent;
+};
+
+Q_DECLARE_TYPEINFO(LoggedPeriodicRecord, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(LoggedProfileRecord, Q_PRIMITIVE_TYPE);
+
+/* This class represents a group of periodic data records.
+
+   Periodic records are stored once per site, in a timeline keyed by their absolute time.
+   writeToDB() only stores the records that are newer than the last one stored for the site,
+   and marks the first of them as following a gap if they don't continue on from it. Read back
+   out of the database, an object holds just the records that its download added, so the
+   objects of a site's downloads, in order, can be written out without any matching. When a
+   download is deleted, the records that a later download also had are moved to that one.
+
+   Downloads archived as raw memory are decoded again when they are read, and hold the
+   unit's whole log. Only these are matched against the records written before them.
  */
 class PeriodicLoggedValue : public LoggedValue {
 public:
 	PeriodicLoggedValue(struct PMPeriodicRecord *records);
-	PeriodicLoggedValue(QSqlDatabase db, int downloadid);
+	PeriodicLoggedValue(QSqlDatabase db, int downloadid, bool legacyTable = false);
+	PeriodicLoggedValue(QByteArray raw);
 
 	bool writeToFile(QString filename);
-	static bool writeGroupToFile(QList<PeriodicLoggedValue *> values, QString filename);
+	static bool exportToFile(QSqlDatabase db, QList<LoggedData *> downloads, LoggedFileWriter & out);
 	bool writeToDB(QSqlDatabase db, int downloadid);
+	int64_t startTime();
 
 private:
-	void writeHeadersToFile(QTextStream & loggedfile);
-	void writeRowsToFile(QTextStream & loggedfile, int startRow, int endRow);
-	int findMatchingRow(PeriodicLoggedValue & previous, bool & extraRow);
-	static bool rowsEqual(struct PMPeriodicRecord & one, struct PMPeriodicRecord & two);
-	QList<struct PMPeriodicRecord> rs;
+	void writeHeadersToFile(LoggedFileWriter & out);
+	void writeRowsToFile(LoggedFileWriter & out, int startRow, int endRow);
+	void writeRecordToFile(LoggedFileWriter & out, const LoggedPeriodicRecord & curr);
+	void setRecords(struct PMPeriodicRecord *records);
+	int findNewRows(const LoggedPeriodicRecord & last, int64_t lastTime, bool & gap);
+	int64_t absoluteTime(const LoggedPeriodicRecord & record);
+	int firstRowAt(int64_t time);
+	static void readRecord(QSqlQuery & query, LoggedPeriodicRecord & curr);
+	static bool rowsEqual(const LoggedPeriodicRecord & one, const LoggedPeriodicRecord & two);
+	QVector<LoggedPeriodicRecord> rs;
 };
 
 class ProfileLoggedValue : public LoggedValue {
 public:
 	ProfileLoggedValue(struct PMProfileRecord *records, int battery);
 	ProfileLoggedValue(QSqlDatabase db, int downloadid, int battery);
+	ProfileLoggedValue(QByteArray raw, int battery);
+	static bool decodeRaw(QByteArray raw, ProfileLoggedValue *& battery1, ProfileLoggedValue *& battery2);
 
 	bool writeToFile(QString filename);
-	static bool writeGroupToFile(QList<ProfileLoggedValue *> values, QString filename);
+	static bool exportToFile(QSqlDatabase db, QList<LoggedData *> downloads, int battery, LoggedFileWriter & out);
 	bool writeToDB(QSqlDatabase db, int downloadid);
 
 private:
-	void writeHeadersToFile(QTextStream & loggedfile);
-	void writeRowsToFile(QTextStream & loggedfile, int startRow, int endRow);
+	void writeHeadersToFile(LoggedFileWriter & out);
+	void writeRowsToFile(LoggedFileWriter & out, int startRow, int endRow);
+	void setRecords(struct PMProfileRecord *records);
 	int findMatchingRow(ProfileLoggedValue & previous, bool & extraRow);
-	static bool rowsEqual(struct PMProfileRecord & one, struct PMProfileRecord & two);
-	QList<struct PMProfileRecord> rs;
+	static bool rowsEqual(const LoggedProfileRecord & one, const LoggedProfileRecord & two);
+	QVector<LoggedProfileRecord> rs;
 };
 
 class EfficiencyLoggedValue : public LoggedValue {
@@ -120,15 +193,17 @@ public:
 	EfficiencyLoggedValue(QSqlDatabase db, int downloadid, int battery);
 
 	bool writeToFile(QString filename);
-	static bool writeGroupToFile(QList<EfficiencyLoggedValue *> values, QString filename);
+	static bool exportToFile(QSqlDatabase db, QList<LoggedData *> downloads, int battery, LoggedFileWriter & out);
 	bool writeToDB(QSqlDatabase db, int downloadid);
 
 private:
-	void writeHeadersToFile(QTextStream & loggedfile);
-	void writeRowsToFile(QTextStream & loggedfile, int startRow, int endRow, QList<struct PMEfficiencyRecord *> & lastFewRows);
+	void writeHeadersToFile(LoggedFileWriter & out);
+	void writeRowsToFile(LoggedFileWriter & out, int startRow, int endRow, QList<struct PMEfficiencyRecord> & lastFewRows);
 	int findMatchingRow(EfficiencyLoggedValue & previous, bool & extraRow);
-	static bool rowsEqual(struct PMEfficiencyRecord & one, struct PMEfficiencyRecord & two);
-	QList<struct PMEfficiencyRecord> rs;
+	int64_t absoluteTime(const struct PMEfficiencyRecord & record);
+	int firstRowAt(int64_t time);
+	static bool rowsEqual(const struct PMEfficiencyRecord & one, const struct PMEfficiencyRecord & two);
+	QVector<struct PMEfficiencyRecord> rs;
 };
 
 
@@ -1,10 +1,13 @@
 #include "mainwindow.h"
 #include "libpmcomm.h"
 #include "appsettings.h"
+#include "ioscheduler.h"
+#include "historystore.h"
 
 #include <QApplication>
 #include <QCoreApplication>
 #include <QSettings>
+#include <QScopedPointer>
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
@@ -19,6 +22,16 @@ int main(int argc, char *argv[]) {
     AppSettings appSettings(&settings);
     AppSettings::setSingletonInstance(&appSettings);
 
+    IOScheduler ioScheduler(appSettings.getIOThreadCount());
+    IOScheduler::setSingletonInstance(&ioScheduler);
+
+    // History of polled values, if it is enabled
+    QScopedPointer<HistoryStore> historyStore;
+    if(appSettings.getHistoryEnabled()) {
+        historyStore.reset(new HistoryStore(HistoryStore::defaultLocation(), appSettings.getHistoryRawDays(), appSettings.getHistoryRetentionDays()));
+        HistoryStore::setSingletonInstance(historyStore.data());
+    }
+
     MainWindow window;
     window.show();
     return app.exec();
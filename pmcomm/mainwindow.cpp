@@ -7,8 +7,10 @@
 #include "optionsdialog.h"
 #include "loggeddownloaddialog.h"
 #include "downloadoptionsdialog.h"
+#include "loggedhistorydialog.h"
 #include "loggeddownloader.h"
 #include "siteslist.h"
+#include "statusserver.h"
 
 #include <QPushButton>
 #include <QComboBox>
@@ -22,6 +24,7 @@
 MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
     AppSettings *settings = AppSettings::getInstance();
     dbErrorCurrent = false;
+    sitesRequest = -1;
 
     setWindowTitle(QString("PMComm %1").arg(QCoreApplication::applicationVersion()));
     setMinimumSize(800, 400);
@@ -48,6 +51,9 @@ MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
 
     displayPanel = new DisplayPanel(sitesList);
 
+    if(settings->getServerEnabled())
+        new StatusServer(sitesList, settings->getServerPort(), this);
+
     downloader = new LoggedDownloader(sitesList, this);
     if(!downloader->isInitialized()) {
         delete downloader;
@@ -58,6 +64,7 @@ MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
         errorMessage.exec();      
     } else {
         connect(downloader, SIGNAL(downloadDBError()), this, SLOT(downloadDBError()));
+        connect(downloader->getStorage(), SIGNAL(sitesWithDownloadsListed(int, const QList<int> &)), this, SLOT(sitesWithDownloadsListed(int, const QList<int> &)));
     }
 
     programButton = new QPushButton("Program the PentaMetric...");
@@ -69,12 +76,16 @@ MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
     downloadOptionsButton = new QPushButton("Logged data auto-download...");
     connect(downloadOptionsButton, SIGNAL(clicked(bool)), this, SLOT(downloadOptionsClicked()));
 
+    historyButton = new QPushButton("Logged data history...");
+    connect(historyButton, SIGNAL(clicked(bool)), this, SLOT(historyClicked()));
+
     QGroupBox *controlsGroup = new QGroupBox("Site");
     QVBoxLayout *controlsLayout = new QVBoxLayout(controlsGroup);
     controlsLayout->addWidget(siteSelection);
     controlsLayout->addWidget(programButton);
     controlsLayout->addWidget(downloadButton);
     controlsLayout->addWidget(downloadOptionsButton);
+    controlsLayout->addWidget(historyButton);
     controlsLayout->addStretch();
 
     QPushButton *manageSites = new QPushButton("Manage sites...");
@@ -154,23 +165,46 @@ void MainWindow::downloadOptionsClicked() {
     downloadOptionsDialog->deleteLater();
 }
 
+// The history window is NOT modal, and there can be one for each site
+void MainWindow::historyClicked() {
+    QDialog *historyDialog = new LoggedHistoryDialog(sitesList->getCurrentManager()->getSettings(), downloader, this);
+    historyDialog->setAttribute(Qt::WA_DeleteOnClose);
+    historyDialog->show();
+}
+
+// Finds out which sites actually have data stored, so the sites dialog can warn the user,
+// then shows the dialog once the storage thread answers
 void MainWindow::manageSitesClicked() {
+    if(sitesRequest >= 0)
+        return;
     if(programDialog != NULL && !programDialog->closePrograms())
         return;
 
+    if(downloader == NULL) {
+        showSitesDialog(QSet<int>());
+        return;
+    }
+
+    sitesRequest = LoggedStorage::newRequest();
+    QMetaObject::invokeMethod(downloader->getStorage(), "listSitesWithDownloads", Qt::QueuedConnection,
+        Q_ARG(int, sitesRequest), Q_ARG(QList<int>, sitesList->getManagers().keys()));
+}
+
+void MainWindow::sitesWithDownloadsListed(int request, const QList<int> & sites) {
+    if(request != sitesRequest)
+        return;
+
+    sitesRequest = -1;
+    showSitesDialog(sites.toSet());
+}
+
+void MainWindow::showSitesDialog(QSet<int> sitesWithDBData) {
     displayPanel->forceStop();
 
     SitesDialog *sitesDialog = new SitesDialog(sitesList, this);
 
-    QSet<int> sitesWithDBData; // Calculate which sites actually have data stored so we can warn the user
     foreach(SiteManager *manager, sitesList->getManagers()) {
         manager->releaseFetcher();
-        if(downloader) {
-            int id = manager->getSettings()->getId();
-            bool success;
-            if(!downloader->downloadsForSite(id, success).empty())
-                sitesWithDBData.insert(id);
-        }
     }
 
     sitesDialog->setSitesWithDBData(sitesWithDBData);
@@ -195,6 +229,7 @@ void MainWindow::setSitesAvailable() {
     programButton->setEnabled(avail);
     downloadButton->setEnabled(avail);
     downloadOptionsButton->setEnabled(avail && downloader != NULL);
+    historyButton->setEnabled(avail && downloader != NULL);
 }
 
 void MainWindow::currentSiteChanged() {
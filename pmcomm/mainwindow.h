@@ -4,8 +4,10 @@
 #include <QWidget>
 #include <QObject>
 #include <QPointer>
+#include <QSet>
 
 #include "programdialog.h"
+#include "loggedstorage.h"
 
 class SiteManager;
 class DisplayPanel;
@@ -34,10 +36,12 @@ public slots:
 	void manageSitesClicked();
 	void globalOptionsClicked();
 	void downloadOptionsClicked();
+	void historyClicked();
 
 	void currentSiteChanged();
 
 	void downloadDBError();
+	void sitesWithDownloadsListed(int request, const QList<int> & sites);
 
 	void managersAdded(const QList<SiteManager *> & managers);
 
@@ -59,8 +63,12 @@ private:
 	QPushButton *programButton;
 	QPushButton *downloadButton;
 	QPushButton *downloadOptionsButton;
+	QPushButton *historyButton;
 
 	void setSitesAvailable();
+	void showSitesDialog(QSet<int> sitesWithDBData);
+
+	int sitesRequest; // The request for the sites with stored data, while it is waiting
 };
 
 #endif
\ No newline at end of file
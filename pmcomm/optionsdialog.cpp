@@ -1,9 +1,12 @@
 #include "optionsdialog.h"
 
 #include "appsettings.h"
+#include "ioscheduler.h"
 
 #include <QRadioButton>
 #include <QComboBox>
+#include <QSpinBox>
+#include <QCheckBox>
 #include <QFormLayout>
 #include <QGroupBox>
 #include <QHBoxLayout>
@@ -35,6 +38,25 @@ OptionsDialog::OptionsDialog(QWidget *parent) : QDialog(parent) {
 	}
 	intervalBox->setCurrentIndex(intervalIndex);
 
+	threadsBox = new QSpinBox();
+	threadsBox->setRange(2, 16); // One is kept for the displays while logged data downloads
+	threadsBox->setValue(settings->getIOThreadCount());
+
+	downloadsBox = new QSpinBox();
+	downloadsBox->setMinimum(1);
+	threadsChanged(threadsBox->value());
+	downloadsBox->setValue(settings->getMaxConcurrentDownloads());
+	connect(threadsBox, SIGNAL(valueChanged(int)), this, SLOT(threadsChanged(int)));
+
+	rawStorageBox = new QCheckBox("Store logged data in the PentaMetric's compact format (not shown in history charts)");
+	rawStorageBox->setChecked(settings->getRawLoggedStorage());
+
+	historyBox = new QCheckBox("Keep every polled value on disk (takes effect on restart)");
+	historyBox->setChecked(settings->getHistoryEnabled());
+
+	snapshotBox = new QCheckBox("Update all displays of a site at once");
+	snapshotBox->setChecked(settings->getSnapshotPolling());
+
 	QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
 	connect(buttonBox, SIGNAL(accepted()), this, SLOT(accept()));
 	connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
@@ -42,6 +64,11 @@ OptionsDialog::OptionsDialog(QWidget *parent) : QDialog(parent) {
 
 	layout->addRow(temperatureBox);
 	layout->addRow("Number of cycles to average for efficiency data", intervalBox);
+	layout->addRow("Maximum simultaneous site connections (one is kept for live values during downloads)", threadsBox);
+	layout->addRow("Maximum simultaneous logged data downloads", downloadsBox);
+	layout->addRow(rawStorageBox);
+	layout->addRow(historyBox);
+	layout->addRow(snapshotBox);
 	layout->addRow(buttonBox);
 
 	if(settings->getTempUnit() == AppSettings::Fahrenheit)
@@ -50,8 +77,19 @@ OptionsDialog::OptionsDialog(QWidget *parent) : QDialog(parent) {
 		celsiusButton->setChecked(true);
 }
 
+// Downloads each hold a connection until they finish, so one is always left for the displays
+void OptionsDialog::threadsChanged(int threads) {
+	downloadsBox->setMaximum(qMax(1, threads - 1));
+}
+
 void OptionsDialog::saveData() {
     AppSettings *settings = AppSettings::getInstance();
     settings->setTempUnit(fahrenheitButton->isChecked() ? AppSettings::Fahrenheit : AppSettings::Celsius);
     settings->setEfficiencyAverageInterval(intervalBox->itemData(intervalBox->currentIndex()).toInt());
+    settings->setIOThreadCount(threadsBox->value());
+    settings->setMaxConcurrentDownloads(downloadsBox->value());
+    settings->setRawLoggedStorage(rawStorageBox->isChecked());
+    settings->setHistoryEnabled(historyBox->isChecked());
+    settings->setSnapshotPolling(snapshotBox->isChecked());
+    IOScheduler::getInstance()->setMaxThreadCount(threadsBox->value());
 }
@@ -8,6 +8,8 @@
 
 class QRadioButton;
 class QComboBox;
+class QSpinBox;
+class QCheckBox;
 
 class OptionsDialog : public QDialog {
 	Q_OBJECT
@@ -19,11 +21,17 @@ public:
 
 public slots:
 	void saveData();
+	void threadsChanged(int threads);
 
 private:
 	QRadioButton *celsiusButton;
 	QRadioButton *fahrenheitButton;
 	QComboBox *intervalBox;
+	QSpinBox *threadsBox;
+	QSpinBox *downloadsBox;
+	QCheckBox *rawStorageBox;
+	QCheckBox *historyBox;
+	QCheckBox *snapshotBox;
 };
 
 
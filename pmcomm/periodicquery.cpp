@@ -0,0 +1,209 @@
+#include "periodicquery.h"
+#include "periodicrollup.h"
+
+#include <QSqlQuery>
+#include <QVariant>
+#include <QStringList>
+#include <qnumeric.h>
+
+// The scale of each stored exponent. libpmcomm only decodes exponents from -3 to 4, and
+// SQLite isn't always built with pow()
+static const char *scaleCase = "CASE %1 WHEN -3 THEN 0.001 WHEN -2 THEN 0.01 WHEN -1 THEN 0.1 "
+	"WHEN 0 THEN 1.0 WHEN 1 THEN 10.0 WHEN 2 THEN 100.0 WHEN 3 THEN 1000.0 WHEN 4 THEN 10000.0 END";
+
+PeriodicQuery::PeriodicQuery() : site(-1), from(0), to(-1) {
+	bucketSeconds = 0;
+	aggregate = AGGREGATE_AVG;
+}
+
+PeriodicQuery::PeriodicQuery(int site, qint64 from, qint64 to) : site(site), from(from), to(to) {
+	bucketSeconds = 0;
+	aggregate = AGGREGATE_AVG;
+}
+
+// Adds a field aggregated with the query's aggregate
+void PeriodicQuery::addField(Field field) {
+	fields.append(field);
+	fieldAggregates.append(-1);
+}
+
+void PeriodicQuery::addField(Field field, Aggregate aggregate) {
+	fields.append(field);
+	fieldAggregates.append(aggregate);
+}
+
+// Groups the records into buckets of bucketSeconds. 0 returns every record
+void PeriodicQuery::setBuckets(int bucketSeconds, Aggregate aggregate) {
+	this->bucketSeconds = qMax(bucketSeconds, 0);
+	this->aggregate = aggregate;
+}
+
+QString PeriodicQuery::fieldExpression(Field field) {
+	switch(field) {
+		case FIELD_AHR1: return QString("ahr1man * %1").arg(QString(scaleCase).arg("ahr1exp"));
+		case FIELD_AHR2: return QString("ahr2man * %1").arg(QString(scaleCase).arg("ahr2exp"));
+		case FIELD_AHR3: return QString("ahr3man * %1").arg(QString(scaleCase).arg("ahr3exp"));
+		case FIELD_WHR1: return QString("whr1man * %1").arg(QString(scaleCase).arg("whr1exp"));
+		case FIELD_WHR2: return QString("whr2man * %1").arg(QString(scaleCase).arg("whr2exp"));
+		case FIELD_MIN_TEMP: return "NULLIF(minTemp, -21)";
+		case FIELD_MAX_TEMP: return "NULLIF(maxTemp, -21)";
+		case FIELD_VOLTS1: return "volts1 / 10.0";
+		case FIELD_VOLTS2: return "volts2 / 10.0";
+		case FIELD_AMPS1: return QString("amps1man * %1").arg(QString(scaleCase).arg("amps1exp"));
+		case FIELD_BAT1_PERCENT: return "bat1percent";
+		case FIELD_BAT2_PERCENT: return "bat2percent";
+		case N_FIELDS: break;
+	}
+	return "NULL";
+}
+
+QString PeriodicQuery::fieldName(Field field) {
+	switch(field) {
+		case FIELD_AHR1: return "ahr1";
+		case FIELD_AHR2: return "ahr2";
+		case FIELD_AHR3: return "ahr3";
+		case FIELD_WHR1: return "whr1";
+		case FIELD_WHR2: return "whr2";
+		case FIELD_MIN_TEMP: return "mintemp";
+		case FIELD_MAX_TEMP: return "maxtemp";
+		case FIELD_VOLTS1: return "volts1";
+		case FIELD_VOLTS2: return "volts2";
+		case FIELD_AMPS1: return "amps1";
+		case FIELD_BAT1_PERCENT: return "bat1percent";
+		case FIELD_BAT2_PERCENT: return "bat2percent";
+		case N_FIELDS: break;
+	}
+	return "";
+}
+
+PeriodicQuery::Aggregate PeriodicQuery::fieldAggregate(int index) {
+	return fieldAggregates[index] < 0 ? aggregate : (Aggregate) fieldAggregates[index];
+}
+
+bool PeriodicQuery::usesLast() {
+	if(bucketSeconds <= 0)
+		return false;
+
+	for(int i = 0; i < fields.size(); i++) {
+		if(fieldAggregate(i) == AGGREGATE_LAST)
+			return true;
+	}
+	return false;
+}
+
+// True if AGGREGATE_LAST is asked for along with AGGREGATE_MIN or AGGREGATE_MAX, which would
+// make SQLite take the last values from the row of the minimum or maximum instead
+bool PeriodicQuery::mixesLast() {
+	if(!usesLast())
+		return false;
+
+	for(int i = 0; i < fields.size(); i++) {
+		if(fieldAggregate(i) == AGGREGATE_MIN || fieldAggregate(i) == AGGREGATE_MAX)
+			return true;
+	}
+	return false;
+}
+
+// Gets the size of the rollup buckets that the query can be answered from, or 0 if it has to
+// read the records. Each bucket must be made of whole rollup buckets, and so must the range
+int PeriodicQuery::rollupSeconds() {
+	if(bucketSeconds <= 0 || usesLast())
+		return 0;
+
+	const int sizes[] = { PeriodicRollup::DAY_SECONDS, PeriodicRollup::HOUR_SECONDS };
+	for(int i = 0; i < 2; i++) {
+		if(bucketSeconds % sizes[i] == 0 && from % sizes[i] == 0 && (to + 1) % sizes[i] == 0)
+			return sizes[i];
+	}
+	return 0;
+}
+
+// Builds the select. Every query starts with the time and the count, followed by the fields.
+// AGGREGATE_LAST relies on SQLite taking the other columns from the row that MAX() picked,
+// so it has MAX(abstime) as an extra third column
+QString PeriodicQuery::buildSql() {
+	int rollup = rollupSeconds();
+	if(rollup > 0)
+		return buildRollupSql(rollup);
+
+	QStringList columns;
+	if(bucketSeconds <= 0) {
+		columns << "abstime" << "1";
+		foreach(Field field, fields) {
+			columns << fieldExpression(field);
+		}
+		return QString("SELECT %1 FROM periodic_timeline WHERE siteid = :siteid "
+			"AND abstime BETWEEN :from AND :to ORDER BY abstime;").arg(columns.join(", "));
+	}
+
+	columns << QString("(abstime / %1) * %1 AS bucket").arg(bucketSeconds) << "COUNT(*)";
+	if(usesLast())
+		columns << "MAX(abstime)";
+	for(int i = 0; i < fields.size(); i++) {
+		QString value = fieldExpression(fields[i]);
+		switch(fieldAggregate(i)) {
+			case AGGREGATE_MIN: columns << QString("MIN(%1)").arg(value); break;
+			case AGGREGATE_MAX: columns << QString("MAX(%1)").arg(value); break;
+			case AGGREGATE_AVG: columns << QString("AVG(%1)").arg(value); break;
+			case AGGREGATE_SUM: columns << QString("SUM(%1)").arg(value); break;
+			case AGGREGATE_LAST: columns << value; break;
+		}
+	}
+
+	return QString("SELECT %1 FROM periodic_timeline WHERE siteid = :siteid "
+		"AND abstime BETWEEN :from AND :to GROUP BY bucket ORDER BY bucket;").arg(columns.join(", "));
+}
+
+// Builds the select over a rollup table, which returns the same columns as buildSql()
+QString PeriodicQuery::buildRollupSql(int rollup) {
+	QStringList columns;
+	columns << QString("(bucket / %1) * %1 AS groupstart").arg(bucketSeconds) << "SUM(records)";
+	for(int i = 0; i < fields.size(); i++) {
+		QString name = fieldName(fields[i]);
+		switch(fieldAggregate(i)) {
+			case AGGREGATE_MIN: columns << QString("MIN(%1_min)").arg(name); break;
+			case AGGREGATE_MAX: columns << QString("MAX(%1_max)").arg(name); break;
+			case AGGREGATE_AVG: columns << QString("SUM(%1_sum) / SUM(%1_n)").arg(name); break;
+			case AGGREGATE_SUM: columns << QString("SUM(%1_sum)").arg(name); break;
+			case AGGREGATE_LAST: columns << "NULL"; break;
+		}
+	}
+
+	return QString("SELECT %1 FROM %2 WHERE siteid = :siteid AND bucket BETWEEN :from AND :to "
+		"GROUP BY groupstart ORDER BY groupstart;").arg(columns.join(", ")).arg(PeriodicRollup::tableName(rollup));
+}
+
+// Reads the range into result, replacing anything already in it. The rows are read forward
+// only, straight into the arrays
+bool PeriodicQuery::run(QSqlDatabase db, PeriodicSeries & result) {
+	result.times.clear();
+	result.counts.clear();
+	result.values.clear();
+	for(int i = 0; i < fields.size(); i++) {
+		result.values.append(QVector<double>());
+	}
+	if(mixesLast())
+		return false;
+
+	QSqlQuery query(db);
+	query.setForwardOnly(true);
+	if(!query.prepare(buildSql()))
+		return false;
+	query.bindValue(":siteid", site);
+	query.bindValue(":from", from);
+	query.bindValue(":to", to);
+	if(!query.exec())
+		return false;
+
+	int firstField = usesLast() ? 3 : 2;
+	while(query.next()) {
+		result.times.append(query.value(0).toLongLong());
+		result.counts.append(query.value(1).toInt());
+		for(int i = 0; i < fields.size(); i++) {
+			QVariant value = query.value(firstField + i);
+			result.values[i].append(value.isNull() ? qQNaN() : value.toDouble());
+		}
+	}
+
+	return query.isActive();
+}
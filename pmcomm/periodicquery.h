@@ -0,0 +1,98 @@
+#ifndef PERIODICQUERY_H
+#define PERIODICQUERY_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QMetaType>
+
+#include <stdint.h>
+
+// The result of a PeriodicQuery. Each array has one entry per row, in time order
+struct PeriodicSeries {
+	QVector<qint64> times; // Seconds since the epoch; the start of the bucket when aggregating
+	QVector<int> counts; // Number of records in each bucket, or 1 for each record
+	QList<QVector<double> > values; // One array per requested field, NaN where there is no valid value
+};
+
+/* This class reads ranges of a site's periodic records out of the timeline, for charts and
+   reports that need some fields over a span of time rather than whole downloads.
+
+   The records can be returned as they are, or grouped into buckets of bucketSeconds and
+   aggregated in SQL, so only one row per bucket leaves the database. Buckets are aligned
+   to multiples of bucketSeconds since the epoch, so hourly and daily buckets fall on UTC
+   hours and days. The query runs on the (siteid, abstime) primary key of periodic_timeline.
+   Whole hours or days aggregated with anything but AGGREGATE_LAST are read from the
+   PeriodicRollup tables instead, when the range starts and ends on the same boundaries.
+
+   Each field can have its own aggregate, so one query can get both the minimum and the
+   maximum of a field. AGGREGATE_LAST can't be mixed with AGGREGATE_MIN or AGGREGATE_MAX,
+   since SQLite would no longer know which record is the last one; run() fails if they are.
+
+   Values are in the units the PentaMetric reports: amp hours, watt hours, volts, amps,
+   degrees C and percent. Downloads archived as raw memory aren't in the timeline, so their
+   records aren't found.
+ */
+class PeriodicQuery {
+public:
+	enum Field {
+		FIELD_AHR1,
+		FIELD_AHR2,
+		FIELD_AHR3,
+		FIELD_WHR1,
+		FIELD_WHR2,
+		FIELD_MIN_TEMP,
+		FIELD_MAX_TEMP,
+		FIELD_VOLTS1,
+		FIELD_VOLTS2,
+		FIELD_AMPS1,
+		FIELD_BAT1_PERCENT,
+		FIELD_BAT2_PERCENT,
+		N_FIELDS
+	};
+
+	enum Aggregate {
+		AGGREGATE_MIN,
+		AGGREGATE_MAX,
+		AGGREGATE_AVG,
+		AGGREGATE_SUM,
+		AGGREGATE_LAST // The value of the last record in the bucket
+	};
+
+	PeriodicQuery();
+	PeriodicQuery(int site, qint64 from, qint64 to);
+
+	void addField(Field field);
+	void addField(Field field, Aggregate aggregate);
+	void setBuckets(int bucketSeconds, Aggregate aggregate);
+
+	// Runs the query, returning false if it failed
+	bool run(QSqlDatabase db, PeriodicSeries & result);
+
+	// The SQL expression for a field's value, in the units the PentaMetric reports
+	static QString fieldExpression(Field field);
+	// The name of the field's columns in the rollup tables
+	static QString fieldName(Field field);
+
+private:
+	QString buildSql();
+	QString buildRollupSql(int rollupSeconds);
+	int rollupSeconds();
+	Aggregate fieldAggregate(int index);
+	bool usesLast();
+	bool mixesLast();
+
+	int site;
+	qint64 from;
+	qint64 to;
+	QList<Field> fields;
+	QList<int> fieldAggregates; // The Aggregate of each field, or -1 for the query's
+	int bucketSeconds; // 0 returns every record
+	Aggregate aggregate;
+};
+
+Q_DECLARE_METATYPE(PeriodicQuery)
+Q_DECLARE_METATYPE(PeriodicSeries)
+
+#endif
@@ -0,0 +1,91 @@
+#include "periodicrollup.h"
+#include "periodicquery.h"
+
+#include <QSqlQuery>
+#include <QVariant>
+#include <QStringList>
+
+bool PeriodicRollup::createTables(QSqlDatabase db, QString suffix) {
+	QStringList columns;
+	columns << "siteid INTEGER NOT NULL" << "bucket INTEGER NOT NULL" << "records INTEGER NOT NULL";
+	for(int f = 0; f < PeriodicQuery::N_FIELDS; f++) {
+		QString name = PeriodicQuery::fieldName((PeriodicQuery::Field) f);
+		columns << name + "_min REAL" << name + "_max REAL" << name + "_sum REAL" << name + "_n INTEGER NOT NULL";
+	}
+
+	QSqlQuery query(db);
+	bool success = true;
+	const int sizes[] = { HOUR_SECONDS, DAY_SECONDS };
+	for(int i = 0; i < 2; i++) {
+		success = success && query.exec(QString("CREATE TABLE %1 (%2, PRIMARY KEY (siteid, bucket))%3;")
+			.arg(tableName(sizes[i])).arg(columns.join(",")).arg(suffix));
+	}
+	return success;
+}
+
+// Recomputes the hours, then the days, that overlap from to to. The caller is expected to
+// hold a transaction, so the two tables always agree
+bool PeriodicRollup::update(QSqlDatabase db, int site, qint64 from, qint64 to) {
+	return updateTable(db, HOUR_SECONDS, site, from, to) && updateTable(db, DAY_SECONDS, site, from, to);
+}
+
+// Recomputes every bucket of every site
+bool PeriodicRollup::rebuild(QSqlDatabase db) {
+	return updateTable(db, HOUR_SECONDS, -1, 0, 0) && updateTable(db, DAY_SECONDS, -1, 0, 0);
+}
+
+QString PeriodicRollup::tableName(int bucketSeconds) {
+	return bucketSeconds == DAY_SECONDS ? "periodic_daily" : "periodic_hourly";
+}
+
+// Replaces the buckets of one table that overlap from to to, or all of them if site is -1.
+// Hours are aggregated from the records, and days from the hours
+bool PeriodicRollup::updateTable(QSqlDatabase db, int bucketSeconds, int site, qint64 from, qint64 to) {
+	QStringList columns;
+	QString source;
+	QString time;
+	if(bucketSeconds == HOUR_SECONDS) {
+		source = "periodic_timeline";
+		time = "abstime";
+		columns << "siteid" << QString("(abstime / %1) * %1 AS rollbucket").arg(bucketSeconds) << "COUNT(*)";
+		for(int f = 0; f < PeriodicQuery::N_FIELDS; f++) {
+			QString value = PeriodicQuery::fieldExpression((PeriodicQuery::Field) f);
+			columns << QString("MIN(%1)").arg(value) << QString("MAX(%1)").arg(value)
+				<< QString("SUM(%1)").arg(value) << QString("COUNT(%1)").arg(value);
+		}
+	} else {
+		source = tableName(HOUR_SECONDS);
+		time = "bucket";
+		columns << "siteid" << QString("(bucket / %1) * %1 AS rollbucket").arg(bucketSeconds) << "SUM(records)";
+		for(int f = 0; f < PeriodicQuery::N_FIELDS; f++) {
+			QString name = PeriodicQuery::fieldName((PeriodicQuery::Field) f);
+			columns << QString("MIN(%1_min)").arg(name) << QString("MAX(%1_max)").arg(name)
+				<< QString("SUM(%1_sum)").arg(name) << QString("SUM(%1_n)").arg(name);
+		}
+	}
+
+	QString table = tableName(bucketSeconds);
+	QString select = QString("SELECT %1 FROM %2").arg(columns.join(", ")).arg(source);
+	QSqlQuery query(db);
+	if(site < 0) {
+		return query.exec(QString("DELETE FROM %1;").arg(table))
+			&& query.exec(QString("INSERT INTO %1 %2 GROUP BY siteid, rollbucket;").arg(table).arg(select));
+	}
+
+	qint64 start = (from / bucketSeconds) * bucketSeconds;
+	qint64 end = (to / bucketSeconds) * bucketSeconds + bucketSeconds - 1;
+
+	query.prepare(QString("DELETE FROM %1 WHERE siteid = :siteid AND bucket BETWEEN :start AND :end;").arg(table));
+	query.bindValue(":siteid", site);
+	query.bindValue(":start", start);
+	query.bindValue(":end", end);
+	if(!query.exec())
+		return false;
+
+	query.prepare(QString("INSERT INTO %1 %2 WHERE siteid = :siteid AND %3 BETWEEN :start AND :end "
+		"GROUP BY siteid, rollbucket;").arg(table).arg(select).arg(time));
+	query.bindValue(":siteid", site);
+	query.bindValue(":start", start);
+	query.bindValue(":end", end);
+	return query.exec();
+}
@@ -0,0 +1,37 @@
+#ifndef PERIODICROLLUP_H
+#define PERIODICROLLUP_H
+
+#include <QSqlDatabase>
+#include <QString>
+
+/* This class keeps the hourly and daily rollups of the periodic timeline, so that charts and
+   reports over months or years read one row per bucket instead of every record.
+
+   periodic_hourly and periodic_daily have one row per site and bucket that has records, keyed
+   on (siteid, bucket), where bucket is the start of the UTC hour or day. Each row holds the
+   number of records and, for each PeriodicQuery field, <field>_min, <field>_max, <field>_sum
+   and <field>_n, the number of records with a valid value. The average is <field>_sum / <field>_n.
+
+   LoggedData::writeToDB() and deleteFromDB() call update() over the time range that they
+   changed, which recomputes only the hours and days in that range. rebuild() recomputes
+   everything, in case the rollups are ever out of step with the timeline.
+ */
+class PeriodicRollup {
+public:
+	enum {
+		HOUR_SECONDS = 3600,
+		DAY_SECONDS = 86400
+	};
+
+	static bool createTables(QSqlDatabase db, QString suffix);
+	static bool update(QSqlDatabase db, int site, qint64 from, qint64 to);
+	static bool rebuild(QSqlDatabase db);
+
+	// Gets the table for a bucket size of HOUR_SECONDS or DAY_SECONDS
+	static QString tableName(int bucketSeconds);
+
+private:
+	static bool updateTable(QSqlDatabase db, int bucketSeconds, int site, qint64 from, qint64 to);
+};
+
+#endif
@@ -16,7 +16,6 @@ include(3rdparty/qextserialport/src/qextserialport.pri)
 
 # Needed to get widgets in Qt5
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-QT += sql
 
 # Application name
 TARGET = PMComm
@@ -49,9 +48,8 @@ win32 {
 	RC_FILE = pmcomm.rc
 }
 
-# Get libpmcomm
-INCLUDEPATH += ../libpmcomm/include
-LIBS += -L"../libpmcomm/" -lpmcomm
+# Communication, settings and logged data classes shared with pmcommd
+include(core.pri)
 
 # Set up installation
 isEmpty(PREFIX) {
@@ -62,53 +60,35 @@ target.path = $$PREFIX/bin/
 INSTALLS += target
 
 SOURCES  += mainwindow.cpp \
-			datafetcher.cpp \
-			displayvalue.cpp \
-			programvalue.cpp \
-			loggedvalue.cpp \
-			pmconnectionwrapper.cpp \
-			sitemanager.cpp \
 			displaytablemodel.cpp \
 			programdialog.cpp \
 			programpanes.cpp \
 			displaypicker.cpp \
 			sitepicker.cpp \
-			siteslist.cpp \
-			sitesettings.cpp \
 			displaypanel.cpp \
 			sitesdialog.cpp \
-			appsettings.cpp \
 			optionsdialog.cpp \
 			loggeddownloaddialog.cpp \
-			loggeddownloader.cpp \
-			loggeddata.cpp \
 			downloadoptionsdialog.cpp \
+			loggedhistorydialog.cpp \
+			loggedhistorychart.cpp \
 			displaypickerdialog.cpp \
 			ipv4validator.cpp \
 			alarmlistmodel.cpp \
             main.cpp
 HEADERS  += mainwindow.h \
-			displayvalue.h \
-			programvalue.h \
-			loggedvalue.h \
-			pmconnectionwrapper.h \
-			sitemanager.h \
 			displaytablemodel.h \
-			datafetcher.h \
 			programdialog.h \
 			programpanes.h \
 			displaypicker.h \
 			sitepicker.h \
-			siteslist.h \
-			sitesettings.h \
 			displaypanel.h \
 			sitesdialog.h \
-			appsettings.h \
 			optionsdialog.h \
 			loggeddownloaddialog.h \
-			loggeddownloader.h \
-			loggeddata.h \
 			downloadoptionsdialog.h \
+			loggedhistorydialog.h \
+			loggedhistorychart.h \
 			displaypickerdialog.h \
 			ipv4validator.h \
 			alarmlistmodel.h
@@ -12,23 +12,90 @@ PMConnectionWrapper::~PMConnectionWrapper() {
 	disconnectPM(-1);
 }
 
+// Dispatches a request to the matching operation below
+void PMConnectionWrapper::execute(const Request & request) {
+	switch(request.kind) {
+		case Request::FetchDisplay:
+			fetchDisplayData(request.display, request.id);
+			break;
+		case Request::FetchDisplaySet:
+			fetchDisplaySet(request.displaySet, request.id);
+			break;
+		case Request::FetchProgram:
+			fetchProgramData(request.program, request.id);
+			break;
+		case Request::SetProgram:
+			setProgramData(request.program, request.value, request.id);
+			break;
+		case Request::FetchLogged:
+			fetchLoggedData(request.loggedType, request.id);
+			break;
+		case Request::Reset:
+			resetPM(request.command, request.id);
+			break;
+		case Request::ResetFailFast:
+			resetFailFast();
+			break;
+		case Request::Disconnect:
+			disconnectPM(request.id);
+			break;
+	}
+}
+
 static const int N_RETRIES = 2; // Number of retries for read/write/etc operations
 static const int N_CONN_RETRIES = 1; // Number of attempts to reconnect
 
-// Fetches data for a diven display, and emits displayDataError or displayDataReady when done
+// Fetches data for a diven display, and queues the result when done
 void PMConnectionWrapper::fetchDisplayData(enum PMDisplayNumber display, int id) {
-	if(failFast) {
-		emit displayDataError(display, id);
-		return;		
+	struct PMDisplayValue val;
+	bool wake;
+	if(readDisplay(display, id, val))
+		pushDisplayResult(display, val.val, id, false, wake);
+	else
+		pushDisplayResult(display, 0, id, true, wake);
+
+	if(wake)
+		emit displayResultsAvailable();
+}
+
+// Fetches every display in the set as one operation. The results are followed by an end of cycle
+// marker with the same id, and the GUI thread is only woken up once the whole set has been queued.
+void PMConnectionWrapper::fetchDisplaySet(const QVector<enum PMDisplayNumber> & displaySet, int id) {
+	bool wake = false;
+	bool pushWake;
+	foreach(enum PMDisplayNumber display, displaySet) {
+		struct PMDisplayValue val;
+		if(readDisplay(display, id, val))
+			pushDisplayResult(display, val.val, id, false, pushWake);
+		else
+			pushDisplayResult(display, 0, id, true, pushWake);
+		wake = wake || pushWake;
 	}
+
+	DisplayResult marker;
+	marker.display = PM_DINVALID;
+	marker.value = 0;
+	marker.id = id;
+	marker.error = false;
+	marker.endOfCycle = true;
+	if(displayResults.push(marker, pushWake))
+		wake = wake || pushWake;
+	else
+		qWarning() << "Display result queue full, dropping end of cycle marker";
+
+	if(wake)
+		emit displayResultsAvailable();
+}
+
+// Reads a single display, with retries and reconnection. Returns false on failure
+bool PMConnectionWrapper::readDisplay(enum PMDisplayNumber display, int id, struct PMDisplayValue & val) {
+	if(failFast)
+		return false;
 	if(conn == NULL)
 		connectPM(id);
-	if(conn == NULL) {
-		emit displayDataError(display, id);
-		return;
-	}
+	if(conn == NULL)
+		return false;
 
-	struct PMDisplayValue val;
 	int err = 0;
 	int reconnections = N_CONN_RETRIES;
 	while(true) {
@@ -49,11 +116,22 @@ void PMConnectionWrapper::fetchDisplayData(enum PMDisplayNumber display, int id)
 		if(err == PM_ERROR_CONNECTION || err == PM_ERROR_COMMUNICATION)
 			failFast = true;
 
-	 	emit displayDataError(display, id);
-	} else {
-	 	DisplayValue v(display, val);
-	 	emit displayDataReady(v, id);
+		return false;
 	}
+	return true;
+}
+
+// Hands a display result to the GUI thread. wake is set if the caller needs to emit displayResultsAvailable()
+void PMConnectionWrapper::pushDisplayResult(enum PMDisplayNumber display, int value, int id, bool error, bool & wake) {
+	DisplayResult result;
+	result.display = display;
+	result.value = value;
+	result.id = id;
+	result.error = error;
+	result.endOfCycle = false;
+
+	if(!displayResults.push(result, wake))
+		qWarning() << "Display result queue full, dropping display " << display;
 }
 
 // Fetches data for a diven program, and emits programDataFetchError or programDataReady when done
@@ -195,8 +273,16 @@ void PMConnectionWrapper::fetchLoggedData(LoggedValue::LoggedDataType type, int
 	status.type = type;
 	status.id = id;
 
-	struct PMPeriodicRecord *records = NULL;
-	struct PMProfileRecord *battery1Records = NULL, *battery2Records = NULL;
+	// Periodic and profile data are read as raw memory, which is kept with the decoded records so
+	// that it can be archived
+	QByteArray raw;
+	if(type == LoggedValue::TYPE_PERIODIC) {
+		raw.resize(PM_PERIODIC_PTR_SIZE + PM_PERIODIC_RAW_SIZE);
+	} else if(type == LoggedValue::TYPE_PROFILE) {
+		raw.resize(PM_PROFILE_PTR_SIZE + PM_PROFILE_RAW_SIZE);
+	}
+	unsigned char *rawPtr = (unsigned char *) raw.data();
+
 	struct PMEfficiencyRecord *battery1Eff = NULL;
 	struct PMEfficiencyRecord *battery2Eff = NULL;
 	// Only allocate efficiency buffers if needed
@@ -205,15 +291,36 @@ void PMConnectionWrapper::fetchLoggedData(LoggedValue::LoggedDataType type, int
 		battery2Eff = new struct PMEfficiencyRecord[PM_MAX_EFFICIENCY_RECORDS];
 	}
 	int nRecords1, nRecords2;
+	LoggedValue *v = NULL;
+	LoggedValue *v2 = NULL;
 
+	// The raw memory is decoded straight after it is read, so that a transfer that was corrupted
+	// (PM_ERROR_DATAFORMAT) is retried the same way as any other failed read
 	int err = 0;
 	int reconnections = N_CONN_RETRIES;
 	while(true) {
 		for(int j = 0; j < N_RETRIES + 1; j++) {
 			if(type == LoggedValue::TYPE_PERIODIC) {
-				err = PMReadPeriodicData(conn, &records, PMConnectionWrapperProgressCallback, &status);
+				err = PMReadPeriodicRaw(conn, rawPtr + PM_PERIODIC_PTR_SIZE, rawPtr, PMConnectionWrapperProgressCallback, &status);
+				if(err >= 0) {
+					v = new PeriodicLoggedValue(raw);
+					if(!v->isValid()) {
+						delete v;
+						v = NULL;
+						err = PM_ERROR_DATAFORMAT;
+					}
+				}
 			} else if(type == LoggedValue::TYPE_PROFILE) {
-				err = PMReadProfileData(conn, &battery1Records, &battery2Records,  PMConnectionWrapperProgressCallback, &status);
+				err = PMReadProfileRaw(conn, rawPtr + PM_PROFILE_PTR_SIZE, rawPtr, PMConnectionWrapperProgressCallback, &status);
+				if(err >= 0) {
+					ProfileLoggedValue *battery1, *battery2;
+					if(ProfileLoggedValue::decodeRaw(raw, battery1, battery2)) {
+						v = battery1;
+						v2 = battery2;
+					} else {
+						err = PM_ERROR_DATAFORMAT;
+					}
+				}
 			} else if(type == LoggedValue::TYPE_EFFICIENCY) {
 				err = PMReadEfficiencyData(conn, &nRecords1, battery1Eff, &nRecords2, battery2Eff, PMConnectionWrapperProgressCallback, &status);
 			} else {
@@ -238,23 +345,11 @@ void PMConnectionWrapper::fetchLoggedData(LoggedValue::LoggedDataType type, int
 		delete[] battery2Eff;
 	 	emit loggedDataError(type, id);
 	} else {
-		LoggedValue *v = NULL;
-		LoggedValue *v2 = NULL;
-		if(type == LoggedValue::TYPE_PERIODIC) {
-			v = new PeriodicLoggedValue(records); // These always initialize correctly, so no need to check isValid()
-			PMFreePeriodicData(records);
-		} else if(type == LoggedValue::TYPE_PROFILE) {
-			v = new ProfileLoggedValue(battery1Records, 1);
-			v2 = new ProfileLoggedValue(battery2Records, 2);
-			PMFreeProfileData(battery1Records);
-			PMFreeProfileData(battery2Records);
-		} else if(type == LoggedValue::TYPE_EFFICIENCY) {
+		if(type == LoggedValue::TYPE_EFFICIENCY) {
 			v = new EfficiencyLoggedValue(battery1Eff, nRecords1, 1);
 			v2 = new EfficiencyLoggedValue(battery2Eff, nRecords2, 2);
 			delete[] battery1Eff;
 			delete[] battery2Eff;
-		} else {
-			Q_ASSERT(0);
 		}
 
 	 	emit loggedDataReady(QSharedPointer<LoggedValue>(v), QSharedPointer<LoggedValue>(v2), id);
@@ -4,10 +4,12 @@
 #include "displayvalue.h"
 #include "programvalue.h"
 #include "loggedvalue.h"
+#include "displayresultqueue.h"
 
 #include <QString>
 #include <QObject>
 #include <QSharedPointer>
+#include <QVector>
 
 // Function used for progress callbacks
 void PM_CALLCONV PMConnectionWrapperProgressCallback(int progress, int outof, void *usrdata);
@@ -25,7 +27,12 @@ void PM_CALLCONV PMConnectionWrapperProgressCallback(int progress, int outof, vo
    emitted.
 
    Note that all types of data, except display data, are wrapped in QSharedPointer for reference
-   counting.
+   counting. Display data is read often enough that it skips the signal entirely: the results are
+   put in a DisplayResultQueue, and displayResultsAvailable() is emitted when the queue needs to
+   be drained.
+
+   The wrapper is normally driven by the IOScheduler rather than by its slots: each operation is
+   packaged into a Request, and the scheduler calls execute() on one of its worker threads.
  */
 class PMConnectionWrapper : public QObject {
 	Q_OBJECT
@@ -35,10 +42,42 @@ public:
 	PMConnectionWrapper(QString serialPort, QObject *parent = NULL);
 	~PMConnectionWrapper();
 
+	// A single queued operation. Only the fields relevant to the kind of request are used.
+	struct Request {
+		enum Kind {
+			FetchDisplay,
+			FetchDisplaySet,
+			FetchProgram,
+			SetProgram,
+			FetchLogged,
+			Reset,
+			ResetFailFast,
+			Disconnect
+		};
+
+		Request() : kind(Disconnect), id(-1) {}
+		Request(Kind kind, int id) : kind(kind), id(id) {}
+
+		Kind kind;
+		int id;
+		enum PMDisplayNumber display;
+		QVector<enum PMDisplayNumber> displaySet;
+		enum PMProgramNumber program;
+		QSharedPointer<ProgramValue> value;
+		LoggedValue::LoggedDataType loggedType;
+		enum PMResetType command;
+	};
+
+	// Runs a request synchronously on the calling thread
+	void execute(const Request & request);
+
+	// Display results are delivered through this queue instead of through a signal
+	DisplayResultQueue *displayResultQueue() { return &displayResults; }
+
 // All of these signals and slots are for requesting operations and receiving the results
 signals:
-	void displayDataReady(DisplayValue value, int id);
-	void displayDataError(enum PMDisplayNumber display, int id);
+	// Emitted when the display result queue goes from empty to non-empty
+	void displayResultsAvailable();
 
 	void programDataReady(QSharedPointer<ProgramValue> value, int id);
 	void programDataFetchError(enum PMProgramNumber program, int id);
@@ -56,6 +95,7 @@ signals:
 
 public slots:
 	void fetchDisplayData(enum PMDisplayNumber display, int id);
+	void fetchDisplaySet(const QVector<enum PMDisplayNumber> & displaySet, int id);
 
 	void fetchProgramData(enum PMProgramNumber program, int id);
 	void setProgramData(enum PMProgramNumber program, QSharedPointer<ProgramValue> value, int id);
@@ -71,6 +111,8 @@ public slots:
 	void resetFailFast();
 
 private:
+	bool readDisplay(enum PMDisplayNumber display, int id, struct PMDisplayValue & val);
+	void pushDisplayResult(enum PMDisplayNumber display, int value, int id, bool error, bool & wake);
 	void handleLoggedCallback(int id, LoggedValue::LoggedDataType type, int progress, int outof);
 	friend void PM_CALLCONV PMConnectionWrapperProgressCallback(int progress, int outof, void *usrdata);
 
@@ -80,6 +122,8 @@ private:
 	QString serialPort;
 	PMConnection *conn;
 
+	DisplayResultQueue displayResults;
+
 	bool failFast; // set to true when further requests should be ignored. Set on connection and
 				   // repeated communication errors
 };
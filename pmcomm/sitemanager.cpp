@@ -2,12 +2,17 @@
 
 #include "appsettings.h"
 #include "datafetcher.h"
+#include "historystore.h"
+
+#include <QDateTime>
 
 #include <QTimer>
+#include <QVector>
 
 #include <QDebug>
 
 static const int MAX_OUTSTANDING_REQUESTS = 2;
+static const int HEARTBEAT_INTERVAL = 10000; // How often the alarm state is polled when nobody is watching the site
 
 SiteManager::SiteManager(QSharedPointer<SiteSettings> settings, QObject *parent) : QObject(parent), settings(settings) {
 	fetcher = NULL;
@@ -20,14 +25,31 @@ SiteManager::SiteManager(QSharedPointer<SiteSettings> settings, QObject *parent)
 	labelsValid = false;
 	forceDisconnect = false;
 	nextId = 0;
+	snapshotMode = false;
+	outstandingCycleId = -1;
+	cycleTime = -1;
+	readCost = 100; // Until there is a real measurement
+	wasSaturated = false;
+	lastCompletion = 0;
+	clock.start();
 	outstandingLoggedRequest.second = -1;
 	downloadingLogged = false;
 	memset(smallShunt, 0, sizeof(smallShunt));
 	displays.insert(PM_DALARM); // Make sure the alarm state is always there
+	for(int i = 0; i < N_DISPLAY_SLOTS; i++) {
+		subscribers[i] = 0;
+		outstandingIds[i] = -1;
+		nextDue[i] = 0;
+		requestSentAt[i] = -1;
+	}
 
 	programDataTimer = new QTimer(this);
 	programDataTimer->setInterval(120000);
 
+	refreshTimer = new QTimer(this);
+	refreshTimer->setSingleShot(true);
+	connect(refreshTimer, SIGNAL(timeout()), this, SLOT(requestDisplays()));
+
 	connect(programDataTimer, SIGNAL(timeout()), this, SLOT(updateProgramData()));
 }
 
@@ -46,8 +68,7 @@ DataFetcher *SiteManager::getFetcher() {
 	fetcher = new DataFetcher(settings.data(), this);
 
 	connect(fetcher, SIGNAL(connected(int, int)), this, SLOT(handleConnected(int, int)));
-	connect(fetcher, SIGNAL(displayDataReady(DisplayValue &, int)), this, SLOT(handleData(DisplayValue &, int)));
-    connect(fetcher, SIGNAL(displayDataError(enum PMDisplayNumber, int)), this, SLOT(displayDataError(enum PMDisplayNumber, int)));
+	connect(fetcher, SIGNAL(displayResultsAvailable()), this, SLOT(drainDisplayResults()));
 	connect(fetcher, SIGNAL(programDataReady(QSharedPointer<ProgramValue>, int)), this, SLOT(handleProgramData(QSharedPointer<ProgramValue>, int)));
     connect(fetcher, SIGNAL(programDataFetchError(enum PMProgramNumber, int)), this, SLOT(fetchError(enum PMProgramNumber, int)));
 	connect(fetcher, SIGNAL(programDataStored(enum PMProgramNumber, int)), this, SLOT(programDataStored(enum PMProgramNumber, int)));
@@ -106,6 +127,8 @@ void SiteManager::startUpdating() {
 
 	updating = true;
 	shouldUpdate = true;
+	snapshotMode = AppSettings::getInstance()->getSnapshotPolling();
+	scheduled.clear(); // Everything is fetched right away
 	updateProgramData();
 	programDataTimer->start();
 	requestDisplays();
@@ -124,8 +147,10 @@ void SiteManager::stopUpdatingError() {
 void SiteManager::stopUpdatingImpl() {
 	updating = false;
 	updatedDisplays.clear();
-	upcomingRequests.clear();
 	outstandingRequests.clear();
+	outstandingCycleId = -1;
+	pendingValues.clear();
+	refreshTimer->stop();
 	programDataTimer->stop();
 
 	emit allDisplaysUpdated();
@@ -141,20 +166,29 @@ void SiteManager::handleConnected(int id, int version) {
 	emit versionUpdated();
 }
 
-void SiteManager::addDisplay(enum PMDisplayNumber display) {
-	displays.insert(display);
+// Registers interest in a display. Only displays with at least one subscriber are polled,
+// except for the alarm state, which is always polled (slowly, if nobody is subscribed)
+void SiteManager::subscribe(enum PMDisplayNumber display) {
+	if(++subscribers[displaySlot(display)] > 1)
+		return;
 
+	displays.insert(display);
 	requestIfNeeded(display);
 }
 
-void SiteManager::removeDisplay(enum PMDisplayNumber display) {
-	if(display == PM_DALARM) // Don't ever remove the alarm state
+void SiteManager::unsubscribe(enum PMDisplayNumber display) {
+	int & count = subscribers[displaySlot(display)];
+	if(count == 0 || --count > 0)
+		return;
+
+	if(display == PM_DALARM) // Don't ever remove the alarm state, it just falls back to the heartbeat
 		return;
 
 	displays.remove(display);
-	upcomingRequests.removeAll(display);
+	scheduled.remove(display);
 	outstandingRequests.remove(display); // Do I really want to do this?
 	updatedDisplays.remove(display);
+	pendingValues.remove(display);
 }
 
 bool SiteManager::batteryPresent(int battery) {
@@ -166,8 +200,8 @@ bool SiteManager::batteryPresent(int battery) {
 }
 
 DisplayValue SiteManager::getDisplay(enum PMDisplayNumber display) {
-	if(currentValues.contains(display) && displayValid(display)) {
-		return currentValues[display];
+	if(haveValues.contains(display) && displayValid(display)) {
+		return currentValues[displaySlot(display)];
 	}
 
 	return DisplayValue();
@@ -294,31 +328,270 @@ void SiteManager::requestDisplays() {
 	if(!updating)
 		return;
 
-	bool refilled = false;
+	rebaseClock();
+
+	if(snapshotMode) {
+		requestSnapshot();
+		return;
+	}
+
 	while(outstandingRequests.size() < MAX_OUTSTANDING_REQUESTS) {
-		if(upcomingRequests.isEmpty()) {
-			if(refilled) // Displays can't be empty, since it always contains at least PM_DALARM
-				return;
-			refilled = true;
-			upcomingRequests = displays.toList();
-			qSort(upcomingRequests);
+		enum PMDisplayNumber display;
+		if(dueDisplays(&display, 1) == 0)
+			break;
+
+		qDebug() << "Fetching display " << display;
+		int id = generateId();
+		int now = clock.elapsed();
+		int slot = displaySlot(display);
+		nextDue[slot] = now + refreshInterval(display);
+		scheduled.insert(display);
+		requestSentAt[slot] = now;
+		outstandingRequests.insert(display);
+		outstandingIds[slot] = id;
+		getFetcher()->fetchDisplayData(display, id);
+	}
+
+	if(outstandingRequests.isEmpty())
+		scheduleNextRefresh();
+}
+
+// Makes the display due immediately
+void SiteManager::requestIfNeeded(enum PMDisplayNumber display) {
+	scheduled.remove(display);
+	if(updating && outstandingRequests.isEmpty())
+		requestDisplays();
+}
+
+// Fills in up to limit displays that are due to be fetched, most overdue first, and returns how many
+// there were. Lateness is measured relative to each display's refresh interval, so a fast-changing
+// display that is one second late goes ahead of a temperature reading that is ten seconds late.
+int SiteManager::dueDisplays(enum PMDisplayNumber *due, int limit) {
+	int now = clock.elapsed();
+
+	double lateness[N_DISPLAY_SLOTS];
+	int n = 0;
+	for(int slot = displays.first(); slot >= 0; slot = displays.next(slot)) {
+		enum PMDisplayNumber display = slotDisplay(slot);
+		if(!displayValid(display) || outstandingRequests.contains(display))
+			continue;
+
+		double late;
+		if(!scheduled.contains(display)) {
+			late = 1e9; // Never fetched
+		} else {
+			int ms = now - nextDue[slot];
+			if(ms < 0)
+				continue;
+			late = (double) ms / refreshInterval(display);
 		}
 
-		enum PMDisplayNumber display = upcomingRequests.takeFirst();
-		if(displayValid(display) && !outstandingRequests.contains(display)) {
-			qDebug() << "Fetching display " << display;
-			int id = generateId();
-			getFetcher()->fetchDisplayData(display, id);
-			outstandingRequests.insert(display, id);
+		// Insertion sort, since there are only a few dozen displays at most
+		int pos = qMin(n, limit);
+		while(pos > 0 && lateness[pos - 1] < late) {
+			if(pos < limit) {
+				lateness[pos] = lateness[pos - 1];
+				due[pos] = due[pos - 1];
+			}
+			pos--;
+		}
+		if(pos < limit) {
+			lateness[pos] = late;
+			due[pos] = display;
+			if(n < limit)
+				n++;
 		}
 	}
+	return n;
 }
 
-void SiteManager::requestIfNeeded(enum PMDisplayNumber display) {
-	if(!updating || upcomingRequests.contains(display))
+// Sets a timer for when the next display becomes due. Only used when nothing is outstanding.
+void SiteManager::scheduleNextRefresh() {
+	if(!updating)
+		return;
+
+	int now = clock.elapsed();
+	int wait = -1;
+	for(int slot = displays.first(); slot >= 0; slot = displays.next(slot)) {
+		enum PMDisplayNumber display = slotDisplay(slot);
+		if(!displayValid(display))
+			continue;
+		int delay = scheduled.contains(display) ? qMax(0, nextDue[slot] - now) : 0;
+		if(wait < 0 || delay < wait)
+			wait = delay;
+	}
+	if(wait < 0)
+		return;
+
+	refreshTimer->start(wait);
+}
+
+// QTime wraps around after a day, so move all of the times back well before that can happen
+void SiteManager::rebaseClock() {
+	if(clock.elapsed() < 12 * 60 * 60 * 1000)
+		return;
+
+	int shift = clock.restart();
+	for(int slot = 0; slot < N_DISPLAY_SLOTS; slot++) {
+		nextDue[slot] -= shift;
+		if(requestSentAt[slot] >= 0)
+			requestSentAt[slot] -= shift;
+	}
+	lastCompletion -= shift;
+}
+
+// Gets the refresh interval for a display, taking the alarm heartbeat into account
+int SiteManager::refreshInterval(enum PMDisplayNumber display) {
+	if(display == PM_DALARM && subscribers[displaySlot(PM_DALARM)] == 0)
+		return qMax(HEARTBEAT_INTERVAL, settings->getRefreshInterval(display));
+
+	return settings->getRefreshInterval(display);
+}
+
+// Folds a new measurement of the time it takes to read one display into the estimate
+void SiteManager::updateReadCost(double msecs) {
+	readCost = 0.8 * readCost + 0.2 * msecs;
+
+	bool saturated = linkSaturated();
+	if(saturated != wasSaturated) {
+		qDebug() << "Link" << (saturated ? "saturated" : "no longer saturated") << ", " << readCost << " ms per display";
+		wasSaturated = saturated;
+	}
+}
+
+// Gets the fraction of the link's time that the refresh intervals of every display need. Above 1
+// the link is saturated and can't keep up
+double SiteManager::linkLoad() {
+	double load = 0;
+	for(int slot = displays.first(); slot >= 0; slot = displays.next(slot)) {
+		enum PMDisplayNumber display = slotDisplay(slot);
+		if(displayValid(display))
+			load += readCost / refreshInterval(display);
+	}
+	return load;
+}
+
+bool SiteManager::linkSaturated() {
+	return linkLoad() > 1.0;
+}
+
+// Handles every display result that has come in since the last time this was called
+void SiteManager::drainDisplayResults() {
+	if(fetcher == NULL)
+		return;
+
+	fetcher->beginDisplayDrain();
+	DisplayResult result;
+	while(fetcher != NULL && fetcher->takeDisplayResult(result)) {
+		if(outstandingCycleId != -1 && result.id == outstandingCycleId) {
+			handleSnapshotResult(result);
+		} else if(result.endOfCycle || snapshotMode) {
+			continue; // Left over from a cycle that was abandoned
+		} else if(result.error) {
+			displayDataError(result.display, result.id);
+		} else {
+			DisplayValue value(result.display, result.value);
+			handleData(value, result.id);
+		}
+	}
+}
+
+// Starts a new snapshot cycle with the displays that are due, unless one is already running.
+// If the link is saturated, the cycle is limited to what can be read within the shortest refresh
+// interval, and the rest are deferred to a later cycle.
+void SiteManager::requestSnapshot() {
+	if(outstandingCycleId != -1)
+		return;
+
+	int limit = displays.size();
+	if(linkSaturated()) {
+		int shortest = -1;
+		for(int slot = displays.first(); slot >= 0; slot = displays.next(slot)) {
+			int interval = refreshInterval(slotDisplay(slot));
+			if(shortest < 0 || interval < shortest)
+				shortest = interval;
+		}
+		limit = qMax(1, (int) (shortest / readCost));
+	}
+
+	enum PMDisplayNumber due[N_DISPLAY_SLOTS];
+	int nDue = dueDisplays(due, qMin(limit, (int) N_DISPLAY_SLOTS));
+	if(nDue == 0) {
+		scheduleNextRefresh();
 		return;
+	}
+	qSort(due, due + nDue);
+
+	int id = generateId();
+	int now = clock.elapsed();
+	QVector<enum PMDisplayNumber> displaySet(nDue);
+	for(int i = 0; i < nDue; i++) {
+		enum PMDisplayNumber display = due[i];
+		int slot = displaySlot(display);
+		displaySet[i] = display;
+		nextDue[slot] = now + refreshInterval(display);
+		scheduled.insert(display);
+		requestSentAt[slot] = -1; // Timed as a whole cycle instead
+		outstandingRequests.insert(display); // So that errors are recognized by displayDataError()
+		outstandingIds[slot] = id;
+	}
+	outstandingCycleId = id;
+	pendingValues.clear();
+	cycleTimer.start();
 
-	upcomingRequests.append(display);
+	qDebug() << "Fetching snapshot of " << displaySet.size() << " displays";
+	getFetcher()->fetchDisplaySet(displaySet, id);
+}
+
+// Collects the results of the current snapshot cycle, and applies all of them at once at the end
+void SiteManager::handleSnapshotResult(DisplayResult & result) {
+	if(result.error) {
+		displayDataError(result.display, result.id);
+		return;
+	}
+
+	if(!result.endOfCycle) {
+		if(displays.contains(result.display)) {
+			pendingValues.insert(result.display);
+			pendingData[displaySlot(result.display)] = DisplayValue(result.display, result.value);
+		}
+		return;
+	}
+
+	if(errorPending == ErrorCleared) {
+		errorPending = ErrorOK;
+		emit statusChanged(getStatus());
+	}
+
+	HistoryStore *history = HistoryStore::getInstance();
+	qint64 now = QDateTime::currentDateTime().toTime_t();
+	for(int slot = pendingValues.first(); slot >= 0; slot = pendingValues.next(slot)) {
+		DisplayValue & data = pendingData[slot];
+		if(history)
+			history->append(settings->getId(), slotDisplay(slot), now, data.getRawIntValue());
+		int ampsChannel = data.ampsChannel();
+		if(ampsChannel != 0) {
+			data.setPrecision(smallShunt[ampsChannel - 1] ? 2 : 1);
+		}
+
+		currentValues[slot] = data;
+		haveValues.insert(slotDisplay(slot));
+		updatedDisplays.insert(slotDisplay(slot));
+	}
+	int cycleSize = outstandingRequests.size();
+	pendingValues.clear();
+	outstandingRequests.clear();
+	outstandingCycleId = -1;
+
+	cycleTime = cycleTimer.elapsed();
+	qDebug() << "Snapshot cycle took " << cycleTime << " ms";
+	updateReadCost((double) cycleTime / qMax(1, cycleSize));
+
+	emit allDisplaysUpdated();
+	emit cycleCompleted(cycleTime);
+
+	// Start the next cycle
+	requestDisplays();
 }
 
 void SiteManager::handleData(DisplayValue & data, int id) {
@@ -334,8 +607,22 @@ void SiteManager::handleData(DisplayValue & data, int id) {
 		data.setPrecision(smallShunt[ampsChannel - 1] ? 2 : 1);
 	}
 
-	currentValues[display] = data;
-	outstandingRequests.remove(display, id);
+	int slot = displaySlot(display);
+	currentValues[slot] = data;
+	haveValues.insert(display);
+	if(HistoryStore::getInstance())
+		HistoryStore::getInstance()->append(settings->getId(), display, QDateTime::currentDateTime().toTime_t(), data.getRawIntValue());
+	if(outstandingRequests.contains(display) && outstandingIds[slot] == id) {
+		outstandingRequests.remove(display);
+
+		if(requestSentAt[slot] >= 0) {
+			// Requests are run one at a time, so a request can't have started before the previous one finished
+			int now = clock.elapsed();
+			updateReadCost(now - qMax(requestSentAt[slot], lastCompletion));
+			lastCompletion = now;
+			requestSentAt[slot] = -1;
+		}
+	}
 
 	if(updating)
 		updatedDisplays.insert(display);
@@ -346,7 +633,7 @@ void SiteManager::handleData(DisplayValue & data, int id) {
 }
 
 void SiteManager::displayDataError(enum PMDisplayNumber display, int id) {
-	if(outstandingRequests.contains(display, id)) {
+	if(outstandingRequests.contains(display) && outstandingIds[displaySlot(display)] == id) {
 		bool newError = errorPending != ErrorHappened;
 		errorPending = ErrorHappened;
 		stopUpdatingError();
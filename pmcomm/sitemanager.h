@@ -6,6 +6,8 @@
 #include "loggeddata.h"
 #include "sitesettings.h"
 #include "programvalue.h"
+#include "displayresultqueue.h"
+#include "displayslots.h"
 
 #include <QObject>
 #include <QString>
@@ -13,6 +15,7 @@
 #include <QSharedPointer>
 #include <QMultiMap>
 #include <QPair>
+#include <QTime>
 
 class DataFetcher;
 
@@ -39,8 +42,9 @@ public:
 	};
 	Status getStatus();
 
-	void addDisplay(enum PMDisplayNumber display);
-	void removeDisplay(enum PMDisplayNumber display);
+	// Each call to subscribe() must be matched by a call to unsubscribe()
+	void subscribe(enum PMDisplayNumber display);
+	void unsubscribe(enum PMDisplayNumber display);
 
 	DisplayValue getDisplay(enum PMDisplayNumber display);
 	bool displayUpToDate(enum PMDisplayNumber display);
@@ -61,16 +65,27 @@ public:
 	QPair<int, int> & firmwareVersion() { return version; }
 	QPair<int, int> & interfaceFirmwareVersion() { return interfaceVersion; }
 
+	// Time taken by the last complete snapshot cycle in ms, or -1 if there hasn't been one
+	int lastCycleTime() { return cycleTime; }
+
+	// The displays that getDisplay() has a value for
+	DisplaySet knownDisplays() { return haveValues; }
+
+	// Estimated time to read one display in ms, and the fraction of the link's time that the
+	// polled displays need at their refresh intervals. Above 1 the displays fall behind
+	double averageReadTime() { return readCost; }
+	double linkLoad();
+
 public slots:
 	void fetchProgram(enum PMProgramNumber program);
 	void saveProgramData(QSharedPointer<ProgramValue> & value);
    	void updateProgramData();
 	void finishError(bool retry, bool noError = false);
 	void cancelLoggedDownload();
+	void requestDisplays();
 
 	// These aren't meant to be called directly (only as a slot invocation)
-    void handleData(DisplayValue & value, int id);
-    void displayDataError(enum PMDisplayNumber display, int id);
+	void drainDisplayResults();
     void handleProgramData(QSharedPointer<ProgramValue> data, int id);
    	void fetchError(enum PMProgramNumber program, int id);
 	void programDataStored(enum PMProgramNumber program, int id);
@@ -99,6 +114,7 @@ signals:
 	void errorCanceled();
 
 	void statusChanged(SiteManager::Status newStatus);
+	void cycleCompleted(int msecs);
 
 	void loggedDataDownloaded();
 	void loggedDataProgress(LoggedValue::LoggedDataType type, int progress, int outof);
@@ -108,10 +124,20 @@ private:
 
 	bool displayValid(enum PMDisplayNumber display);
 
+	void handleData(DisplayValue & value, int id);
+	void displayDataError(enum PMDisplayNumber display, int id);
+	void handleSnapshotResult(DisplayResult & result);
+	void requestSnapshot();
+
 	void stopUpdatingError();
 	void stopUpdatingImpl();
-	void requestDisplays();
 	void requestIfNeeded(enum PMDisplayNumber display);
+	int dueDisplays(enum PMDisplayNumber *due, int limit);
+	void scheduleNextRefresh();
+	void rebaseClock();
+	int refreshInterval(enum PMDisplayNumber display);
+	void updateReadCost(double msecs);
+	bool linkSaturated();
 
 	bool getResetCommand(enum PMDisplayNumber display, enum PMResetType & command);
 
@@ -135,11 +161,35 @@ private:
 	DataFetcher *fetcher;
 	QSharedPointer<SiteSettings> settings;
 	// QString siteName;
-	QMap<enum PMDisplayNumber, DisplayValue> currentValues;
-	QSet<enum PMDisplayNumber> updatedDisplays;
-	QSet<enum PMDisplayNumber> displays;
-	QMultiMap<enum PMDisplayNumber, int> outstandingRequests;
-	QList<enum PMDisplayNumber> upcomingRequests;
+
+	// All of the per-display state is indexed by displaySlot()
+	DisplayValue currentValues[N_DISPLAY_SLOTS]; // Only meaningful for displays in haveValues
+	DisplaySet haveValues;
+	DisplaySet updatedDisplays;
+	DisplaySet displays; // The displays being polled
+	int subscribers[N_DISPLAY_SLOTS]; // Number of subscribers to each display
+	DisplaySet outstandingRequests;
+	int outstandingIds[N_DISPLAY_SLOTS]; // Id of the outstanding request for each display in outstandingRequests
+
+	// Each display is fetched again once its refresh interval (from the site settings) has passed.
+	// Times are in ms on clock.
+	QTime clock;
+	int nextDue[N_DISPLAY_SLOTS]; // Only meaningful for displays in scheduled
+	DisplaySet scheduled;
+	int requestSentAt[N_DISPLAY_SLOTS]; // Time each outstanding single display request was sent, or -1
+	int lastCompletion;
+	double readCost; // Moving average of the time to read one display, in ms
+	bool wasSaturated;
+	QTimer *refreshTimer;
+
+	// Snapshot mode: the whole display set is fetched in one request, and the results are
+	// only applied once all of them have arrived
+	bool snapshotMode;
+	int outstandingCycleId;
+	DisplaySet pendingValues;
+	DisplayValue pendingData[N_DISPLAY_SLOTS];
+	QTime cycleTimer;
+	int cycleTime;
 
 	QPair<int, int> version;
 	QPair<int, int> interfaceVersion;
@@ -214,6 +214,7 @@ void SitesDialog::saveSiteData(int row) {
 	}
 
 	newSettings->setName(siteName->text());
+	newSettings->setRefreshIntervals(oldSettings->getRefreshIntervals());
 
 	sitesListWidget->item(row)->setData(Qt::UserRole, QVariant::fromValue(QSharedPointer<SiteSettings>(newSettings)));
 }
@@ -59,6 +59,69 @@ void SiteSettings::setDownloadInterval(int secs) {
 	downloadInterval = secs;
 }
 
+int SiteSettings::getRefreshInterval(enum PMDisplayNumber display) const {
+	return refreshIntervals.value(display, defaultRefreshInterval(display));
+}
+
+// Setting an interval of 0 or less goes back to the default
+void SiteSettings::setRefreshInterval(enum PMDisplayNumber display, int msecs) {
+	if(msecs <= 0 || msecs == defaultRefreshInterval(display))
+		refreshIntervals.remove(display);
+	else
+		refreshIntervals.insert(display, msecs);
+}
+
+// Gets the default refresh interval, based on how quickly the display is expected to change
+int SiteSettings::defaultRefreshInterval(enum PMDisplayNumber display) {
+	switch(display) {
+		// Instantaneous values
+		case PM_D1:
+		case PM_D2:
+		case PM_D7:
+		case PM_D8:
+		case PM_D9:
+		case PM_D18:
+		case PM_D19:
+		case PM_DALARM: return 1000;
+
+		// Averages
+		case PM_D3:
+		case PM_D4:
+		case PM_D10:
+		case PM_D11:
+		case PM_D12: return 5000;
+
+		// Accumulated values
+		case PM_D13:
+		case PM_D14:
+		case PM_D15:
+		case PM_D16:
+		case PM_D17:
+		case PM_D20:
+		case PM_D21: return 10000;
+
+		// Battery state
+		case PM_D22:
+		case PM_D23:
+		case PM_D24:
+		case PM_D25:
+		case PM_D26:
+		case PM_D27: return 30000;
+
+		case PM_D28: return 60000; // Temperature
+
+		default: return 10000;
+	}
+}
+
+QMap<int, int> SiteSettings::getRefreshIntervals() const {
+	return refreshIntervals;
+}
+
+void SiteSettings::setRefreshIntervals(const QMap<int, int> & intervals) {
+	refreshIntervals = intervals;
+}
+
 void SiteSettings::saveChanges() {
 	AppSettings *appSettings = AppSettings::getInstance();
 	appSettings->saveSites();
@@ -1,7 +1,10 @@
 #ifndef SITESETTINGS_H
 #define SITESETTINGS_H
 
+#include "pmdefs.h"
+
 #include <QString>
+#include <QMap>
 #include <QSharedPointer>
 #include <QMetaType>
 
@@ -27,6 +30,15 @@ public:
 	int getDownloadInterval() const;
 	void setDownloadInterval(int secs);
 
+	// How often a display is fetched while updating, in ms
+	int getRefreshInterval(enum PMDisplayNumber display) const;
+	void setRefreshInterval(enum PMDisplayNumber display, int msecs);
+	static int defaultRefreshInterval(enum PMDisplayNumber display);
+
+	// Only the intervals that differ from the defaults, by display number
+	QMap<int, int> getRefreshIntervals() const;
+	void setRefreshIntervals(const QMap<int, int> & intervals);
+
 	void saveChanges();
 
 	bool conflictsWith(const SiteSettings & other) const;
@@ -42,6 +54,7 @@ private:
 	QString serialPort;
 
 	int downloadInterval;
+	QMap<int, int> refreshIntervals;
 };
 
 Q_DECLARE_METATYPE(QSharedPointer<SiteSettings>);
@@ -0,0 +1,474 @@
+#include "statusserver.h"
+
+#include "siteslist.h"
+#include "sitesettings.h"
+#include "historystore.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QDateTime>
+#include <QtAlgorithms>
+
+#include <QDebug>
+
+static const int MAX_REQUEST_SIZE = 8192;
+static const int EVENT_INTERVAL = 250; // Minimum time between "values" events
+static const int KEEPALIVE_INTERVAL = 15000;
+static const qint64 MAX_EVENT_BACKLOG = 1 << 20; // Bytes
+static const qint64 MAX_HISTORY_SPAN = 7 * 86400; // Seconds of history that one request can ask for
+
+StatusServer::StatusServer(SitesList *sitesList, quint16 port, QObject *parent) : QObject(parent) {
+	this->sitesList = sitesList;
+
+	eventTimer = new QTimer(this);
+	eventTimer->setSingleShot(true);
+	connect(eventTimer, SIGNAL(timeout()), this, SLOT(sendEvents()));
+
+	keepAliveTimer = new QTimer(this);
+	keepAliveTimer->setInterval(KEEPALIVE_INTERVAL);
+	connect(keepAliveTimer, SIGNAL(timeout()), this, SLOT(sendKeepAlive()));
+
+	server = new QTcpServer(this);
+	connect(server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+	if(!server->listen(QHostAddress::LocalHost, port))
+		qWarning() << "Status server could not listen on port" << port << ":" << server->errorString();
+
+	connect(sitesList, SIGNAL(managersAdded(const QList<SiteManager *> &)), this, SLOT(managersAdded(const QList<SiteManager *> &)));
+	connect(sitesList, SIGNAL(managersRemoved(const QList<SiteManager *> &)), this, SLOT(managersRemoved(const QList<SiteManager *> &)));
+	managersAdded(sitesList->getManagers().values());
+}
+
+StatusServer::~StatusServer() {
+	server->close();
+}
+
+bool StatusServer::isListening() {
+	return server->isListening();
+}
+
+void StatusServer::managersAdded(const QList<SiteManager *> & managers) {
+	foreach(SiteManager *manager, managers) {
+		connect(manager, SIGNAL(displayUpdated(PMDisplayNumber)), this, SLOT(displayUpdated(PMDisplayNumber)));
+		connect(manager, SIGNAL(allDisplaysUpdated()), this, SLOT(allDisplaysUpdated()));
+		connect(manager, SIGNAL(statusChanged(SiteManager::Status)), this, SLOT(statusChanged(SiteManager::Status)));
+	}
+}
+
+void StatusServer::managersRemoved(const QList<SiteManager *> & managers) {
+	foreach(SiteManager *manager, managers) {
+		disconnect(manager, 0, this, 0);
+		QMutableSetIterator<QPair<SiteManager *, int> > it(changedDisplays);
+		while(it.hasNext()) {
+			if(it.next().first == manager)
+				it.remove();
+		}
+	}
+}
+
+void StatusServer::newConnection() {
+	while(server->hasPendingConnections()) {
+		QTcpSocket *socket = server->nextPendingConnection();
+		connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+		requestBuffers.insert(socket, QByteArray());
+	}
+}
+
+void StatusServer::clientDisconnected() {
+	QTcpSocket *socket = (QTcpSocket *) sender();
+	requestBuffers.remove(socket);
+	eventClients.removeAll(socket);
+	if(eventClients.isEmpty())
+		keepAliveTimer->stop();
+	socket->deleteLater();
+}
+
+void StatusServer::readRequest() {
+	QTcpSocket *socket = (QTcpSocket *) sender();
+	if(!requestBuffers.contains(socket)) { // Already answered; ignore anything else it sends
+		socket->readAll();
+		return;
+	}
+
+	QByteArray & buffer = requestBuffers[socket];
+	buffer.append(socket->readAll());
+
+	int headerEnd = buffer.indexOf("\r\n\r\n");
+	if(headerEnd < 0) {
+		if(buffer.size() > MAX_REQUEST_SIZE) {
+			requestBuffers.remove(socket);
+			sendResponse(socket, 431, "Request Header Fields Too Large", "{\"error\":\"request too large\"}");
+		}
+		return;
+	}
+
+	QList<QByteArray> requestLine = buffer.left(buffer.indexOf("\r\n")).split(' ');
+	requestBuffers.remove(socket);
+	if(requestLine.size() != 3) {
+		sendResponse(socket, 400, "Bad Request", "{\"error\":\"bad request\"}");
+		return;
+	}
+
+	handleRequest(socket, requestLine[0], requestLine[1]);
+}
+
+void StatusServer::handleRequest(QTcpSocket *socket, const QByteArray & method, const QByteArray & target) {
+	if(method != "GET") {
+		sendResponse(socket, 405, "Method Not Allowed", "{\"error\":\"only GET is supported\"}");
+		return;
+	}
+
+	int queryStart = target.indexOf('?');
+	QByteArray path = queryStart < 0 ? target : target.left(queryStart);
+	QByteArray query = queryStart < 0 ? QByteArray() : target.mid(queryStart + 1);
+
+	if(path == "/events") {
+		socket->write("HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/event-stream\r\n"
+			"Cache-Control: no-cache\r\n"
+			"Connection: keep-alive\r\n"
+			"\r\n");
+		// Start the stream with the current state so clients don't need a separate request
+		socket->write("event: values\ndata: " + valuesJson(sitesList->getManagers().values()) + "\n\n");
+		eventClients.append(socket);
+		if(!keepAliveTimer->isActive())
+			keepAliveTimer->start();
+		return;
+	}
+
+	if(path == "/sites") {
+		sendResponse(socket, 200, "OK", sitesJson());
+		return;
+	}
+
+	if(path == "/history") {
+		sendHistory(socket, query);
+		return;
+	}
+
+	bool found;
+	QList<SiteManager *> managers = selectedManagers(query, found);
+	if(!found) {
+		sendResponse(socket, 404, "Not Found", "{\"error\":\"no such site\"}");
+		return;
+	}
+
+	if(path == "/values")
+		sendResponse(socket, 200, "OK", valuesJson(managers));
+	else if(path == "/alarms")
+		sendResponse(socket, 200, "OK", alarmsJson(managers));
+	else if(path == "/stats")
+		sendResponse(socket, 200, "OK", statsJson(managers));
+	else
+		sendResponse(socket, 404, "Not Found", "{\"error\":\"not found\"}");
+}
+
+void StatusServer::sendResponse(QTcpSocket *socket, int status, const QByteArray & reason, const QByteArray & body) {
+	QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + " " + reason + "\r\n";
+	response += "Content-Type: application/json\r\n";
+	response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+	response += "Cache-Control: no-cache\r\n";
+	response += "Connection: close\r\n\r\n";
+	response += body;
+	socket->write(response);
+	socket->disconnectFromHost(); // Closes once everything has been written
+}
+
+void StatusServer::sendHistory(QTcpSocket *socket, const QByteArray & query) {
+	HistoryStore *history = HistoryStore::getInstance();
+	if(history == NULL) {
+		sendResponse(socket, 404, "Not Found", "{\"error\":\"history is not enabled\"}");
+		return;
+	}
+
+	int site = -1, display = PM_DINVALID;
+	qint64 to = QDateTime::currentDateTime().toTime_t();
+	qint64 from = to - 3600;
+	bool ok = true;
+	foreach(QByteArray param, query.split('&')) {
+		bool valid = true;
+		if(param.startsWith("site="))
+			site = param.mid(5).toInt(&valid);
+		else if(param.startsWith("display="))
+			display = param.mid(8).toInt(&valid);
+		else if(param.startsWith("from="))
+			from = param.mid(5).toLongLong(&valid);
+		else if(param.startsWith("to="))
+			to = param.mid(3).toLongLong(&valid);
+		ok = ok && valid;
+	}
+
+	if(!ok || display == PM_DINVALID || to < from || to - from > MAX_HISTORY_SPAN) {
+		sendResponse(socket, 400, "Bad Request", "{\"error\":\"bad site, display or range\"}");
+		return;
+	}
+	if(!sitesList->getManagers().contains(site)) {
+		sendResponse(socket, 404, "Not Found", "{\"error\":\"no such site\"}");
+		return;
+	}
+
+	QVector<HistorySample> samples = history->read(site, (enum PMDisplayNumber) display, from, to);
+	QByteArray json = "{\"site\":" + QByteArray::number(site) + ",\"display\":" + QByteArray::number(display) + ",\"samples\":[";
+	for(int i = 0; i < samples.size(); i++) {
+		if(i > 0)
+			json += ",";
+		json += "[" + QByteArray::number(samples[i].time) + "," + QByteArray::number(samples[i].value) + "]";
+	}
+	json += "]}";
+	sendResponse(socket, 200, "OK", json);
+}
+
+// Returns every manager, or only the one given by ?site=<id>. found is false if that site doesn't exist
+QList<SiteManager *> StatusServer::selectedManagers(const QByteArray & query, bool & found) {
+	found = true;
+	const QMap<int, SiteManager *> & managers = sitesList->getManagers();
+
+	foreach(QByteArray param, query.split('&')) {
+		if(param.startsWith("site=")) {
+			bool ok;
+			int id = param.mid(5).toInt(&ok);
+			QList<SiteManager *> result;
+			if(ok && managers.contains(id))
+				result.append(managers[id]);
+			else
+				found = false;
+			return result;
+		}
+	}
+
+	return managers.values();
+}
+
+QByteArray StatusServer::sitesJson() {
+	QByteArray json = "[";
+	bool first = true;
+	foreach(SiteManager *manager, sitesList->getManagers()) {
+		if(!first)
+			json += ",";
+		first = false;
+		json += siteJson(manager);
+	}
+	json += "]";
+	return json;
+}
+
+QByteArray StatusServer::siteJson(SiteManager *manager) {
+	QSharedPointer<SiteSettings> settings = manager->getSettings();
+	return "{\"id\":" + QByteArray::number(settings->getId())
+		+ ",\"name\":" + jsonString(settings->getName())
+		+ ",\"status\":" + statusString(manager->getStatus()) + "}";
+}
+
+QByteArray StatusServer::valuesJson(const QList<SiteManager *> & managers) {
+	QByteArray json = "[";
+	bool firstSite = true;
+	foreach(SiteManager *manager, managers) {
+		if(!firstSite)
+			json += ",";
+		firstSite = false;
+
+		json += "{\"site\":" + QByteArray::number(manager->getSettings()->getId()) + ",\"displays\":[";
+		DisplaySet known = manager->knownDisplays();
+		for(int slot = known.first(); slot >= 0; slot = known.next(slot)) {
+			if(slot != known.first())
+				json += ",";
+			json += displayJson(manager, slotDisplay(slot));
+		}
+		json += "]}";
+	}
+	json += "]";
+	return json;
+}
+
+QByteArray StatusServer::displayJson(SiteManager *manager, enum PMDisplayNumber display) {
+	DisplayValue value = manager->getDisplay(display);
+	return "{\"display\":" + QByteArray::number(display)
+		+ ",\"label\":" + jsonString(manager->getLabel(display))
+		+ ",\"text\":" + jsonString(value.toString())
+		+ ",\"raw\":" + QByteArray::number(value.getRawIntValue())
+		+ ",\"upToDate\":" + (manager->displayUpToDate(display) ? "true" : "false") + "}";
+}
+
+QByteArray StatusServer::alarmsJson(const QList<SiteManager *> & managers) {
+	static const struct {
+		const char *name;
+		int mask;
+	} alarms[] = {
+		{"battery1Low", PM_ALARMVAL_BAT1_LOW},
+		{"battery1Charged", PM_ALARMVAL_BAT1_CHARGED},
+		{"battery1High", PM_ALARMVAL_BAT1_HIGH},
+		{"battery1NeedCharge", PM_ALARMVAL_BAT1_NEEDCHARGE},
+		{"battery1NeedEqualize", PM_ALARMVAL_BAT1_NEEDEQUALIZE},
+		{"battery2Low", PM_ALARMVAL_BAT2_LOW},
+		{"battery2Charged", PM_ALARMVAL_BAT2_CHARGED},
+		{"battery2High", PM_ALARMVAL_BAT2_HIGH},
+		{"battery2NeedCharge", PM_ALARMVAL_BAT2_NEEDCHARGE},
+		{"battery2NeedEqualize", PM_ALARMVAL_BAT2_NEEDEQUALIZE},
+		{"relayOn", PM_ALARMVAL_RELAY_ON}
+	};
+
+	QByteArray json = "[";
+	bool first = true;
+	foreach(SiteManager *manager, managers) {
+		if(!first)
+			json += ",";
+		first = false;
+
+		json += "{\"site\":" + QByteArray::number(manager->getSettings()->getId());
+		if(!manager->knownDisplays().contains(PM_DALARM)) {
+			json += ",\"valid\":false}";
+			continue;
+		}
+
+		int raw = manager->getDisplay(PM_DALARM).getRawIntValue();
+		json += ",\"valid\":true,\"upToDate\":";
+		json += manager->displayUpToDate(PM_DALARM) ? "true" : "false";
+		json += ",\"raw\":" + QByteArray::number(raw);
+		for(unsigned int i = 0; i < sizeof(alarms) / sizeof(alarms[0]); i++) {
+			json += ",\"" + QByteArray(alarms[i].name) + "\":" + ((raw & alarms[i].mask) ? "true" : "false");
+		}
+		json += "}";
+	}
+	json += "]";
+	return json;
+}
+
+QByteArray StatusServer::statsJson(const QList<SiteManager *> & managers) {
+	QByteArray json = "[";
+	bool first = true;
+	foreach(SiteManager *manager, managers) {
+		if(!first)
+			json += ",";
+		first = false;
+
+		double load = manager->linkLoad();
+		json += "{\"site\":" + QByteArray::number(manager->getSettings()->getId())
+			+ ",\"status\":" + statusString(manager->getStatus())
+			+ ",\"readTimeMs\":" + QByteArray::number(manager->averageReadTime(), 'f', 1)
+			+ ",\"lastCycleMs\":" + QByteArray::number(manager->lastCycleTime())
+			+ ",\"linkLoad\":" + QByteArray::number(load, 'f', 3)
+			+ ",\"saturated\":" + (load > 1.0 ? "true" : "false")
+			+ ",\"displays\":" + QByteArray::number(manager->knownDisplays().size()) + "}";
+	}
+	json += "]";
+	return json;
+}
+
+QByteArray StatusServer::statusString(SiteManager::Status status) {
+	switch(status) {
+		case SiteManager::SiteStopped: return "\"stopped\"";
+		case SiteManager::SiteUpdating: return "\"updating\"";
+		case SiteManager::SiteDownloadingLogged: return "\"downloadingLogged\"";
+		case SiteManager::SiteError: return "\"error\"";
+		default: return "\"unknown\"";
+	}
+}
+
+QByteArray StatusServer::jsonString(const QString & s) {
+	QByteArray json = "\"";
+	QByteArray utf8 = s.toUtf8();
+	for(int i = 0; i < utf8.size(); i++) {
+		char c = utf8[i];
+		switch(c) {
+			case '"': json += "\\\""; break;
+			case '\\': json += "\\\\"; break;
+			case '\n': json += "\\n"; break;
+			case '\r': json += "\\r"; break;
+			case '\t': json += "\\t"; break;
+			default:
+				if((unsigned char) c < 0x20)
+					json += "\\u00" + QByteArray::number((unsigned char) c, 16).rightJustified(2, '0');
+				else
+					json += c;
+		}
+	}
+	json += "\"";
+	return json;
+}
+
+void StatusServer::displayUpdated(PMDisplayNumber display) {
+	if(eventClients.isEmpty())
+		return;
+
+	changedDisplays.insert(QPair<SiteManager *, int>((SiteManager *) sender(), display));
+	if(!eventTimer->isActive())
+		eventTimer->start(EVENT_INTERVAL);
+}
+
+void StatusServer::allDisplaysUpdated() {
+	if(eventClients.isEmpty())
+		return;
+
+	SiteManager *manager = (SiteManager *) sender();
+	DisplaySet known = manager->knownDisplays();
+	for(int slot = known.first(); slot >= 0; slot = known.next(slot)) {
+		changedDisplays.insert(QPair<SiteManager *, int>(manager, slotDisplay(slot)));
+	}
+	if(!eventTimer->isActive())
+		eventTimer->start(EVENT_INTERVAL);
+}
+
+void StatusServer::statusChanged(SiteManager::Status newStatus) {
+	Q_UNUSED(newStatus);
+	if(eventClients.isEmpty())
+		return;
+
+	writeEvent("event: status\ndata: " + siteJson((SiteManager *) sender()) + "\n\n");
+}
+
+void StatusServer::sendEvents() {
+	if(changedDisplays.isEmpty() || eventClients.isEmpty()) {
+		changedDisplays.clear();
+		return;
+	}
+
+	// Group the changes by site, in the same format as /values
+	QMap<SiteManager *, QList<int> > bySite;
+	QPair<SiteManager *, int> change;
+	foreach(change, changedDisplays) {
+		bySite[change.first].append(change.second);
+	}
+	changedDisplays.clear();
+
+	QByteArray json = "[";
+	bool firstSite = true;
+	QMap<SiteManager *, QList<int> >::iterator it;
+	for(it = bySite.begin(); it != bySite.end(); ++it) {
+		if(!firstSite)
+			json += ",";
+		firstSite = false;
+
+		qSort(it.value());
+		json += "{\"site\":" + QByteArray::number(it.key()->getSettings()->getId()) + ",\"displays\":[";
+		bool first = true;
+		foreach(int display, it.value()) {
+			if(!first)
+				json += ",";
+			first = false;
+			json += displayJson(it.key(), (enum PMDisplayNumber) display);
+		}
+		json += "]}";
+	}
+	json += "]";
+
+	writeEvent("event: values\ndata: " + json + "\n\n");
+}
+
+// Comments are ignored by clients, but stop proxies and idle timeouts from closing the stream
+void StatusServer::sendKeepAlive() {
+	writeEvent(":\n\n");
+}
+
+// Sends to every event client. A client that has stopped reading is dropped rather than buffered forever
+void StatusServer::writeEvent(const QByteArray & event) {
+	foreach(QTcpSocket *socket, eventClients) {
+		if(socket->bytesToWrite() > MAX_EVENT_BACKLOG) {
+			eventClients.removeAll(socket);
+			socket->abort();
+			continue;
+		}
+		socket->write(event);
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef STATUSSERVER_H
+#define STATUSSERVER_H
+
+#include "pmdefs.h"
+#include "sitemanager.h"
+
+#include <QObject>
+#include <QList>
+#include <QSet>
+#include <QPair>
+#include <QMap>
+#include <QByteArray>
+
+class SitesList;
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+
+/* This class is a small HTTP server, bound to localhost, that lets other programs read what
+   the SiteManagers already know without opening their own connections to the PentaMetrics.
+   Every request is answered from the managers' current values, so it never causes any
+   communication with a device.
+
+	GET /sites    The configured sites and their status
+	GET /values   The latest value of every display that is being polled, for each site
+	GET /alarms   The alarm and relay state of each site
+	GET /stats    Per-site link statistics
+	GET /events   A server-sent events stream. Display changes are sent as "values" events,
+	              at most every EVENT_INTERVAL ms, and status changes as "status" events
+	GET /history  The samples of one display kept by the HistoryStore, as [time, raw] pairs.
+	              Takes ?site=<id>&display=<n>, and optionally from=<time>&to=<time> in
+	              seconds since the epoch (the last hour by default, at most MAX_HISTORY_SPAN)
+
+   /values, /alarms and /stats take an optional ?site=<id>. All responses are JSON.
+ */
+class StatusServer : public QObject {
+	Q_OBJECT
+
+public:
+	StatusServer(SitesList *sitesList, quint16 port, QObject *parent = NULL);
+	~StatusServer();
+
+	bool isListening();
+
+private slots:
+	void managersAdded(const QList<SiteManager *> & managers);
+	void managersRemoved(const QList<SiteManager *> & managers);
+
+	void newConnection();
+	void readRequest();
+	void clientDisconnected();
+
+	void displayUpdated(PMDisplayNumber display);
+	void allDisplaysUpdated();
+	void statusChanged(SiteManager::Status newStatus);
+	void sendEvents();
+	void sendKeepAlive();
+
+private:
+	void handleRequest(QTcpSocket *socket, const QByteArray & method, const QByteArray & target);
+	void sendResponse(QTcpSocket *socket, int status, const QByteArray & reason, const QByteArray & body);
+	void writeEvent(const QByteArray & event);
+	void sendHistory(QTcpSocket *socket, const QByteArray & query);
+
+	QList<SiteManager *> selectedManagers(const QByteArray & query, bool & found);
+	QByteArray sitesJson();
+	QByteArray valuesJson(const QList<SiteManager *> & managers);
+	QByteArray alarmsJson(const QList<SiteManager *> & managers);
+	QByteArray statsJson(const QList<SiteManager *> & managers);
+
+	static QByteArray siteJson(SiteManager *manager);
+	static QByteArray displayJson(SiteManager *manager, enum PMDisplayNumber display);
+	static QByteArray statusString(SiteManager::Status status);
+	static QByteArray jsonString(const QString & s);
+
+	SitesList *sitesList;
+	QTcpServer *server;
+
+	QMap<QTcpSocket *, QByteArray> requestBuffers; // Data received so far from clients that haven't sent a whole request
+	QList<QTcpSocket *> eventClients;
+
+	QSet<QPair<SiteManager *, int> > changedDisplays; // Displays changed since the last "values" event
+	QTimer *eventTimer;
+	QTimer *keepAliveTimer;
+};
+
+#endif
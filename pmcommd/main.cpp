@@ -0,0 +1,99 @@
+#include "pmcommdaemon.h"
+#include "libpmcomm.h"
+#include "appsettings.h"
+#include "ioscheduler.h"
+#include "historystore.h"
+#include "loggeddownloader.h"
+#include "loggeddata.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QStringList>
+#include <QScopedPointer>
+#include <QSqlDatabase>
+
+#include <cstdio>
+
+static void usage() {
+	fprintf(stderr, "Usage: pmcommd [--config FILE] [--no-poll] [--rebuild-rollups]\n"
+		"  --config FILE       Read the sites and settings from the INI file FILE instead of\n"
+		"                      the settings shared with PMComm\n"
+		"  --no-poll           Only download logged data; don't poll the selected displays\n"
+		"  --rebuild-rollups   Recompute the hourly and daily rollups of the logged data,\n"
+		"                      then exit\n");
+}
+
+// Recomputes the rollups in the logged data database. Returns the exit status
+static int rebuildRollups() {
+	int status = 1;
+	{
+		QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "loggeddata");
+		db.setDatabaseName(LoggedDownloader::databasePath());
+		if(!db.open() || !LoggedData::setupDB(db) || !LoggedData::configureConnection(db))
+			fprintf(stderr, "pmcommd: could not open logged data database\n");
+		else if(!LoggedData::rebuildRollups(db))
+			fprintf(stderr, "pmcommd: could not rebuild the rollups\n");
+		else
+			status = 0;
+		db.close();
+	}
+	QSqlDatabase::removeDatabase("loggeddata");
+	return status;
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	PMNetInitialize();
+
+	// Same names as PMComm, so by default the daemon shares its settings and database
+	QCoreApplication::setOrganizationName("Bogart Engineering");
+	QCoreApplication::setOrganizationDomain("bogartengineering.com");
+	QCoreApplication::setApplicationName("PMComm");
+	QCoreApplication::setApplicationVersion(APP_VERSION);
+
+	QString configPath;
+	bool poll = true;
+	bool rebuild = false;
+	QStringList args = app.arguments();
+	for(int i = 1; i < args.size(); i++) {
+		if(args[i] == "--config" && i + 1 < args.size()) {
+			configPath = args[++i];
+		} else if(args[i] == "--no-poll") {
+			poll = false;
+		} else if(args[i] == "--rebuild-rollups") {
+			rebuild = true;
+		} else {
+			usage();
+			return 2;
+		}
+	}
+
+	if(rebuild)
+		return rebuildRollups();
+
+	QScopedPointer<QSettings> settings;
+	if(configPath.isEmpty())
+		settings.reset(new QSettings);
+	else
+		settings.reset(new QSettings(configPath, QSettings::IniFormat));
+	AppSettings appSettings(settings.data());
+	AppSettings::setSingletonInstance(&appSettings);
+
+	IOScheduler ioScheduler(appSettings.getIOThreadCount());
+	IOScheduler::setSingletonInstance(&ioScheduler);
+
+	// History of polled values, if it is enabled
+	QScopedPointer<HistoryStore> historyStore;
+	if(appSettings.getHistoryEnabled()) {
+		historyStore.reset(new HistoryStore(HistoryStore::defaultLocation(), appSettings.getHistoryRawDays(), appSettings.getHistoryRetentionDays()));
+		HistoryStore::setSingletonInstance(historyStore.data());
+	}
+
+	PMCommDaemon daemon(poll);
+	if(!daemon.isInitialized()) {
+		fprintf(stderr, "pmcommd: could not open logged data database\n");
+		return 1;
+	}
+
+	return app.exec();
+}
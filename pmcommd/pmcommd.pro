@@ -0,0 +1,48 @@
+# Uncomment for debugging
+# CONFIG += debug
+
+# Application version (keep in sync with pmcomm.pro)
+VERSION = 2.0
+FULL_VERSION = "2.0 Beta 2"
+
+
+
+# Configs below here shouldn't typically need modification
+
+# The daemon only builds against Qt5, since Qt4 needs QtGui to find the data location
+lessThan(QT_MAJOR_VERSION, 5): error("pmcommd requires Qt5")
+
+cache()
+
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+# Application name
+TARGET = pmcommd
+
+# Leaves out the parts of the shared classes that need QtGui
+DEFINES += PMCOMM_HEADLESS
+
+# Define the preprocessor macro to get the application version in our application
+DEFINES += APP_VERSION=\"\\\"$$FULL_VERSION\\\"\"
+
+# Disable debug output (it will still print if CONFIG += debug is present above)
+CONFIG(release, debug|release) {
+    DEFINES += QT_NO_DEBUG_OUTPUT=1
+}
+
+# Communication, settings and logged data classes shared with PMComm
+include(../pmcomm/core.pri)
+
+# Set up installation
+isEmpty(PREFIX) {
+	PREFIX = /usr/local
+}
+
+target.path = $$PREFIX/bin/
+INSTALLS += target
+
+SOURCES  += pmcommdaemon.cpp \
+			main.cpp
+HEADERS  += pmcommdaemon.h
@@ -0,0 +1,81 @@
+#include "pmcommdaemon.h"
+
+#include "appsettings.h"
+#include "siteslist.h"
+#include "sitemanager.h"
+#include "sitesettings.h"
+#include "loggeddownloader.h"
+#include "statusserver.h"
+
+#include <QTimer>
+
+#include <QDebug>
+
+PMCommDaemon::PMCommDaemon(bool poll, QObject *parent) : QObject(parent) {
+	this->poll = poll;
+	displays = AppSettings::getInstance()->getSelectedDisplays();
+
+	retryTimer = new QTimer(this);
+	retryTimer->setSingleShot(true);
+	connect(retryTimer, SIGNAL(timeout()), this, SLOT(retryFailed()));
+
+	sitesList = new SitesList(this);
+	connect(sitesList, SIGNAL(managersAdded(const QList<SiteManager *> &)), this, SLOT(managersAdded(const QList<SiteManager *> &)));
+	connect(sitesList, SIGNAL(managersRemoved(const QList<SiteManager *> &)), this, SLOT(managersRemoved(const QList<SiteManager *> &)));
+
+	downloader = new LoggedDownloader(sitesList, this);
+	if(downloader->isInitialized())
+		connect(downloader, SIGNAL(downloadDBError()), this, SLOT(downloadDBError()));
+
+	if(AppSettings::getInstance()->getServerEnabled())
+		new StatusServer(sitesList, AppSettings::getInstance()->getServerPort(), this);
+
+	managersAdded(sitesList->getManagers().values());
+}
+
+bool PMCommDaemon::isInitialized() {
+	return downloader->isInitialized();
+}
+
+void PMCommDaemon::managersAdded(const QList<SiteManager *> & managers) {
+	foreach(SiteManager *manager, managers) {
+		connect(manager, SIGNAL(communicationsError()), this, SLOT(handleError()));
+
+		if(!poll)
+			continue;
+		foreach(enum PMDisplayNumber display, displays) {
+			manager->subscribe(display);
+		}
+		manager->startUpdating();
+		qDebug() << "Polling site" << manager->getSettings()->getName();
+	}
+}
+
+void PMCommDaemon::managersRemoved(const QList<SiteManager *> & managers) {
+	foreach(SiteManager *manager, managers) {
+		failed.remove(manager);
+	}
+}
+
+void PMCommDaemon::handleError() {
+	SiteManager *manager = (SiteManager *) sender();
+	if(manager == NULL)
+		return;
+
+	qWarning() << "Error communicating with site" << manager->getSettings()->getName() << "- retrying in" << retryDelay / 1000 << "seconds";
+	failed.insert(manager);
+	if(!retryTimer->isActive())
+		retryTimer->start(retryDelay);
+}
+
+void PMCommDaemon::retryFailed() {
+	QSet<SiteManager *> toRetry = failed;
+	failed.clear();
+	foreach(SiteManager *manager, toRetry) {
+		manager->finishError(true);
+	}
+}
+
+void PMCommDaemon::downloadDBError() {
+	qWarning() << "Could not write logged data to the database";
+}
@@ -0,0 +1,52 @@
+#ifndef PMCOMMDAEMON_H
+#define PMCOMMDAEMON_H
+
+#include "pmdefs.h"
+
+#include <QObject>
+#include <QList>
+#include <QSet>
+
+class SitesList;
+class SiteManager;
+class LoggedDownloader;
+class QTimer;
+
+/* This class does the unattended part of what the main window does: it keeps every
+   configured site connected, polls the selected displays, and lets the LoggedDownloader
+   store logged data on each site's download interval.
+
+   There is nobody to ask whether to retry after a communications error, so the daemon
+   always retries, after waiting retryDelay milliseconds to avoid hammering a site that
+   is down.
+ */
+class PMCommDaemon : public QObject {
+	Q_OBJECT
+
+public:
+	PMCommDaemon(bool poll, QObject *parent = NULL);
+
+	// Returns false if the logged data database could not be opened
+	bool isInitialized();
+
+	static const int retryDelay = 60000;
+
+private slots:
+	void managersAdded(const QList<SiteManager *> & managers);
+	void managersRemoved(const QList<SiteManager *> & managers);
+	void handleError();
+	void retryFailed();
+	void downloadDBError();
+
+private:
+	bool poll;
+	QList<enum PMDisplayNumber> displays;
+
+	SitesList *sitesList;
+	LoggedDownloader *downloader;
+
+	QSet<SiteManager *> failed; // Managers waiting for the retry timer
+	QTimer *retryTimer;
+};
+
+#endif